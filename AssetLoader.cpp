@@ -0,0 +1,97 @@
+#include "AssetLoader.h"
+#include "Profiler.h"
+#include "soil.h"
+
+#include <iostream>
+
+ThreadPool * AssetLoader::pool = NULL;
+std::mutex AssetLoader::lock;
+std::deque<std::function<void()>> AssetLoader::uploads;
+std::atomic<int> AssetLoader::in_flight(0);
+long long AssetLoader::start_time = 0;
+bool AssetLoader::reported = true;
+
+DecodedImage::~DecodedImage()
+{
+	if (data == NULL) return;
+	if (from_soil) SOIL_free_image_data(data);
+	else delete[] data;
+}
+
+void AssetLoader::start(int threads)
+{
+	if (pool) return;
+	pool = new ThreadPool(threads, "asset loader");
+	start_time = Profiler::now();
+	reported = false;
+	std::cout << "Loading assets on " << threads << " threads" << std::endl;
+}
+
+void AssetLoader::shutdown()
+{
+	// Joins the workers, so no decode job can touch an object after this returns
+	delete pool;
+	pool = NULL;
+
+	std::lock_guard<std::mutex> guard(lock);
+	uploads.clear();
+	in_flight = 0;
+}
+
+void AssetLoader::load(std::function<void()> decode, std::function<void()> upload)
+{
+	if (pool == NULL)
+	{
+		decode();
+		upload();
+		return;
+	}
+
+	in_flight++;
+	pool->enqueue([decode, upload]()
+	{
+		decode();
+		std::lock_guard<std::mutex> guard(lock);
+		uploads.push_back(upload);
+	});
+}
+
+void AssetLoader::drain(double budget_ms)
+{
+	PROFILE_ZONE("AssetLoader::drain");
+	long long deadline = Profiler::now() + (long long)(budget_ms * 1000.0);
+
+	// Always make progress by at least one upload, even if it blows the budget
+	do
+	{
+		std::function<void()> upload;
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			if (uploads.empty()) break;
+			upload = uploads.front();
+			uploads.pop_front();
+		}
+		upload();
+		in_flight--;
+	} while (Profiler::now() < deadline);
+
+	if (!reported && in_flight == 0)
+	{
+		reported = true;
+		std::cout << "All assets loaded after " << (Profiler::now() - start_time) / 1000.0 << " ms" << std::endl;
+	}
+}
+
+void AssetLoader::finish()
+{
+	while (in_flight > 0)
+	{
+		if (pool) pool->wait_idle();
+		drain(1000.0);
+	}
+}
+
+int AssetLoader::pending()
+{
+	return in_flight;
+}
@@ -0,0 +1,49 @@
+#pragma once
+#ifndef _ASSETLOADER_H_
+#define _ASSETLOADER_H_
+
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+
+#include "ThreadPool.h"
+
+#define ASSET_UPLOAD_BUDGET_MS 4.0	// Main thread time per frame spent on GL uploads
+
+// Pixels decoded on a worker thread, waiting for their GL upload
+struct DecodedImage
+{
+	unsigned char * data;
+	int width;
+	int height;
+	bool from_soil;	// SOIL allocates with malloc, loadPPM with new[]
+
+	DecodedImage() : data(NULL), width(0), height(0), from_soil(false) {}
+	~DecodedImage();
+};
+
+// Loads assets in two halves: file I/O and decoding run on a worker pool, then the GL upload is
+// queued for the main thread (the only thread with a GL context) and drained a little each frame.
+// Until start() is called both halves run immediately, so loading is just synchronous.
+class AssetLoader
+{
+public:
+	static void start(int threads);
+	static void shutdown();
+	static void load(std::function<void()> decode, std::function<void()> upload);
+	static void drain(double budget_ms);	// Run queued uploads, main thread only
+	static void finish();					// Block until everything has loaded
+	static int pending();
+
+private:
+	static ThreadPool * pool;
+	static std::mutex lock;
+	static std::deque<std::function<void()>> uploads;
+	static std::atomic<int> in_flight;
+	static long long start_time;
+	static bool reported;
+};
+
+#endif
@@ -0,0 +1,198 @@
+#include "AssetPack.h"
+#include "VFS.h"
+#include "Lz4.h"
+#include "TextureBaker.h"
+#include "MeshCache.h"
+#include "Profiler.h"
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Everything the renderer loads. Baked textures and mesh caches next to these get packed too.
+static const char * pack_list[] = {
+	"../shader.vert",
+	"../shader.frag",
+	"../terrainShader.vert",
+	"../terrainShader.frag",
+	"../water.vert",
+	"../water.frag",
+	"../patch.vert",
+	"../patch.tesc",
+	"../patch.tese",
+	"../upsample.vert",
+	"../upsample.frag",
+	"../assets/skybox_images/TropicalSunnyDayLeft2048.ppm",
+	"../assets/skybox_images/TropicalSunnyDayRight2048.ppm",
+	"../assets/skybox_images/TropicalSunnyDayUp2048.ppm",
+	"../assets/skybox_images/TropicalSunnyDayDown2048.ppm",
+	"../assets/skybox_images/TropicalSunnyDayFront2048.ppm",
+	"../assets/skybox_images/TropicalSunnyDayBack2048.ppm",
+	"../assets/textures/sand2.ppm",
+	"../assets/textures/grass.ppm",
+	"../assets/textures/rocky.ppm",
+	"../assets/textures/waterDUDV.png",
+	"../assets/textures/normal.png",
+	"../assets/SanDiegoTerrain.jpg",
+	"../assets/lake.png",
+	"../assets/coast.jpg",
+	"../assets/object_files/Anchor.obj",
+	"../assets/object_files/beachball.obj",
+	"../assets/object_files/beachchair_C.obj",
+	"../assets/object_files/Citiezn_snips.obj",
+	"../assets/object_files/Hut_obj.obj",
+	"../assets/object_files/obj.obj",
+	"../assets/object_files/Stone_F_3.obj",
+	"../assets/object_files/Stone_Forest_1.obj",
+};
+
+struct PackSource
+{
+	std::string path;
+	std::string name;	// Normalised, the table of contents key
+	bool compress;
+};
+
+static bool read_file(const char * path, std::vector<char> & out, struct stat & st)
+{
+	if (stat(path, &st) != 0) return false;
+	FILE * fp = fopen(path, "rb");
+	if (fp == NULL) return false;
+	out.resize((size_t)st.st_size);
+	bool ok = out.empty() || fread(&out[0], out.size(), 1, fp) == 1;
+	fclose(fp);
+	return ok;
+}
+
+bool AssetPack::build(const char * pack_path)
+{
+	PROFILE_ZONE("AssetPack::build");
+	double start = Profiler::now();
+
+	// Sources plus whatever was built from them. Baked textures and mesh caches are already in
+	// the layout the loaders want, they stay uncompressed so they're used straight from the mapping.
+	std::vector<PackSource> sources;
+	int listed = sizeof(pack_list) / sizeof(pack_list[0]);
+	int missing = 0;
+	for (int i = 0; i < listed; i++)
+	{
+		std::string path = pack_list[i];
+		struct stat st;
+		if (stat(path.c_str(), &st) != 0)
+		{
+			// Left out, the VFS falls back to loose files for anything the pack doesn't have
+			std::cerr << "could not find " << path << ", leaving it out of the pack" << std::endl;
+			missing++;
+			continue;
+		}
+		PackSource source = { path, VFS::normalize(path.c_str()), true };
+		sources.push_back(source);
+
+		size_t dot = path.rfind('.');
+		const char * derived[] = { BAKED_EXTENSION, MESH_CACHE_EXTENSION };
+		for (int k = 0; k < 2; k++)
+		{
+			std::string sibling = path.substr(0, dot) + derived[k];
+			if (stat(sibling.c_str(), &st) != 0) continue;
+			PackSource built = { sibling, VFS::normalize(sibling.c_str()), false };
+			sources.push_back(built);
+		}
+	}
+	std::sort(sources.begin(), sources.end(), [](const PackSource & a, const PackSource & b) { return a.name < b.name; });
+
+	// Names block
+	PackHeader header;
+	memcpy(header.magic, "APAK", 4);
+	header.version = PACK_VERSION;
+	header.entry_count = (unsigned int)sources.size();
+	std::vector<char> names;
+	std::vector<PackEntry> entries(sources.size());
+	for (unsigned int i = 0; i < sources.size(); i++)
+	{
+		entries[i].name_offset = (unsigned int)names.size();
+		names.insert(names.end(), sources[i].name.begin(), sources[i].name.end());
+		names.push_back('\0');
+	}
+	header.names_size = (unsigned int)names.size();
+
+	// Data goes after the table, which is written last once the offsets are known
+	std::string temp = std::string(pack_path) + ".tmp";
+	FILE * fp = fopen(temp.c_str(), "wb");
+	if (fp == NULL)
+	{
+		std::cerr << "could not open " << temp << " for writing" << std::endl;
+		return false;
+	}
+	unsigned long long offset = sizeof(header) + entries.size() * sizeof(PackEntry) + names.size();
+	bool ok = true;
+	unsigned long long raw_total = 0;
+	std::vector<char> contents, packed;
+	static const char padding[PACK_ALIGNMENT] = { 0 };
+	for (unsigned int i = 0; i < sources.size() && ok; i++)
+	{
+		PackEntry & entry = entries[i];
+		struct stat st;
+		if (!read_file(sources[i].path.c_str(), contents, st))
+		{
+			std::cerr << "could not read " << sources[i].path << std::endl;
+			ok = false;
+			break;
+		}
+
+		unsigned long long aligned = (offset + PACK_ALIGNMENT - 1) / PACK_ALIGNMENT * PACK_ALIGNMENT;
+		entry.offset = aligned;
+		entry.size = contents.size();
+		entry.source_mtime = (unsigned long long)st.st_mtime;
+		entry.flags = 0;
+
+		const char * data = contents.empty() ? NULL : &contents[0];
+		size_t stored = contents.size();
+		if (sources[i].compress && !contents.empty())
+		{
+			packed.resize(Lz4::bound((int)contents.size()));
+			int packed_size = Lz4::compress(&contents[0], (int)contents.size(), &packed[0], (int)packed.size());
+			if (packed_size > 0 && packed_size < contents.size() * PACK_MIN_SAVING)
+			{
+				data = &packed[0];
+				stored = packed_size;
+				entry.flags = PACK_LZ4;
+			}
+		}
+		entry.packed_size = stored;
+
+		// Place the first entry after the table, the table itself is written at the end
+		if (i == 0) ok = fseek(fp, (long)aligned, SEEK_SET) == 0;
+		else ok = fwrite(padding, 1, (size_t)(aligned - offset), fp) == aligned - offset;
+		ok = ok && (stored == 0 || fwrite(data, 1, stored, fp) == stored);
+		offset = aligned + stored;
+		raw_total += entry.size;
+		printf("  %-60s %10llu -> %10llu%s\n", sources[i].name.c_str(), entry.size, entry.packed_size, entry.flags & PACK_LZ4 ? " lz4" : "");
+	}
+	ok = ok && !entries.empty() && fseek(fp, 0, SEEK_SET) == 0;
+	ok = ok && fwrite(&header, sizeof(header), 1, fp) == 1;
+	ok = ok && fwrite(&entries[0], sizeof(PackEntry), entries.size(), fp) == entries.size();
+	ok = ok && fwrite(&names[0], 1, names.size(), fp) == names.size();
+	ok = fclose(fp) == 0 && ok;
+	if (!ok)
+	{
+		std::cerr << "could not write " << temp << std::endl;
+		remove(temp.c_str());
+		return false;
+	}
+	remove(pack_path);	// rename won't replace an existing file on Windows
+	if (rename(temp.c_str(), pack_path) != 0)
+	{
+		std::cerr << "could not write " << pack_path << std::endl;
+		remove(temp.c_str());
+		return false;
+	}
+
+	printf("Packed %d files into %s: %.1f MB -> %.1f MB in %.0f ms\n", (int)sources.size(), pack_path,
+		raw_total / (1024.0 * 1024.0), offset / (1024.0 * 1024.0), (Profiler::now() - start) / 1000.0);
+	return missing == 0;
+}
@@ -0,0 +1,40 @@
+#pragma once
+#ifndef _ASSETPACK_H_
+#define _ASSETPACK_H_
+
+#define PACK_PATH "../assets.pak"	// Mounted at startup if it exists, --pack writes it
+#define PACK_VERSION 1
+#define PACK_ALIGNMENT 64			// Entry data starts on a cache line, mapped streams can be used in place
+#define PACK_MIN_SAVING 0.9			// Only keep the LZ4 version if it's under 90% of the original
+
+#define PACK_LZ4 1	// Entry flag: data is an LZ4 block, size is the unpacked size
+
+// On disk: this header, entry_count entries sorted by name, the names (each NUL terminated),
+// then the entry data, each aligned to PACK_ALIGNMENT
+struct PackHeader
+{
+	char magic[4];	// "APAK"
+	unsigned int version;
+	unsigned int entry_count;
+	unsigned int names_size;
+};
+
+struct PackEntry
+{
+	unsigned long long offset;		// From the start of the pack
+	unsigned long long size;		// Unpacked
+	unsigned long long packed_size;	// Bytes stored, same as size unless PACK_LZ4
+	unsigned long long source_mtime;	// Of the loose file when it was packed
+	unsigned int name_offset;		// Into the names block
+	unsigned int flags;
+};
+
+// Offline step: --pack gathers the loose assets (plus any .ctex/.mesh built from them) into a
+// single archive. Run it after --bake and after one launch has written the mesh caches.
+class AssetPack
+{
+public:
+	static bool build(const char * pack_path);
+};
+
+#endif
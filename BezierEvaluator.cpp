@@ -0,0 +1,151 @@
+#include "BezierEvaluator.h"
+#include "Profiler.h"
+
+glm::vec3 BezierSamples::get_position(int patch, int u, int v) const
+{
+	int i = (patch * samples + v) * samples + u;
+	return glm::vec3(position[0][i], position[1][i], position[2][i]);
+}
+
+glm::vec3 BezierSamples::get_normal(int patch, int u, int v) const
+{
+	int i = (patch * samples + v) * samples + u;
+	return glm::vec3(normal[0][i], normal[1][i], normal[2][i]);
+}
+
+template <int Degree>
+void BezierEvaluator<Degree>::bernstein(float t, float basis[ORDER], float derivative[ORDER])
+{
+	// Powers of t and 1 - t by multiplication, binomials by Pascal's rule
+	float s = 1.0f - t;
+	float t_power[ORDER], s_power[ORDER], binomial[ORDER];
+	t_power[0] = s_power[0] = 1.0f;
+	for (int k = 1; k < ORDER; k++)
+	{
+		t_power[k] = t_power[k - 1] * t;
+		s_power[k] = s_power[k - 1] * s;
+	}
+	binomial[0] = 1.0f;
+	for (int k = 1; k < ORDER; k++) binomial[k] = binomial[k - 1] * (Degree - k + 1) / k;
+	for (int k = 0; k < ORDER; k++) basis[k] = binomial[k] * t_power[k] * s_power[Degree - k];
+
+	// B'(k, n) = n * (B(k - 1, n - 1) - B(k, n - 1))
+	float lower[ORDER];
+	for (int k = 0; k < Degree; k++)
+	{
+		float b = 1.0f;
+		for (int m = 0; m < k; m++) b = b * (Degree - 1 - m) / (m + 1);
+		lower[k] = b * t_power[k] * s_power[Degree - 1 - k];
+	}
+	for (int k = 0; k < ORDER; k++)
+	{
+		float left = k > 0 ? lower[k - 1] : 0.0f;
+		float right = k < Degree ? lower[k] : 0.0f;
+		derivative[k] = Degree * (left - right);
+	}
+}
+
+template <int Degree>
+BezierEvaluator<Degree>::BezierEvaluator(int samples) : count(samples < 2 ? 2 : samples)
+{
+	bases.resize(ORDER * count);
+	derivatives.resize(ORDER * count);
+	for (int s = 0; s < count; s++)
+	{
+		// Integer steps, accumulating 1 / (count - 1) can miss the last sample
+		float t = (float)s / (count - 1);
+		float b[ORDER], d[ORDER];
+		bernstein(t, b, d);
+		for (int k = 0; k < ORDER; k++)
+		{
+			bases[k * count + s] = b[k];
+			derivatives[k * count + s] = d[k];
+		}
+	}
+}
+
+template <int Degree>
+void BezierEvaluator<Degree>::evaluate(const glm::vec3 * control, int patch_count, BezierSamples & out) const
+{
+	PROFILE_ZONE("BezierEvaluator::evaluate");
+	const int n = count;
+	const int area = n * n;
+	out.samples = n;
+	out.patches = patch_count;
+	for (int c = 0; c < 3; c++)
+	{
+		out.position[c].assign(area * patch_count, 0.0f);
+		out.normal[c].assign(area * patch_count, 0.0f);
+	}
+
+	// Per coordinate scratch: control rows against the u tables, and both tangents over the grid
+	std::vector<float> rows(ORDER * n), row_tangents(ORDER * n);
+	std::vector<float> tangent_u(3 * area), tangent_v(3 * area);
+
+	for (int p = 0; p < patch_count; p++)
+	{
+		const glm::vec3 * points = control + p * CONTROL_POINTS;
+		for (int c = 0; c < 3; c++)
+		{
+			// rows[j][u] = sum over i of P[j][i] * B_i(u), and the same against B'_i(u)
+			for (int i = 0; i < ORDER * n; i++) rows[i] = row_tangents[i] = 0.0f;
+			for (int j = 0; j < ORDER; j++)
+			{
+				float * row = &rows[j * n];
+				float * row_tangent = &row_tangents[j * n];
+				for (int i = 0; i < ORDER; i++)
+				{
+					float weight = points[j * ORDER + i][c];
+					const float * b = &bases[i * n];
+					const float * d = &derivatives[i * n];
+					for (int u = 0; u < n; u++)
+					{
+						row[u] += weight * b[u];
+						row_tangent[u] += weight * d[u];
+					}
+				}
+			}
+
+			// P[v][u] = sum over j of B_j(v) * rows[j][u], dP/du from the row tangents, dP/dv from B'_j(v)
+			float * position = &out.position[c][p * area];
+			float * du = &tangent_u[c * area];
+			float * dv = &tangent_v[c * area];
+			for (int i = 0; i < area; i++) du[i] = dv[i] = 0.0f;
+			for (int v = 0; v < n; v++)
+			{
+				float * position_row = position + v * n;
+				float * du_row = du + v * n;
+				float * dv_row = dv + v * n;
+				for (int j = 0; j < ORDER; j++)
+				{
+					float b = bases[j * n + v];
+					float d = derivatives[j * n + v];
+					const float * row = &rows[j * n];
+					const float * row_tangent = &row_tangents[j * n];
+					for (int u = 0; u < n; u++)
+					{
+						position_row[u] += b * row[u];
+						du_row[u] += b * row_tangent[u];
+						dv_row[u] += d * row[u];
+					}
+				}
+			}
+		}
+
+		// Normals, one cross product per sample across the planes
+		const float * ux = &tangent_u[0], * uy = &tangent_u[area], * uz = &tangent_u[2 * area];
+		const float * vx = &tangent_v[0], * vy = &tangent_v[area], * vz = &tangent_v[2 * area];
+		float * nx = &out.normal[0][p * area], * ny = &out.normal[1][p * area], * nz = &out.normal[2][p * area];
+		for (int i = 0; i < area; i++)
+		{
+			nx[i] = uy[i] * vz[i] - uz[i] * vy[i];
+			ny[i] = uz[i] * vx[i] - ux[i] * vz[i];
+			nz[i] = ux[i] * vy[i] - uy[i] * vx[i];
+		}
+	}
+}
+
+// Linear, quadratic and bicubic patches
+template class BezierEvaluator<1>;
+template class BezierEvaluator<2>;
+template class BezierEvaluator<3>;
@@ -0,0 +1,56 @@
+#pragma once
+#ifndef _BEZIEREVALUATOR_H_
+#define _BEZIEREVALUATOR_H_
+
+// Use of degrees is deprecated. Use radians instead.
+#ifndef GLM_FORCE_RADIANS
+#define GLM_FORCE_RADIANS
+#endif
+#include <glm/glm.hpp>
+
+#include <vector>
+
+// Patch surfaces sampled on a regular grid, structure of arrays so whole rows go through the
+// arithmetic together. Sample (u, v) of patch p is at p * samples * samples + v * samples + u.
+struct BezierSamples
+{
+	int samples;	// Per side, u and v both run 0..1 inclusive
+	int patches;
+	std::vector<float> position[3];	// x, y, z
+	std::vector<float> normal[3];	// cross(dP/du, dP/dv), not normalised
+
+	glm::vec3 get_position(int patch, int u, int v) const;
+	glm::vec3 get_normal(int patch, int u, int v) const;
+};
+
+// Evaluates tensor product Bezier patches of one degree at a fixed resolution. The Bernstein bases
+// and their derivatives are tabulated once per resolution, then each patch is two small matrix
+// products per coordinate (control rows times the u table, then the v table times those rows) with
+// the sample loops innermost and contiguous so the compiler vectorises them. Degree is a template
+// parameter so the loops over control points have fixed trip counts. Instantiated in
+// BezierEvaluator.cpp for degrees 1 to 3, Patch uses 3 (bicubic).
+template <int Degree>
+class BezierEvaluator
+{
+public:
+	enum { ORDER = Degree + 1, CONTROL_POINTS = (Degree + 1) * (Degree + 1) };
+
+	explicit BezierEvaluator(int samples);	// t = i / (samples - 1), so the ends are exactly 0 and 1
+
+	int samples() const { return count; }
+	float basis(int k, int s) const { return bases[k * count + s]; }
+	float derivative(int k, int s) const { return derivatives[k * count + s]; }
+
+	// patch_count patches of CONTROL_POINTS points each, rows of ORDER points along u
+	void evaluate(const glm::vec3 * control, int patch_count, BezierSamples & out) const;
+
+	// Bernstein basis and derivative at a single t
+	static void bernstein(float t, float basis[ORDER], float derivative[ORDER]);
+
+private:
+	int count;
+	std::vector<float> bases;		// ORDER rows of count samples
+	std::vector<float> derivatives;
+};
+
+#endif
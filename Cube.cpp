@@ -1,5 +1,9 @@
 #include "Cube.h"
 #include "Window.h"
+#include "AssetLoader.h"
+#include "TextureUploader.h"
+#include "ResourceCache.h"
+#include "VFS.h"
 
 Cube::Cube()
 {
@@ -50,11 +54,13 @@ Cube::~Cube()
 	glDeleteVertexArrays(1, &VAO);
 	glDeleteBuffers(1, &VBO);
 	glDeleteBuffers(1, &EBO);
-	glDeleteTextures(1, &textureID);
+	ResourceCache::release(RESOURCE_TEXTURE, textureID);
 }
 
 void Cube::draw(GLuint shaderProgram)
 { 
+	if (!ResourceCache::is_loaded(RESOURCE_TEXTURE, textureID)) return;	// Cube map still loading
+
 	// Calculate the combination of the model and view (camera inverse) matrices
 	glm::mat4 modelview = Window::V * toWorld;
 	// We need to calcullate this because modern OpenGL does not keep track of any matrix other than the viewport (D)
@@ -64,14 +70,11 @@ void Cube::draw(GLuint shaderProgram)
 	uModelview = glGetUniformLocation(shaderProgram, "modelview");
 	uView = glGetUniformLocation(shaderProgram, "view");
 
-	uMode = glGetUniformLocation(shaderProgram, "mode");
-
 	// Now send these values to the shader program
 	glm::mat4 view = glm::mat4(glm::mat3(Window::V));
 	glUniformMatrix4fv(uProjection, 1, GL_FALSE, &Window::P[0][0]);
 	glUniformMatrix4fv(uModelview, 1, GL_FALSE, &modelview[0][0]);
 	glUniformMatrix4fv(uView, 1, GL_FALSE, &view[0][0]);
-	glUniform1i(uMode, 2);
 
 	glEnable(GL_CULL_FACE);
 	glCullFace(GL_BACK);
@@ -91,15 +94,15 @@ void Cube::draw(GLuint shaderProgram)
 	glDisable(GL_TEXTURE_CUBE_MAP);
 }
 
-void Cube::update()
+void Cube::update(float dt)
 {
-	spin(1.0f);
+	spin(SKYBOX_SPIN_SPEED * dt);
 }
 
 void Cube::spin(float deg)
 {
 	// If you haven't figured it out from the last project, this is how you fix spin's behavior
-	toWorld = toWorld * glm::rotate(glm::mat4(1.0f), 1.0f / 180.0f * glm::pi<float>(), glm::vec3(0.0f, 1.0f, 0.0f));
+	toWorld = toWorld * glm::rotate(glm::mat4(1.0f), deg / 180.0f * glm::pi<float>(), glm::vec3(0.0f, 1.0f, 0.0f));
 }
 
 /** Load a ppm file from disk.
@@ -111,15 +114,16 @@ will be printed and this function will return 0
 **/
 unsigned char* Cube::loadPPM(const char* filename, int& width, int& height)
 {
+	PROFILE_ZONE("Cube::loadPPM");
 	const int BUFSIZE = 128;
-	FILE* fp;
+	VFSFile fp;
 	unsigned int read;
 	unsigned char* rawData;
 	char buf[3][BUFSIZE];
 	char* retval_fgets;
 	size_t retval_sscanf;
 
-	if ((fp = fopen(filename, "rb")) == NULL)
+	if (!VFS::open(filename, fp))
 	{
 		std::cerr << "error reading ppm file, could not locate " << filename << std::endl;
 		width = 0;
@@ -128,12 +132,12 @@ unsigned char* Cube::loadPPM(const char* filename, int& width, int& height)
 	}
 
 	// Read magic number:
-	retval_fgets = fgets(buf[0], BUFSIZE, fp);
+	retval_fgets = fp.gets(buf[0], BUFSIZE);
 
 	// Read width and height:
 	do
 	{
-		retval_fgets = fgets(buf[0], BUFSIZE, fp);
+		retval_fgets = fp.gets(buf[0], BUFSIZE);
 	} while (buf[0][0] == '#');
 	retval_sscanf = sscanf(buf[0], "%s %s", buf[1], buf[2]);
 	width = atoi(buf[1]);
@@ -142,13 +146,13 @@ unsigned char* Cube::loadPPM(const char* filename, int& width, int& height)
 	// Read maxval:
 	do
 	{
-		retval_fgets = fgets(buf[0], BUFSIZE, fp);
+		retval_fgets = fp.gets(buf[0], BUFSIZE);
 	} while (buf[0][0] == '#');
 
 	// Read image data:
 	rawData = new unsigned char[width * height * 3];
-	read = fread(rawData, width * height * 3, 1, fp);
-	fclose(fp);
+	read = fp.read(rawData, width * height * 3, 1);
+	fp.close();
 	if (read != 1)
 	{
 		std::cerr << "error parsing ppm file, incomplete data" << std::endl;
@@ -164,25 +168,16 @@ unsigned char* Cube::loadPPM(const char* filename, int& width, int& height)
 // load image file into texture object
 void Cube::loadTexture()
 {
-	GLuint texture;     // storage for one texture
-	int twidth, theight;   // texture width/height [pixels]
-	unsigned char* tdata;  // texture pixel data
+	// Water reflects the same six faces, whoever asks first loads them and the other shares the cube map
+	std::string key = "cubemap:clamp";
+	for (unsigned int i = 0; i < faces.size(); i++) key += std::string(";") + faces[i];
 
-	// Create ID for texture
-	glGenTextures(1, &texture);
+	bool created;
+	textureID = ResourceCache::acquire(RESOURCE_TEXTURE, key, []() { GLuint id; glGenTextures(1, &id); return id; }, &created);
+	if (!created) return;
 
 	// Set this texture to be the one we are working with
-	glBindTexture(GL_TEXTURE_CUBE_MAP, texture);
-
-	// Load image files
-	for (unsigned int i = 0; i < faces.size(); i++)
-	{
-		tdata = loadPPM(faces[i], twidth, theight);
-		if (tdata == NULL) return;
-
-		// Generate the texture
-		glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, 3, twidth, theight, 0, GL_RGB, GL_UNSIGNED_BYTE, tdata);
-	}
+	glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
 
 	// Set bi-linear filtering for both minification and magnification
 	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
@@ -190,7 +185,35 @@ void Cube::loadTexture()
 	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
 	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+	glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
 
-	textureID = texture;
+	// Load image files, each face is decoded on a loader thread and uploaded on the main thread
+	GLuint texture = textureID;
+	ResourceCache::begin_loading(RESOURCE_TEXTURE, texture, (int)faces.size());
+	for (unsigned int i = 0; i < faces.size(); i++)
+	{
+		const char * face = faces[i];
+		std::shared_ptr<DecodedImage> image(new DecodedImage());
+		std::shared_ptr<BakedTexture> baked(new BakedTexture());
+		AssetLoader::load([this, image, baked, face]() {
+			if (!TextureBaker::load(face, *baked))
+				image->data = loadPPM(face, image->width, image->height);
+		}, [image, baked, i, texture]() {
+			if (image->data == NULL && baked->empty()) {
+				ResourceCache::end_loading(RESOURCE_TEXTURE, texture);
+				return;
+			}
+
+			// Generate the texture
+			std::function<void()> done = [texture]() { ResourceCache::end_loading(RESOURCE_TEXTURE, texture); };
+			if (!baked->empty()) {
+				ResourceCache::add_size(RESOURCE_TEXTURE, texture, baked->data_size());
+				TextureUploader::upload_compressed(texture, GL_TEXTURE_CUBE_MAP, GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, baked, done);
+			}
+			else {
+				ResourceCache::add_size(RESOURCE_TEXTURE, texture, image->width * image->height * 3);
+				TextureUploader::upload(texture, GL_TEXTURE_CUBE_MAP, GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, image, done);
+			}
+		});
+	}
 }
-
@@ -17,6 +17,8 @@
 
 #include <vector>
 
+#define SKYBOX_SPIN_SPEED 60.0f	// Degrees per second
+
 class Cube
 {
 public:
@@ -34,15 +36,15 @@ public:
 		"../assets/skybox_images/TropicalSunnyDayBack2048.ppm"
 	};
 
-	void draw(GLuint);
-	void update();
+	void draw(GLuint);	// Takes the FEATURE_SKYBOX variant of shader.*
+	void update(float dt);
 	void spin(float);
 	unsigned char* loadPPM(const char* filename, int& width, int& height);
 	void loadTexture();
 
 	// These variables are needed for the shader program
 	GLuint VBO, VAO, EBO;
-	GLuint uProjection, uModelview, uView, uMode;
+	GLuint uProjection, uModelview, uView;
 	GLuint textureID;
 };
 
@@ -1,63 +1,147 @@
 #include "Curve.h"
 #include "Window.h"
 
-Curve::Curve(GLfloat p[])
-{
-	for (int i = 0; i < 2250; i++)
-	{
-		points[i] = p[i];
-	}
-	for (int i = 0; i < 750; i++) indices[i] = i;
+#include <string.h>
+#include <algorithm>
 
+Curve::Curve(float tolerance) : tolerance(tolerance), used(0), live(0), capacity(0), upload_begin(0), upload_end(0)
+{
 	toWorld = glm::mat4(1.0f);
 
 	// Create array object and buffers. Remember to delete your buffers when the object is destroyed!
 	glGenVertexArrays(1, &VAO);
 	glGenBuffers(1, &VBO);
-	glGenBuffers(1, &EBO);
-	
+
 	// Bind the Vertex Array Object (VAO) first, then bind the associated buffers to it.
 	// Consider the VAO as a container for all your buffers.
 	glBindVertexArray(VAO);
-
-	// Now bind a VBO to it as a GL_ARRAY_BUFFER. The GL_ARRAY_BUFFER is an array containing relevant data to what
-	// you want to draw, such as vertices, normals, colors, etc.
 	glBindBuffer(GL_ARRAY_BUFFER, VBO);
-	// glBufferData populates the most recently bound buffer with data starting at the 3rd argument and ending after
-	// the 2nd argument number of indices. How does OpenGL know how long an index spans? Go to glVertexAttribPointer.
-	glBufferData(GL_ARRAY_BUFFER, sizeof(points), points, GL_STATIC_DRAW);
-	// Enable the usage of layout location 0 (check the vertex shader to see what this is)
+	resize_buffer(CURVE_INITIAL_VERTICES);
 	glEnableVertexAttribArray(0);
-	glVertexAttribPointer(0,// This first parameter x should be the same as the number passed into the line "layout (location = x)" in the vertex shader. In this case, it's 0. Valid values are 0 to GL_MAX_UNIFORM_LOCATIONS.
-		3, // This second line tells us how any components there are per vertex. In this case, it's 3 (we have an x, y, and z component)
-		GL_FLOAT, // What type these components are
-		GL_FALSE, // GL_TRUE means the values should be normalized. GL_FALSE means they shouldn't
-		3 * sizeof(GLfloat), // Offset between consecutive indices. Since each of our vertices have 3 floats, they should have the size of 3 floats in between
-		(GLvoid*)0); // Offset of the first vertex's component. In our case it's 0 since we don't pad the vertices array with anything.
-
-	// We've sent the vertex data over to OpenGL, but there's still something missing.
-	// In what order should it draw those vertices? That's why we'll need a GL_ELEMENT_ARRAY_BUFFER for this.
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), (GLvoid*)0);
 
 	// Unbind the currently bound buffer so that we don't accidentally make unwanted changes to it.
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
 	// Unbind the VAO now so we don't accidentally tamper with it.
-	// NOTE: You must NEVER unbind the element array buffer associated with a VAO!
 	glBindVertexArray(0);
 }
 
 Curve::~Curve()
 {
-	// Delete previously generated buffers. Note that forgetting to do this can waste GPU memory in a 
+	// Delete previously generated buffers. Note that forgetting to do this can waste GPU memory in a
 	// large project! This could crash the graphics driver due to memory leaks, or slow down application performance!
 	glDeleteVertexArrays(1, &VAO);
 	glDeleteBuffers(1, &VBO);
-	glDeleteBuffers(1, &EBO);
+}
+
+int Curve::add(const Spline & spline)
+{
+	Range range;
+	range.spline = spline;
+	range.reserved = 0;
+	range.dirty = true;
+	curves.push_back(range);
+	firsts.push_back(0);
+	counts.push_back(0);
+	return (int)curves.size() - 1;
+}
+
+void Curve::set(int curve, const Spline & spline)
+{
+	if (curve < 0 || curve >= (int)curves.size()) return;
+	curves[curve].spline = spline;
+	curves[curve].dirty = true;
+}
+
+void Curve::clear()
+{
+	curves.clear();
+	firsts.clear();
+	counts.clear();
+	used = live = 0;
+}
+
+// Leaves the buffer bound
+void Curve::resize_buffer(GLsizei vertices)
+{
+	capacity = vertices;
+	mirror.resize(capacity);
+	glBindBuffer(GL_ARRAY_BUFFER, VBO);
+	glBufferData(GL_ARRAY_BUFFER, capacity * sizeof(glm::vec3), NULL, GL_DYNAMIC_DRAW);
+}
+
+// Closes the holes moved curves left behind, and doubles the buffer until extra more vertices fit
+void Curve::repack(GLsizei extra)
+{
+	PROFILE_ZONE("Curve::repack");
+	GLsizei needed = extra;
+	for (size_t c = 0; c < curves.size(); c++) needed += curves[c].reserved;
+	GLsizei size = capacity;
+	while (size < needed) size *= 2;
+
+	std::vector<glm::vec3> packed(size);
+	GLsizei next = 0;
+	for (size_t c = 0; c < curves.size(); c++)
+	{
+		if (counts[c] > 0) memcpy(&packed[next], &mirror[firsts[c]], counts[c] * sizeof(glm::vec3));
+		firsts[c] = next;
+		next += curves[c].reserved;
+	}
+	used = next;
+
+	if (size != capacity) resize_buffer(size);
+	mirror.swap(packed);
+	upload_begin = 0;
+	upload_end = used;
+}
+
+void Curve::update()
+{
+	PROFILE_ZONE("Curve::update");
+	upload_begin = capacity;
+	upload_end = 0;
+
+	for (size_t c = 0; c < curves.size(); c++)
+	{
+		if (!curves[c].dirty) continue;
+		curves[c].dirty = false;
+		flat.clear();
+		curves[c].spline.flatten(tolerance, flat);
+		GLsizei size = (GLsizei)flat.size();
+		live += size - counts[c];
+
+		// Outgrown its range, give it a new one at the end with room to grow into
+		if (size > curves[c].reserved)
+		{
+			counts[c] = 0;
+			curves[c].reserved = 0;
+			GLsizei reserve = size + size / 2;
+			if (used + reserve > capacity) repack(reserve);
+			firsts[c] = used;
+			curves[c].reserved = reserve;
+			used += reserve;
+		}
+
+		counts[c] = size;
+		if (size == 0) continue;
+		memcpy(&mirror[firsts[c]], &flat[0], size * sizeof(glm::vec3));
+		upload_begin = std::min(upload_begin, (GLsizei)firsts[c]);
+		upload_end = std::max(upload_end, (GLsizei)firsts[c] + size);
+	}
+
+	// Everything that changed in one go, including whatever unchanged ranges lie in between
+	if (upload_end > upload_begin)
+	{
+		glBindBuffer(GL_ARRAY_BUFFER, VBO);
+		glBufferSubData(GL_ARRAY_BUFFER, upload_begin * sizeof(glm::vec3), (upload_end - upload_begin) * sizeof(glm::vec3), &mirror[upload_begin]);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
 }
 
 void Curve::draw(GLuint shaderProgram)
-{ 
+{
+	if (live == 0) return;
+
 	// Calculate the combination of the model and view (camera inverse) matrices
 	glm::mat4 modelview = Window::V * toWorld;
 	// We need to calcullate this because modern OpenGL does not keep track of any matrix other than the viewport (D)
@@ -67,20 +151,14 @@ void Curve::draw(GLuint shaderProgram)
 	uModelview = glGetUniformLocation(shaderProgram, "modelview");
 	uView = glGetUniformLocation(shaderProgram, "view");
 
-	uMode = glGetUniformLocation(shaderProgram, "mode");
-
 	// Now send these values to the shader program
 	glUniformMatrix4fv(uProjection, 1, GL_FALSE, &Window::P[0][0]);
 	glUniformMatrix4fv(uModelview, 1, GL_FALSE, &modelview[0][0]);
 	glUniformMatrix4fv(uView, 1, GL_FALSE, &Window::V[0][0]);
-	glUniform1i(uMode, 3);
 
-	// Now draw the cube. We simply need to bind the VAO associated with it.
+	// Every curve is its own line strip in the one buffer, closed ones end on their first point
 	glBindVertexArray(VAO);
-	// Tell OpenGL to draw with lines, using 150 indices, the type of the indices, and the offset to start from
-	glDrawElements(GL_LINE_LOOP, 750, GL_UNSIGNED_INT, 0);
+	glMultiDrawArrays(GL_LINE_STRIP, &firsts[0], &counts[0], (GLsizei)curves.size());
 	// Unbind the VAO when we're done so we don't accidentally draw extra stuff or tamper with its bound buffers
 	glBindVertexArray(0);
 }
-
-
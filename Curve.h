@@ -17,22 +17,60 @@
 
 #include <vector>
 
+#include "Spline.h"
+
+#define CURVE_TOLERANCE 0.01f		// Default flattening error, in model units
+#define CURVE_INITIAL_VERTICES 4096
+
+// Any number of splines flattened into one line strip buffer and drawn with one glMultiDrawArrays.
+// Each curve owns a range of the buffer with some slack, so an edit that stays within it rewrites
+// just that range. One that outgrows it moves to the end, and when the buffer fills up the ranges are
+// packed together again, doubling the buffer if that's still not enough. All the changes of a frame
+// go up in one glBufferSubData.
 class Curve
 {
 public:
-	Curve(GLfloat p[]);
+	Curve(float tolerance = CURVE_TOLERANCE);
 	~Curve();
 
-	void draw(GLuint);
+	int add(const Spline & spline);
+	void set(int curve, const Spline & spline);	// Re-flattened on the next update()
+	const Spline & get(int curve) const { return curves[curve].spline; }
+	void clear();
+
+	void update();			// Flattens and uploads the edited curves, needs the GL context
+	void draw(GLuint);		// Takes the FEATURE_FLAT variant of shader.*
+
+	int curve_count() const { return (int)curves.size(); }
+	GLsizei buffer_capacity() const { return capacity; }
 
 	glm::mat4 toWorld;
-	GLfloat points[2250];
-	GLuint indices[750];
+	float tolerance;
 
 	// These variables are needed for the shader program
-	GLuint VBO, VAO, EBO;
-	GLuint uProjection, uModelview, uView, uMode;
+	GLuint VBO, VAO;
+	GLuint uProjection, uModelview, uView;
+
+private:
+	struct Range
+	{
+		Spline spline;
+		GLsizei reserved;	// Vertices set aside in the buffer
+		bool dirty;
+	};
+
+	std::vector<Range> curves;
+	std::vector<GLint> firsts;		// Per curve, straight into glMultiDrawArrays
+	std::vector<GLsizei> counts;
+	std::vector<glm::vec3> mirror;	// Copy of the whole buffer
+	std::vector<glm::vec3> flat;	// Scratch
+	GLsizei used;		// End of the last range
+	GLsizei live;		// Vertices actually drawn
+	GLsizei capacity;
+	GLsizei upload_begin, upload_end;
+
+	void repack(GLsizei extra);
+	void resize_buffer(GLsizei vertices);
 };
 
 #endif
-
@@ -0,0 +1,219 @@
+#include "DynamicResolution.h"
+#include "Window.h"
+
+#include <stdio.h>
+#include <algorithm>
+
+#define UPSAMPLE_SHADER_VERT_PATH "../upsample.vert"
+#define UPSAMPLE_SHADER_FRAG_PATH "../upsample.frag"
+
+bool DynamicResolution::enabled = true;
+double DynamicResolution::target_fps = 60.0;
+float DynamicResolution::min_scale[RES_PASSES] = { 0.5f, 0.5f, 0.5f };
+float DynamicResolution::max_scale[RES_PASSES] = { 1.0f, 1.0f, 1.0f };
+float DynamicResolution::scale[RES_PASSES] = { 1.0f, 1.0f, 1.0f };
+double DynamicResolution::smoothed_ms[RES_PASSES] = { 0.0, 0.0, 0.0 };
+double DynamicResolution::fixed_ms = 0.0;
+int DynamicResolution::frames = 0;
+ResolutionPass DynamicResolution::current = RES_MAIN;
+int DynamicResolution::target_width = 0;
+int DynamicResolution::target_height = 0;
+GLuint DynamicResolution::scene_FBO = 0;
+GLuint DynamicResolution::scene_color = 0;
+GLuint DynamicResolution::scene_depth = 0;
+GLuint DynamicResolution::resolve_FBO = 0;
+GLuint DynamicResolution::resolve_texture = 0;
+GLuint DynamicResolution::upsample_shader = 0;
+GLuint DynamicResolution::empty_VAO = 0;
+
+static const char * pass_names[RES_PASSES] = { "reflection", "refraction", "main" };
+
+void DynamicResolution::init()
+{
+	if (!GPUTimer::available())
+	{
+		std::cout << "No GPU timings, dynamic resolution stays at full size" << std::endl;
+		enabled = false;
+	}
+	for (int p = 0; p < RES_PASSES; p++) scale[p] = max_scale[p];
+
+	glGenFramebuffers(1, &scene_FBO);
+	glGenRenderbuffers(1, &scene_color);
+	glGenRenderbuffers(1, &scene_depth);
+	glGenFramebuffers(1, &resolve_FBO);
+	glGenTextures(1, &resolve_texture);
+	resize_targets();
+
+	upsample_shader = ResourceCache::program(UPSAMPLE_SHADER_VERT_PATH, UPSAMPLE_SHADER_FRAG_PATH);
+	glGenVertexArrays(1, &empty_VAO);	// The full screen triangle has no attributes, core still wants a VAO
+}
+
+void DynamicResolution::clean_up()
+{
+	glDeleteFramebuffers(1, &scene_FBO);
+	glDeleteRenderbuffers(1, &scene_color);
+	glDeleteRenderbuffers(1, &scene_depth);
+	glDeleteFramebuffers(1, &resolve_FBO);
+	glDeleteTextures(1, &resolve_texture);
+	glDeleteVertexArrays(1, &empty_VAO);
+	ResourceCache::release(RESOURCE_PROGRAM, upsample_shader);
+}
+
+void DynamicResolution::resize_targets()
+{
+	target_width = Window::width;
+	target_height = Window::height;
+	if (target_width <= 0 || target_height <= 0) return;
+
+	// Same multisampling as the window, the resolve below turns it into one sample per pixel
+	GLint samples = 0;
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glGetIntegerv(GL_SAMPLES, &samples);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, scene_FBO);
+	glBindRenderbuffer(GL_RENDERBUFFER, scene_color);
+	glRenderbufferStorageMultisample(GL_RENDERBUFFER, samples, GL_RGBA8, target_width, target_height);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, scene_color);
+	glBindRenderbuffer(GL_RENDERBUFFER, scene_depth);
+	glRenderbufferStorageMultisample(GL_RENDERBUFFER, samples, GL_DEPTH_COMPONENT24, target_width, target_height);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, scene_depth);
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) std::cerr << "Dynamic resolution scene framebuffer is incomplete" << std::endl;
+
+	glBindFramebuffer(GL_FRAMEBUFFER, resolve_FBO);
+	glBindTexture(GL_TEXTURE_2D, resolve_texture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, target_width, target_height, 0, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, resolve_texture, 0);
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) std::cerr << "Dynamic resolution resolve framebuffer is incomplete" << std::endl;
+
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+int DynamicResolution::width(ResolutionPass pass)
+{
+	return std::max(1, (int)(Window::width * scale[pass] + 0.5f));
+}
+
+int DynamicResolution::height(ResolutionPass pass)
+{
+	return std::max(1, (int)(Window::height * scale[pass] + 0.5f));
+}
+
+void DynamicResolution::uv_scale(ResolutionPass pass, float * out)
+{
+	out[0] = Window::width > 0 ? (float)width(pass) / Window::width : 1.0f;
+	out[1] = Window::height > 0 ? (float)height(pass) / Window::height : 1.0f;
+}
+
+bool DynamicResolution::scaled_main()
+{
+	return width(RES_MAIN) < Window::width || height(RES_MAIN) < Window::height;
+}
+
+void DynamicResolution::update()
+{
+	if (Window::width != target_width || Window::height != target_height) resize_targets();
+	if (!enabled) return;
+
+	// Water draws into the main pass's target, so it scales with it
+	double ms[RES_PASSES];
+	ms[RES_REFLECTION] = GPUTimer::latest_ms("reflection");
+	ms[RES_REFRACTION] = GPUTimer::latest_ms("refraction");
+	ms[RES_MAIN] = GPUTimer::latest_ms("main") + GPUTimer::latest_ms("water");
+	// Upsampling only runs when the main pass is scaled, the label's last time would otherwise stay charged
+	fixed_ms = 0.8 * fixed_ms + 0.2 * (scaled_main() ? GPUTimer::latest_ms("upsample") : 0.0);
+	for (int p = 0; p < RES_PASSES; p++) smoothed_ms[p] = frames == 0 ? ms[p] : 0.8 * smoothed_ms[p] + 0.2 * ms[p];
+	if (++frames % DYNRES_INTERVAL != 0) return;
+
+	double budget = 1000.0 / target_fps * DYNRES_BUDGET;
+	double total = fixed_ms;
+	for (int p = 0; p < RES_PASSES; p++) total += smoothed_ms[p];
+
+	if (total > budget)
+	{
+		for (int p = RES_REFLECTION; p <= RES_MAIN; p++)
+		{
+			if (scale[p] <= min_scale[p]) continue;
+			scale[p] = std::max(min_scale[p], scale[p] * DYNRES_STEP_DOWN);
+			return;
+		}
+	}
+	else
+	{
+		for (int p = RES_MAIN; p >= RES_REFLECTION; p--)
+		{
+			if (scale[p] >= max_scale[p]) continue;
+			float next = std::min(max_scale[p], scale[p] * DYNRES_STEP_UP);
+			double growth = (double)(next * next) / (scale[p] * scale[p]);
+			if (total + smoothed_ms[p] * (growth - 1.0) > budget * DYNRES_RAISE_BELOW) return;
+			scale[p] = next;
+			return;
+		}
+	}
+}
+
+void DynamicResolution::begin_pass(ResolutionPass pass)
+{
+	current = pass;
+	if (pass == RES_MAIN && scaled_main()) glBindFramebuffer(GL_FRAMEBUFFER, scene_FBO);
+	glViewport(0, 0, width(pass), height(pass));
+}
+
+void DynamicResolution::end_main()
+{
+	if (!scaled_main()) return;
+	GPUTimer::begin("upsample");
+	int w = width(RES_MAIN), h = height(RES_MAIN);
+
+	// Resolve the multisamples at the rendered size, then stretch that corner over the window
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, scene_FBO);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, resolve_FBO);
+	glBlitFramebuffer(0, 0, w, h, 0, 0, w, h, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glViewport(0, 0, Window::width, Window::height);
+
+	float uv[2];
+	uv_scale(RES_MAIN, uv);
+	// Water leaves blending on, and its edges leave alpha under 1, the window would show through
+	GLboolean blend = glIsEnabled(GL_BLEND);
+	glDisable(GL_BLEND);
+	glDisable(GL_DEPTH_TEST);
+	glUseProgram(upsample_shader);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, resolve_texture);
+	glUniform1i(glGetUniformLocation(upsample_shader, "scene"), 0);
+	glUniform2f(glGetUniformLocation(upsample_shader, "uv_scale"), uv[0], uv[1]);
+	glUniform2f(glGetUniformLocation(upsample_shader, "uv_limit"), uv[0] - 0.5f / target_width, uv[1] - 0.5f / target_height);
+	glBindVertexArray(empty_VAO);
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+	glBindVertexArray(0);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glEnable(GL_DEPTH_TEST);
+	if (blend) glEnable(GL_BLEND);
+	GPUTimer::end();
+}
+
+void DynamicResolution::set_enabled(bool enabled)
+{
+	DynamicResolution::enabled = enabled && GPUTimer::available();
+	for (int p = 0; p < RES_PASSES; p++) scale[p] = max_scale[p];
+	frames = 0;
+}
+
+void DynamicResolution::report()
+{
+	double total = fixed_ms;
+	for (int p = 0; p < RES_PASSES; p++) total += smoothed_ms[p];
+	printf("Dynamic resolution %s, target %.0f fps (%.2f ms GPU budget), GPU passes %.2f ms\n", enabled ? "on" : "off", target_fps,
+		1000.0 / target_fps * DYNRES_BUDGET, total);
+	for (int p = 0; p < RES_PASSES; p++)
+	{
+		printf("  %-10s %4d x %-4d (%3.0f%%, %.0f-%.0f%%) %.2f ms\n", pass_names[p], width((ResolutionPass)p), height((ResolutionPass)p),
+			scale[p] * 100.0f, min_scale[p] * 100.0f, max_scale[p] * 100.0f, smoothed_ms[p]);
+	}
+}
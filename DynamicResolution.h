@@ -0,0 +1,70 @@
+#pragma once
+#ifndef _DYNAMICRESOLUTION_H_
+#define _DYNAMICRESOLUTION_H_
+
+#define GLFW_INCLUDE_GLEXT
+#ifdef __APPLE__
+#define GLFW_INCLUDE_GLCOREARB
+#else
+#include <GL/glew.h>
+#endif
+#include <GLFW/glfw3.h>
+
+#define DYNRES_BUDGET 0.85			// Share of the frame the GPU passes may take, the rest is headroom
+#define DYNRES_RAISE_BELOW 0.9		// Only raise a scale when the predicted total stays under this share of the budget
+#define DYNRES_INTERVAL 15			// Frames between adjustments, GPUTimer results come back two frames late
+#define DYNRES_STEP_DOWN 0.85f
+#define DYNRES_STEP_UP 1.05f
+
+enum ResolutionPass { RES_REFLECTION, RES_REFRACTION, RES_MAIN, RES_PASSES };
+
+// Renders the reflection, refraction and main passes at their own fraction of the window size,
+// chosen by a governor that holds the GPU frame time under the target frame rate.
+//
+// Every render target stays allocated at the window size and a pass only renders into the bottom
+// left corner of it, so changing a scale costs nothing. Water samples the reflection and refraction
+// corners through uv scales. A scaled main pass (with the water) goes into an offscreen target
+// with the window's multisampling, is resolved, and is stretched over the window by upsample.*.
+// At full scale the main pass draws straight to the window as before.
+//
+// Each frame the governor smooths the newest GPUTimer time of every pass. If the total is over
+// budget it steps down the reflection, then the refraction, then the main pass, since the water
+// distorts the first two anyway. When there's room it steps them back up in the opposite order,
+// if the cost it predicts for the larger size (time goes with pixel count) still fits.
+class DynamicResolution
+{
+public:
+	static bool enabled;
+	static double target_fps;
+	static float min_scale[RES_PASSES];
+	static float max_scale[RES_PASSES];
+
+	static void init();
+	static void clean_up();
+	static void update();		// Once per frame, after GPUTimer::begin_frame has collected
+	static void begin_pass(ResolutionPass pass);	// After the pass's framebuffer is bound, sets the viewport
+	static void end_main();		// After the water, puts a scaled main pass on the window
+	static int width(ResolutionPass pass);
+	static int height(ResolutionPass pass);
+	static int render_width() { return width(current); }	// Of the pass being drawn
+	static int render_height() { return height(current); }
+	static void uv_scale(ResolutionPass pass, float * out);	// Part of a full size target the pass covers
+	static void set_enabled(bool enabled);
+	static void report();
+
+private:
+	static float scale[RES_PASSES];
+	static double smoothed_ms[RES_PASSES];
+	static double fixed_ms;		// Upsampling, the same at any scale
+	static int frames;
+	static ResolutionPass current;
+	static int target_width, target_height;		// Size the targets were made for
+	static GLuint scene_FBO, scene_color, scene_depth;	// Multisampled, like the window
+	static GLuint resolve_FBO, resolve_texture;
+	static GLuint upsample_shader, empty_VAO;
+
+	static void resize_targets();
+	static bool scaled_main();
+};
+
+#endif
@@ -0,0 +1,290 @@
+#include "Flythrough.h"
+#include "Window.h"
+
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <iostream>
+
+bool Flythrough::exit_when_done = false;
+FILE * Flythrough::file = NULL;
+long long Flythrough::record_start = 0;
+Flythrough::Mode Flythrough::mode = PLAY_OFF;
+bool Flythrough::started = false;
+bool Flythrough::injecting = false;
+std::vector<Flythrough::CameraState> Flythrough::cameras;
+std::vector<Flythrough::InputEvent> Flythrough::events;
+std::vector<Flythrough::TourLeg> Flythrough::tour;
+size_t Flythrough::next_event = 0;
+long long Flythrough::frame = 0;
+long long Flythrough::play_start = 0;
+long long Flythrough::last_frame = 0;
+double Flythrough::worst_frame_ms = 0.0;
+
+// Keys that drive the recorder itself never go into a recording, replaying them would start another one
+static bool own_key(int key)
+{
+	return key == GLFW_KEY_F5 || key == GLFW_KEY_F6 || key == GLFW_KEY_F7;
+}
+
+double Flythrough::record_time()
+{
+	return (Profiler::now() - record_start) / 1000000.0;
+}
+
+bool Flythrough::record(const char * path)
+{
+	if (playing())
+	{
+		std::cerr << "Can't record while a flythrough is playing" << std::endl;
+		return false;
+	}
+	stop_recording();
+	file = fopen(path, "w");
+	if (file == NULL)
+	{
+		std::cerr << "Could not open " << path << " for recording" << std::endl;
+		return false;
+	}
+	fprintf(file, "# flythrough recording, see Flythrough.h\n");
+	record_start = Profiler::now();
+	std::cout << "Recording camera and input to " << path << std::endl;
+	return true;
+}
+
+void Flythrough::stop_recording()
+{
+	if (file == NULL) return;
+	fclose(file);
+	file = NULL;
+	std::cout << "Recording stopped after " << record_time() << " s" << std::endl;
+}
+
+void Flythrough::log_key(int key, int scancode, int action, int mods)
+{
+	if (file == NULL || own_key(key)) return;
+	fprintf(file, "K %.6f %d %d %d %d\n", record_time(), key, scancode, action, mods);
+}
+
+void Flythrough::log_cursor(double x, double y, bool left, bool right)
+{
+	if (file == NULL) return;
+	fprintf(file, "M %.6f %.3f %.3f %d %d\n", record_time(), x, y, left ? 1 : 0, right ? 1 : 0);
+}
+
+void Flythrough::log_scroll(double x, double y)
+{
+	if (file == NULL) return;
+	fprintf(file, "S %.6f %.3f %.3f\n", record_time(), x, y);
+}
+
+bool Flythrough::play(const char * path, bool input)
+{
+	stop();
+	FILE * fp = fopen(path, "r");
+	if (fp == NULL)
+	{
+		std::cerr << "Could not open recording " << path << std::endl;
+		return false;
+	}
+
+	cameras.clear();
+	events.clear();
+	char line[256];
+	int line_number = 0;
+	while (fgets(line, sizeof(line), fp))
+	{
+		line_number++;
+		if (line[0] == '#' || line[0] == '\n' || line[0] == '\r') continue;
+
+		bool ok = false;
+		if (line[0] == 'C')
+		{
+			CameraState state;
+			ok = sscanf(line + 1, "%lf %f %f %f %f %f %f %f %f %f %d", &state.time, &state.pos.x, &state.pos.y, &state.pos.z,
+				&state.look_at.x, &state.look_at.y, &state.look_at.z, &state.up.x, &state.up.y, &state.up.z, &state.ground) == 11;
+			if (ok) cameras.push_back(state);
+		}
+		else
+		{
+			InputEvent event;
+			event.type = line[0];
+			event.x = event.y = 0.0;
+			memset(event.values, 0, sizeof(event.values));
+			if (event.type == 'K') ok = sscanf(line + 1, "%lf %d %d %d %d", &event.time, &event.values[0], &event.values[1], &event.values[2], &event.values[3]) == 5;
+			else if (event.type == 'M') ok = sscanf(line + 1, "%lf %lf %lf %d %d", &event.time, &event.x, &event.y, &event.values[0], &event.values[1]) == 5;
+			else if (event.type == 'S') ok = sscanf(line + 1, "%lf %lf %lf", &event.time, &event.x, &event.y) == 3;
+			if (ok) events.push_back(event);
+		}
+		if (!ok) std::cerr << path << ":" << line_number << ": skipping unreadable line" << std::endl;
+	}
+	fclose(fp);
+
+	if (cameras.empty())
+	{
+		std::cerr << path << " has no camera states to start from" << std::endl;
+		return false;
+	}
+	std::cout << "Playing " << path << ": " << cameras.back().time << " s, " << events.size() << " input events, replaying " << (input ? "input" : "camera") << std::endl;
+	begin_playback(input ? PLAY_INPUT : PLAY_CAMERA);
+	return true;
+}
+
+// One closed loop per ground, low over the beach props and higher over the taller lake and coast maps
+void Flythrough::build_tour()
+{
+	if (!tour.empty()) return;
+	static const glm::vec3 beach[] = { glm::vec3(182.0f, 3.0f, 20.0f), glm::vec3(150.0f, 8.0f, -40.0f), glm::vec3(60.0f, 12.0f, -120.0f),
+		glm::vec3(-80.0f, 15.0f, -60.0f), glm::vec3(-60.0f, 12.0f, 80.0f), glm::vec3(80.0f, 8.0f, 100.0f) };
+	static const glm::vec3 lake[] = { glm::vec3(200.0f, 35.0f, 0.0f), glm::vec3(100.0f, 40.0f, -200.0f), glm::vec3(-150.0f, 45.0f, -150.0f),
+		glm::vec3(-200.0f, 40.0f, 100.0f), glm::vec3(0.0f, 35.0f, 220.0f) };
+	static const glm::vec3 coast[] = { glm::vec3(250.0f, 100.0f, 0.0f), glm::vec3(0.0f, 110.0f, -250.0f), glm::vec3(-250.0f, 105.0f, 0.0f),
+		glm::vec3(0.0f, 95.0f, 250.0f) };
+	const glm::vec3 * paths[3] = { beach, lake, coast };
+	const int sizes[3] = { 6, 5, 4 };
+
+	for (int ground = 0; ground < 3; ground++)
+	{
+		TourLeg leg;
+		leg.ground = ground;
+		leg.path = Spline(SPLINE_CATMULL_ROM, true);
+		leg.path.points.assign(paths[ground], paths[ground] + sizes[ground]);
+		leg.path.arc_length(0.05f, leg.table);
+		tour.push_back(leg);
+	}
+}
+
+void Flythrough::play_tour()
+{
+	stop();
+	build_tour();
+	float length = 0.0f;
+	for (size_t i = 0; i < tour.size(); i++) length += tour[i].table.length();
+	std::cout << "Playing the tour: " << tour.size() << " grounds, " << length / FLYTHROUGH_TOUR_SPEED << " s" << std::endl;
+	begin_playback(PLAY_TOUR);
+}
+
+void Flythrough::begin_playback(Mode mode)
+{
+	Flythrough::mode = mode;
+	started = false;
+	next_event = 0;
+	frame = 0;
+	worst_frame_ms = 0.0;
+}
+
+void Flythrough::stop()
+{
+	if (mode == PLAY_OFF) return;
+	std::cout << "Playback stopped" << std::endl;
+	if (started) Simulation::use_fixed_clock(false);
+	mode = PLAY_OFF;
+}
+
+void Flythrough::finish_playback()
+{
+	double seconds = (Profiler::now() - play_start) / 1000000.0;
+	printf("Flythrough done: %lld frames in %.2f s, %.2f ms average, %.2f ms worst\n", frame, seconds, frame > 0 ? seconds * 1000.0 / frame : 0.0, worst_frame_ms);
+	Simulation::use_fixed_clock(false);
+	mode = PLAY_OFF;
+}
+
+bool Flythrough::place_tour_camera(double time)
+{
+	float distance = (float)time * FLYTHROUGH_TOUR_SPEED;
+	for (size_t i = 0; i < tour.size(); i++)
+	{
+		const TourLeg & leg = tour[i];
+		float length = leg.table.length();
+		if (distance > length)
+		{
+			distance -= length;
+			continue;
+		}
+
+		// Closed loops, so looking ahead past the end wraps to the start
+		float ahead = fmod(distance + FLYTHROUGH_LOOK_AHEAD, length);
+		Window::ground_type = leg.ground;
+		Window::cam_pos = leg.path.evaluate(leg.table.parameter_at(distance));
+		Window::cam_look_at = leg.path.evaluate(leg.table.parameter_at(ahead)) - glm::vec3(0.0f, 3.0f, 0.0f);
+		Window::cam_up = glm::vec3(0.0f, 1.0f, 0.0f);
+		return true;
+	}
+	return false;
+}
+
+void Flythrough::place_recorded_camera(double time)
+{
+	// Last state at or before the time, blended toward the one after it
+	size_t i = std::upper_bound(cameras.begin(), cameras.end(), time, [](double t, const CameraState & state) { return t < state.time; }) - cameras.begin();
+	if (i > 0) i--;
+	const CameraState & a = cameras[i];
+	const CameraState & b = cameras[std::min(i + 1, cameras.size() - 1)];
+	float f = b.time > a.time ? (float)((time - a.time) / (b.time - a.time)) : 0.0f;
+	f = std::min(std::max(f, 0.0f), 1.0f);
+	Window::cam_pos = glm::mix(a.pos, b.pos, f);
+	Window::cam_look_at = glm::mix(a.look_at, b.look_at, f);
+	Window::cam_up = glm::normalize(glm::mix(a.up, b.up, f));
+	Window::ground_type = a.ground;
+}
+
+void Flythrough::inject(GLFWwindow * window, const InputEvent & event)
+{
+	injecting = true;
+	switch (event.type)
+	{
+	case 'K': Window::key_callback(window, event.values[0], event.values[1], event.values[2], event.values[3]); break;
+	case 'M': Window::move_cursor(event.x, event.y, event.values[0] != 0, event.values[1] != 0); break;
+	case 'S': Window::scroll_callback(window, event.x, event.y); break;
+	}
+	injecting = false;
+}
+
+void Flythrough::update(GLFWwindow * window)
+{
+	if (file) fprintf(file, "C %.6f %f %f %f %f %f %f %f %f %f %u\n", record_time(), Window::cam_pos.x, Window::cam_pos.y, Window::cam_pos.z,
+		Window::cam_look_at.x, Window::cam_look_at.y, Window::cam_look_at.z, Window::cam_up.x, Window::cam_up.y, Window::cam_up.z, Window::ground_type);
+	if (mode == PLAY_OFF) return;
+
+	long long now = Profiler::now();
+	if (!started)
+	{
+		// Frames that are still uploading assets would only add noise
+		if (mode == PLAY_TOUR) place_tour_camera(0.0);
+		else place_recorded_camera(0.0);
+		if (AssetLoader::pending() > 0 || TextureUploader::queued() > 0) return;
+		started = true;
+		Simulation::use_fixed_clock(true);
+		play_start = now;
+	}
+	else
+	{
+		worst_frame_ms = std::max(worst_frame_ms, (now - last_frame) / 1000.0);
+		Simulation::tick(FLYTHROUGH_FRAME_TIME);
+	}
+	last_frame = now;
+
+	double time = frame * FLYTHROUGH_FRAME_TIME;
+	while (next_event < events.size() && events[next_event].time <= time)
+	{
+		// Camera playback still takes keys for the toggles, the states below override any movement
+		if (mode == PLAY_INPUT || events[next_event].type == 'K') inject(window, events[next_event]);
+		next_event++;
+		if (mode == PLAY_OFF) return;	// A replayed key ended it
+	}
+
+	bool done;
+	if (mode == PLAY_TOUR) done = !place_tour_camera(time);
+	else
+	{
+		if (mode == PLAY_CAMERA) place_recorded_camera(time);
+		done = time > cameras.back().time && next_event == events.size();
+	}
+	if (done)
+	{
+		finish_playback();
+		if (exit_when_done) glfwSetWindowShouldClose(window, GL_TRUE);
+		return;
+	}
+	frame++;
+}
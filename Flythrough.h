@@ -0,0 +1,109 @@
+#pragma once
+#ifndef _FLYTHROUGH_H_
+#define _FLYTHROUGH_H_
+
+#define GLFW_INCLUDE_GLEXT
+#ifdef __APPLE__
+#define GLFW_INCLUDE_GLCOREARB
+#else
+#include <GL/glew.h>
+#endif
+#include <GLFW/glfw3.h>
+// Use of degrees is deprecated. Use radians instead.
+#ifndef GLM_FORCE_RADIANS
+#define GLM_FORCE_RADIANS
+#endif
+#include <glm/glm.hpp>
+
+#include <stdio.h>
+#include <vector>
+
+#include "Spline.h"
+
+#define FLYTHROUGH_FRAME_TIME (1.0 / 60.0)	// Playback time per frame, however long the frame really took
+#define FLYTHROUGH_RECORDING "camera_recording.txt"
+#define FLYTHROUGH_TOUR_SPEED 30.0f		// Units per second along the tour paths
+#define FLYTHROUGH_LOOK_AHEAD 12.0f		// The tour camera looks at the path this far ahead
+
+// Records the camera and the input that moved it, and plays either back with fixed timing so
+// performance runs see the same frames every time.
+//
+// A recording is a text file, one line per entry, times in seconds from the start:
+//   C time pos.xyz look_at.xyz up.xyz ground	camera at the start of a frame
+//   K time key scancode action mods			key event
+//   M time x y left right						cursor moved, with the mouse buttons held
+//   S time x y									scroll
+// Playing it back advances FLYTHROUGH_FRAME_TIME per frame and puts the simulation on the same fixed
+// clock. Camera playback places the camera from the C lines and replays keys for the toggles, input
+// playback feeds every event back through Window's callbacks instead. The tour flies Catmull-Rom
+// paths over each ground at constant speed. Playback starts once loading is done.
+class Flythrough
+{
+public:
+	static bool exit_when_done;	// Close the window when playback ends, for scripted runs
+
+	static bool record(const char * path);
+	static void stop_recording();
+	static bool play(const char * path, bool input);	// input replays events instead of camera states
+	static void play_tour();
+	static void stop();
+	static bool recording() { return file != NULL; }
+	static bool playing() { return mode != PLAY_OFF; }
+	static bool accepts_input() { return mode == PLAY_OFF || injecting; }	// Live input is ignored during playback
+
+	static void update(GLFWwindow * window);	// Start of every frame, before anything reads the camera
+
+	static void log_key(int key, int scancode, int action, int mods);
+	static void log_cursor(double x, double y, bool left, bool right);
+	static void log_scroll(double x, double y);
+
+private:
+	enum Mode { PLAY_OFF, PLAY_CAMERA, PLAY_INPUT, PLAY_TOUR };
+
+	struct CameraState
+	{
+		double time;
+		glm::vec3 pos, look_at, up;
+		int ground;
+	};
+
+	struct InputEvent
+	{
+		double time;
+		char type;		// 'K', 'M' or 'S' as in the file
+		int values[4];	// key, scancode, action, mods or the two buttons
+		double x, y;
+	};
+
+	struct TourLeg
+	{
+		int ground;
+		Spline path;
+		ArcLengthTable table;
+	};
+
+	static FILE * file;
+	static long long record_start;
+
+	static Mode mode;
+	static bool started;
+	static bool injecting;
+	static std::vector<CameraState> cameras;
+	static std::vector<InputEvent> events;
+	static std::vector<TourLeg> tour;
+	static size_t next_event;
+	static long long frame;
+	static long long play_start;
+	static long long last_frame;
+	static double worst_frame_ms;
+
+	static double record_time();
+	static void begin_playback(Mode mode);
+	static void finish_playback();
+	static void build_tour();
+	static bool place_tour_camera(double time);
+	static void place_recorded_camera(double time);
+	static void inject(GLFWwindow * window, const InputEvent & event);
+};
+
+#endif
@@ -0,0 +1,228 @@
+#include "FramePacer.h"
+#include "Window.h"
+
+#include <stdio.h>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+bool FramePacer::pacing = false;
+int FramePacer::max_queued = 2;
+bool FramePacer::timestamps = false;
+long long FramePacer::period = 16667;
+long long FramePacer::last_vblank = 0;
+long long FramePacer::last_poll = 0;
+long long FramePacer::frame_latch = 0;
+long long FramePacer::frame_aim = 0;
+long long FramePacer::swap_start = 0;
+double FramePacer::predicted = 0.0;
+long long FramePacer::clock_offset = 0;
+long long FramePacer::clock_synced = 0;
+GLsync FramePacer::fences[FRAMEPACE_MAX_QUEUED];
+int FramePacer::fence_next = 0;
+FramePacer::Slot FramePacer::slots[FRAMEPACE_SLOTS];
+int FramePacer::slot_next = 0;
+double FramePacer::done_ms[FRAMEPACE_WINDOW];
+double FramePacer::photon_ms[FRAMEPACE_WINDOW];
+int FramePacer::done_count = 0;
+int FramePacer::photon_count = 0;
+long long FramePacer::measured = 0;
+long long FramePacer::paced = 0;
+long long FramePacer::late = 0;
+long long FramePacer::dropped = 0;
+
+void FramePacer::init(GLFWwindow * window)
+{
+	// Refresh rate of the monitor the window is on, windowed mode windows have no monitor
+	GLFWmonitor * monitor = glfwGetWindowMonitor(window);
+	if (monitor == NULL) monitor = glfwGetPrimaryMonitor();
+	const GLFWvidmode * mode = monitor ? glfwGetVideoMode(monitor) : NULL;
+	if (mode && mode->refreshRate > 0) period = 1000000 / mode->refreshRate;
+	max_queued = std::min(std::max(max_queued, 0), FRAMEPACE_MAX_QUEUED);
+
+	timestamps = GPUTimer::available();
+	for (int i = 0; i < FRAMEPACE_MAX_QUEUED; i++) fences[i] = 0;
+	for (int i = 0; i < FRAMEPACE_SLOTS; i++)
+	{
+		slots[i].query = 0;
+		slots[i].issued = false;
+		if (timestamps) glGenQueries(1, &slots[i].query);
+	}
+	std::cout << "Frame pacing " << (pacing ? "on" : "off") << ", " << 1000000.0 / period << " Hz, at most " << max_queued << " frames queued" << std::endl;
+}
+
+void FramePacer::clean_up()
+{
+	for (int i = 0; i < FRAMEPACE_MAX_QUEUED; i++)
+	{
+		if (fences[i]) glDeleteSync(fences[i]);
+		fences[i] = 0;
+	}
+	for (int i = 0; i < FRAMEPACE_SLOTS; i++)
+	{
+		if (slots[i].query) glDeleteQueries(1, &slots[i].query);
+	}
+}
+
+// First vblank at or after the time, going by the last one seen and the refresh period.
+// Timestamps are often collected a frame or more late, so the time can be before last_vblank too.
+long long FramePacer::next_vblank(long long time)
+{
+	if (last_vblank == 0) return 0;
+	if (time <= last_vblank) return last_vblank - ((last_vblank - time) / period) * period;
+	long long periods = (time - last_vblank + period - 1) / period;
+	return last_vblank + periods * period;
+}
+
+// The GPU's timestamp clock has its own epoch, line it up with Profiler::now about once a second
+void FramePacer::sync_clocks()
+{
+	long long now = Profiler::now();
+	if (clock_synced != 0 && now - clock_synced < 1000000) return;
+	GLint64 gpu = 0;
+	glGetInteger64v(GL_TIMESTAMP, &gpu);
+	clock_offset = Profiler::now() - gpu / 1000;
+	clock_synced = now;
+}
+
+void FramePacer::collect(Slot & slot)
+{
+	if (!slot.issued) return;
+	slot.issued = false;
+
+	GLuint available = 0;
+	glGetQueryObjectuiv(slot.query, GL_QUERY_RESULT_AVAILABLE, &available);
+	if (!available)
+	{
+		dropped++;
+		return;
+	}
+	GLuint64 gpu = 0;
+	glGetQueryObjectui64v(slot.query, GL_QUERY_RESULT, &gpu);
+	long long done = (long long)(gpu / 1000) + clock_offset;
+	long long cost = std::max(done - slot.latch, 0LL);
+
+	// Jump up to a slow frame straight away, come back down slowly
+	predicted = cost > predicted ? (double)cost : 0.95 * predicted + 0.05 * cost;
+
+	done_ms[measured % FRAMEPACE_WINDOW] = cost / 1000.0;
+	done_count = std::min(done_count + 1, FRAMEPACE_WINDOW);
+	if (last_vblank != 0)
+	{
+		long long shown = next_vblank(done);
+		photon_ms[photon_count % FRAMEPACE_WINDOW] = (shown - slot.latch) / 1000.0;
+		photon_count++;
+		if (slot.aim != 0)
+		{
+			paced++;
+			if (shown > slot.aim) late++;
+		}
+	}
+	measured++;
+}
+
+void FramePacer::begin_frame()
+{
+	PROFILE_ZONE("frame pacing");
+
+	// Queue limit: the frame max_queued back has to be done on the GPU before this one starts
+	if (max_queued > 0)
+	{
+		GLsync & fence = fences[(fence_next + FRAMEPACE_MAX_QUEUED - max_queued) % FRAMEPACE_MAX_QUEUED];
+		if (fence)
+		{
+			glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 100000000);	// 100 ms, in case the driver never signals
+			glDeleteSync(fence);
+			fence = 0;
+		}
+	}
+	if (timestamps)
+	{
+		sync_clocks();
+		for (int i = 0; i < FRAMEPACE_SLOTS; i++)
+		{
+			// Only the ones that are already back, before_swap drops whatever is still out when reused
+			GLuint available = 0;
+			if (slots[i].issued) glGetQueryObjectuiv(slots[i].query, GL_QUERY_RESULT_AVAILABLE, &available);
+			if (available) collect(slots[i]);
+		}
+	}
+
+	frame_aim = 0;
+	if (pacing)
+	{
+		// Start late enough that the frame is done just before a vblank, but never miss the next one on purpose
+		long long lead = (long long)predicted + FRAMEPACE_MARGIN_US;
+		long long now = Profiler::now();
+		frame_aim = next_vblank(now + lead);
+		if (frame_aim != 0)
+		{
+			long long start = frame_aim - lead;
+			if (start - now > FRAMEPACE_SPIN_US) std::this_thread::sleep_for(std::chrono::microseconds(start - now - FRAMEPACE_SPIN_US));
+			while (Profiler::now() < start) std::this_thread::yield();
+		}
+		poll_events();
+	}
+	frame_latch = last_poll;
+}
+
+void FramePacer::poll_events()
+{
+	glfwPollEvents();
+	last_poll = Profiler::now();
+}
+
+void FramePacer::before_swap()
+{
+	if (timestamps)
+	{
+		Slot & slot = slots[slot_next];
+		slot_next = (slot_next + 1) % FRAMEPACE_SLOTS;
+		collect(slot);
+		glQueryCounter(slot.query, GL_TIMESTAMP);
+		slot.issued = true;
+		slot.latch = frame_latch;
+		slot.aim = frame_aim;
+	}
+	swap_start = Profiler::now();
+}
+
+void FramePacer::after_swap()
+{
+	// A swap that blocked returned at a vblank (give or take the wake up)
+	long long now = Profiler::now();
+	if (now - swap_start > 1000) last_vblank = now;
+
+	GLsync & fence = fences[fence_next];
+	if (fence) glDeleteSync(fence);
+	fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	fence_next = (fence_next + 1) % FRAMEPACE_MAX_QUEUED;
+}
+
+void FramePacer::report()
+{
+	printf("Frame pacing %s, %.1f Hz, %d frames queued at most, %lld timestamps lost\n", pacing ? "on" : "off", 1000000.0 / period, max_queued, dropped);
+	if (done_count == 0)
+	{
+		printf("  No latency samples yet%s\n", timestamps ? "" : " (no timer queries)");
+		return;
+	}
+	double total = 0.0, worst = 0.0;
+	for (int i = 0; i < done_count; i++)
+	{
+		total += done_ms[i];
+		worst = std::max(worst, done_ms[i]);
+	}
+	printf("  Input poll to GPU done: %.2f ms average, %.2f ms worst, predicted %.2f ms\n", total / done_count, worst, predicted / 1000.0);
+
+	int photons = std::min(photon_count, FRAMEPACE_WINDOW);
+	if (photons == 0)
+	{
+		printf("  Input to photon: no vblank reference, swaps never blocked\n");
+		return;
+	}
+	total = 0.0;
+	for (int i = 0; i < photons; i++) total += photon_ms[i];
+	printf("  Input to photon (next vblank after GPU done): %.2f ms average over %d frames, %lld of %lld paced frames late\n",
+		total / photons, photons, late, paced);
+}
@@ -0,0 +1,80 @@
+#pragma once
+#ifndef _FRAMEPACER_H_
+#define _FRAMEPACER_H_
+
+#define GLFW_INCLUDE_GLEXT
+#ifdef __APPLE__
+#define GLFW_INCLUDE_GLCOREARB
+#else
+#include <GL/glew.h>
+#endif
+#include <GLFW/glfw3.h>
+
+#define FRAMEPACE_MAX_QUEUED 3		// Fences kept, the largest queue limit there can be
+#define FRAMEPACE_SLOTS 4			// Timestamp queries in flight, read back a few frames late
+#define FRAMEPACE_MARGIN_US 1500	// Aim to be done this long before the vblank
+#define FRAMEPACE_SPIN_US 1000		// Sleeps can overshoot by about this much, spin the rest
+#define FRAMEPACE_WINDOW 120		// Frames in the latency averages
+
+// Low latency frame pacing. Normally input is polled at the end of a frame and used by the next
+// one, so the camera is one to two frames old by the time it's on screen. With pacing on, the
+// frame sleeps first, then polls and latches the camera, timed so the frame should finish
+// rendering just before the vblank it's aiming for. The sleep is the next vblank minus the
+// predicted time from latch to the GPU being done (the slowest recent frame, decaying).
+//
+// Vblanks are taken from glfwSwapBuffers returning after blocking. Drivers that never block in
+// swap give no reference, and then pacing only moves the poll to the start of the frame.
+//
+// max_queued limits how many frames the GPU may be behind: each frame waits on the fence of the
+// frame that many back before it starts, so the driver can't buffer up frames of stale input.
+//
+// Latency is measured per frame: a GL_TIMESTAMP after the last draw, moved onto the CPU clock,
+// minus the time the input was polled. The time on screen is estimated as the next vblank after that.
+class FramePacer
+{
+public:
+	static bool pacing;
+	static int max_queued;		// 0 leaves buffering to the driver
+
+	static void init(GLFWwindow * window);
+	static void clean_up();
+	static void begin_frame();	// First thing in a frame: queue limit, sleep, then poll when pacing
+	static void poll_events();	// glfwPollEvents, remembering when
+	static void before_swap();
+	static void after_swap();
+	static void report();
+
+private:
+	struct Slot
+	{
+		GLuint query;
+		bool issued;
+		long long latch;	// When this frame's input was polled
+		long long aim;		// Vblank it was paced for, 0 when it wasn't
+	};
+
+	static bool timestamps;		// Timer queries are there
+	static long long period;	// Microseconds between vblanks
+	static long long last_vblank;
+	static long long last_poll;
+	static long long frame_latch;
+	static long long frame_aim;
+	static long long swap_start;
+	static double predicted;	// Latch to GPU done, microseconds
+	static long long clock_offset;	// CPU minus GPU clock, microseconds
+	static long long clock_synced;
+	static GLsync fences[FRAMEPACE_MAX_QUEUED];
+	static int fence_next;
+	static Slot slots[FRAMEPACE_SLOTS];
+	static int slot_next;
+	static double done_ms[FRAMEPACE_WINDOW];
+	static double photon_ms[FRAMEPACE_WINDOW];	// Only frames with a vblank reference
+	static int done_count, photon_count;
+	static long long measured, paced, late, dropped;	// paced counts the collected frames that had an aim
+
+	static long long next_vblank(long long time);
+	static void sync_clocks();
+	static void collect(Slot & slot);
+};
+
+#endif
@@ -0,0 +1,238 @@
+#include "GPUTimer.h"
+
+#include <string.h>
+#include <iostream>
+
+bool GPUTimer::enabled = false;
+int GPUTimer::report_interval = 120;
+
+bool GPUTimer::supported = false;
+GLuint GPUTimer::query_pool[GPU_TIMER_BUFFERS][GPU_TIMER_MAX_ZONES * 2];
+GPUTimer::Zone GPUTimer::zones[GPU_TIMER_BUFFERS][GPU_TIMER_MAX_ZONES];
+int GPUTimer::zone_count[GPU_TIMER_BUFFERS];
+unsigned long long GPUTimer::frame_index[GPU_TIMER_BUFFERS];
+int GPUTimer::stack[GPU_TIMER_MAX_ZONES];
+int GPUTimer::stack_size = 0;
+int GPUTimer::current = 0;
+unsigned long long GPUTimer::frame = 0;
+unsigned long long GPUTimer::dropped_frames = 0;
+FILE * GPUTimer::csv = NULL;
+
+std::map<std::pair<int, const char *>, int> GPUTimer::label_lookup;
+std::vector<GPUTimer::Stats> GPUTimer::labels;
+
+void GPUTimer::init()
+{
+#ifdef __APPLE__
+	supported = true;	// Timer queries are core in the 3.3 context we ask for
+#else
+	supported = GLEW_ARB_timer_query ? true : false;
+#endif
+	if (!supported)
+	{
+		std::cout << "GL_ARB_timer_query not supported, GPU pass timings disabled" << std::endl;
+		return;
+	}
+
+	// Allocate every query object up front so nothing is created mid-frame
+	for (int i = 0; i < GPU_TIMER_BUFFERS; i++)
+	{
+		glGenQueries(GPU_TIMER_MAX_ZONES * 2, query_pool[i]);
+		zone_count[i] = 0;
+		frame_index[i] = 0;
+	}
+}
+
+void GPUTimer::clean_up()
+{
+	close_csv();
+	if (!supported) return;
+	for (int i = 0; i < GPU_TIMER_BUFFERS; i++)
+	{
+		glDeleteQueries(GPU_TIMER_MAX_ZONES * 2, query_pool[i]);
+	}
+}
+
+void GPUTimer::begin_frame()
+{
+	if (!supported) return;
+
+	// The buffer we are about to record into was last used GPU_TIMER_BUFFERS frames ago
+	current = (int)(frame % GPU_TIMER_BUFFERS);
+	collect(current);
+
+	zone_count[current] = 0;
+	frame_index[current] = frame;
+	stack_size = 0;
+}
+
+void GPUTimer::end_frame()
+{
+	if (!supported) return;
+
+	// Close any zones that were left open so the next frame starts clean
+	while (stack_size > 0) end();
+
+	if (enabled && report_interval > 0 && frame > 0 && frame % report_interval == 0)
+	{
+		print_table();
+	}
+	frame++;
+}
+
+void GPUTimer::begin(const char * name)
+{
+	if (!supported) return;
+	if (zone_count[current] >= GPU_TIMER_MAX_ZONES || stack_size >= GPU_TIMER_MAX_ZONES) return;
+
+	int parent = stack_size > 0 ? zones[current][stack[stack_size - 1]].label : -1;
+	int index = zone_count[current]++;
+	Zone & zone = zones[current][index];
+	zone.label = get_label(parent, name);
+	zone.queries[0] = query_pool[current][index * 2];
+	zone.queries[1] = query_pool[current][index * 2 + 1];
+	glQueryCounter(zone.queries[0], GL_TIMESTAMP);
+
+	stack[stack_size++] = index;
+}
+
+void GPUTimer::end()
+{
+	if (!supported || stack_size == 0) return;
+
+	Zone & zone = zones[current][stack[--stack_size]];
+	glQueryCounter(zone.queries[1], GL_TIMESTAMP);
+}
+
+int GPUTimer::get_label(int parent, const char * name)
+{
+	// Zone names are string literals, so the pointer is normally enough to find the label
+	std::map<std::pair<int, const char *>, int>::iterator it = label_lookup.find(std::make_pair(parent, name));
+	if (it != label_lookup.end()) return it->second;
+
+	// Same name from another call site: match by path instead of making a duplicate row
+	std::string path = parent >= 0 ? labels[parent].name + "/" + name : std::string(name);
+	int label = -1;
+	for (unsigned int i = 0; i < labels.size(); i++)
+	{
+		if (labels[i].name == path)
+		{
+			label = i;
+			break;
+		}
+	}
+
+	if (label < 0)
+	{
+		Stats stats;
+		stats.name = path;
+		stats.depth = parent >= 0 ? labels[parent].depth + 1 : 0;
+		stats.count = 0;
+		stats.next = 0;
+		memset(stats.samples, 0, sizeof(stats.samples));
+		labels.push_back(stats);
+		label = (int)labels.size() - 1;
+	}
+	label_lookup[std::make_pair(parent, name)] = label;
+	return label;
+}
+
+void GPUTimer::collect(int buffer)
+{
+	int count = zone_count[buffer];
+	if (count == 0) return;
+
+	// Checking the last end query is enough: timestamps complete in submission order
+	GLint available = 0;
+	glGetQueryObjectiv(zones[buffer][count - 1].queries[1], GL_QUERY_RESULT_AVAILABLE, &available);
+	if (!available)
+	{
+		// Never wait on the GPU, just lose this frame's samples
+		dropped_frames++;
+		return;
+	}
+
+	for (int i = 0; i < count; i++)
+	{
+		GLuint64 start, stop;
+		glGetQueryObjectui64v(zones[buffer][i].queries[0], GL_QUERY_RESULT, &start);
+		glGetQueryObjectui64v(zones[buffer][i].queries[1], GL_QUERY_RESULT, &stop);
+		double ms = (stop - start) / 1000000.0;
+
+		Stats & stats = labels[zones[buffer][i].label];
+		stats.samples[stats.next] = ms;
+		stats.next = (stats.next + 1) % GPU_TIMER_WINDOW;
+		if (stats.count < GPU_TIMER_WINDOW) stats.count++;
+
+		if (csv)
+		{
+			fprintf(csv, "%llu,%s,%.4f\n", frame_index[buffer], stats.name.c_str(), ms);
+		}
+	}
+}
+
+bool GPUTimer::open_csv(const char * path)
+{
+	close_csv();
+	csv = fopen(path, "w");
+	if (csv == NULL)
+	{
+		std::cerr << "could not open " << path << " for GPU timings" << std::endl;
+		return false;
+	}
+	fprintf(csv, "frame,pass,ms\n");
+	std::cout << "Logging GPU timings to " << path << std::endl;
+	return true;
+}
+
+void GPUTimer::close_csv()
+{
+	if (csv == NULL) return;
+	fclose(csv);
+	csv = NULL;
+}
+
+double GPUTimer::average_ms(const char * path)
+{
+	for (unsigned int i = 0; i < labels.size(); i++)
+	{
+		if (labels[i].name != path || labels[i].count == 0) continue;
+		double total = 0.0;
+		for (int j = 0; j < labels[i].count; j++) total += labels[i].samples[j];
+		return total / labels[i].count;
+	}
+	return 0.0;
+}
+
+double GPUTimer::latest_ms(const char * path)
+{
+	for (unsigned int i = 0; i < labels.size(); i++)
+	{
+		if (labels[i].name != path || labels[i].count == 0) continue;
+		return labels[i].samples[(labels[i].next + GPU_TIMER_WINDOW - 1) % GPU_TIMER_WINDOW];
+	}
+	return 0.0;
+}
+
+void GPUTimer::print_table()
+{
+	printf("---- GPU pass timings (last %d frames, %llu dropped) ----\n", GPU_TIMER_WINDOW, dropped_frames);
+	printf("%-32s %9s %9s %9s\n", "pass", "avg ms", "min ms", "max ms");
+	for (unsigned int i = 0; i < labels.size(); i++)
+	{
+		const Stats & stats = labels[i];
+		if (stats.count == 0) continue;
+
+		double total = 0.0, lo = stats.samples[0], hi = stats.samples[0];
+		for (int j = 0; j < stats.count; j++)
+		{
+			total += stats.samples[j];
+			if (stats.samples[j] < lo) lo = stats.samples[j];
+			if (stats.samples[j] > hi) hi = stats.samples[j];
+		}
+
+		// Indent nested zones under their pass
+		std::string name = std::string(stats.depth * 2, ' ') + stats.name.substr(stats.name.find_last_of('/') + 1);
+		printf("%-32s %9.3f %9.3f %9.3f\n", name.c_str(), total / stats.count, lo, hi);
+	}
+}
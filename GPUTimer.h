@@ -0,0 +1,87 @@
+#pragma once
+#ifndef _GPUTIMER_H_
+#define _GPUTIMER_H_
+
+#define GLFW_INCLUDE_GLEXT
+#ifdef __APPLE__
+#define GLFW_INCLUDE_GLCOREARB
+#else
+#include <GL/glew.h>
+#endif
+#include <GLFW/glfw3.h>
+
+#include <stdio.h>
+#include <map>
+#include <string>
+#include <vector>
+
+#define GPU_TIMER_BUFFERS 2		// Double-buffered: read frame N-2 while frame N is being recorded
+#define GPU_TIMER_MAX_ZONES 64	// Most begin/end pairs recorded in a single frame
+#define GPU_TIMER_WINDOW 120	// Number of frames in the rolling average
+
+// Measures how long the GPU spends in each render pass / draw group. Every zone is a pair of
+// GL_TIMESTAMP queries, so zones can nest (e.g. "reflection/terrain" inside "reflection").
+// Results are only read back once GL_QUERY_RESULT_AVAILABLE says so, so the CPU never stalls.
+class GPUTimer
+{
+public:
+	static bool enabled;		// Print the rolling table to stdout
+	static int report_interval;	// Frames between printed tables
+
+	static void init();
+	static void clean_up();
+	static void begin_frame();	// Collect finished results and start recording a new frame
+	static void end_frame();
+	static void begin(const char * name);
+	static void end();
+	static bool open_csv(const char * path);
+	static void close_csv();
+	static void print_table();
+	static double average_ms(const char * path);	// Rolling average for a zone, e.g. "main/terrain"
+	static double latest_ms(const char * path);		// Newest collected sample, 0 before the first
+	static bool available() { return supported; }
+
+private:
+	struct Zone
+	{
+		int label;
+		GLuint queries[2];	// Begin and end timestamps
+	};
+
+	struct Stats
+	{
+		std::string name;
+		int depth;
+		double samples[GPU_TIMER_WINDOW];
+		int count;
+		int next;
+	};
+
+	static bool supported;
+	static GLuint query_pool[GPU_TIMER_BUFFERS][GPU_TIMER_MAX_ZONES * 2];
+	static Zone zones[GPU_TIMER_BUFFERS][GPU_TIMER_MAX_ZONES];
+	static int zone_count[GPU_TIMER_BUFFERS];
+	static unsigned long long frame_index[GPU_TIMER_BUFFERS];
+	static int stack[GPU_TIMER_MAX_ZONES];
+	static int stack_size;
+	static int current;
+	static unsigned long long frame;
+	static unsigned long long dropped_frames;
+	static FILE * csv;
+
+	static std::map<std::pair<int, const char *>, int> label_lookup;
+	static std::vector<Stats> labels;
+
+	static int get_label(int parent, const char * name);
+	static void collect(int buffer);
+};
+
+// Times everything in the enclosing scope
+class GPUTimerScope
+{
+public:
+	GPUTimerScope(const char * name) { GPUTimer::begin(name); }
+	~GPUTimerScope() { GPUTimer::end(); }
+};
+
+#endif
@@ -30,7 +30,7 @@ public:
 	~Geometry();
 	void init(char* filename);
 	void draw(glm::mat4 C);
-	void update();
+	void update(float dt);
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,280 @@
+#include "Lights.h"
+#include "Window.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <algorithm>
+#include <glm/gtc/constants.hpp>
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__SSE__)
+#define LIGHTS_SSE
+#include <xmmintrin.h>
+#endif
+
+glm::vec3 Lights::sun_direction(-0.3f, 0.2f, -1.0f);
+glm::vec3 Lights::sun_color(1.0f, 1.0f, 1.0f);
+std::vector<PointLight> Lights::points;
+bool Lights::evening = false;
+std::vector<PointLight> Lights::base;
+Lights::ClusterBounds * Lights::bounds = NULL;
+glm::mat4 Lights::bounds_projection(0.0f);
+float Lights::near_plane = 0.0f;
+float Lights::far_plane = 0.0f;
+float Lights::slice_scale = 0.0f;
+float Lights::slice_bias = 0.0f;
+GLuint Lights::buffers[3];
+GLuint Lights::textures[3];
+std::vector<GLfloat> Lights::light_data;
+std::vector<GLuint> Lights::grid;
+std::vector<GLuint> Lights::indices;
+std::vector<GLuint> Lights::counts;
+std::vector<GLuint> Lights::hits;
+long long Lights::builds = 0;
+long long Lights::references = 0;
+long long Lights::overflows = 0;
+GLuint Lights::busiest = 0;
+
+// Same numbers every run so recorded flythroughs light the same way
+static float jitter(unsigned int & seed)
+{
+	seed = seed * 1664525u + 1013904223u;
+	return (seed >> 8) / 16777216.0f;
+}
+
+void Lights::init()
+{
+	// Torches over the beach, a little above the sand, and lamps around the hut
+	unsigned int seed = 167;
+	for (int i = 0; i < 16; i++)
+	{
+		for (int j = 0; j < 16; j++)
+		{
+			PointLight torch;
+			torch.position = glm::vec3(20.0f + 28.0f * i + 10.0f * jitter(seed), 1.5f + jitter(seed), -230.0f + 28.0f * j + 10.0f * jitter(seed));
+			torch.radius = 18.0f + 6.0f * jitter(seed);
+			torch.color = glm::vec3(1.0f, 0.45f + 0.2f * jitter(seed), 0.15f) * 1.5f;
+			base.push_back(torch);
+		}
+	}
+	for (int i = 0; i < 4; i++)
+	{
+		float angle = i * glm::pi<float>() * 0.5f;
+		PointLight lamp;
+		lamp.position = glm::vec3(420.0f + 12.0f * cos(angle), 16.0f, -70.0f + 12.0f * sin(angle));
+		lamp.radius = 30.0f;
+		lamp.color = glm::vec3(1.0f, 0.8f, 0.5f);
+		base.push_back(lamp);
+	}
+
+	bounds = new ClusterBounds();
+	grid.resize(CLUSTER_COUNT * 2);
+	counts.resize(CLUSTER_COUNT);
+	indices.resize(CLUSTER_MAX_INDICES);
+	light_data.resize(CLUSTER_MAX_LIGHTS * 8);
+
+	// Sizes never change, build() only orphans and refills them
+	GLsizeiptr sizes[3] = { (GLsizeiptr)(light_data.size() * sizeof(GLfloat)), (GLsizeiptr)(grid.size() * sizeof(GLuint)), (GLsizeiptr)(indices.size() * sizeof(GLuint)) };
+	GLenum formats[3] = { GL_RGBA32F, GL_RG32UI, GL_R32UI };
+	glGenBuffers(3, buffers);
+	glGenTextures(3, textures);
+	for (int i = 0; i < 3; i++)
+	{
+		glBindBuffer(GL_TEXTURE_BUFFER, buffers[i]);
+		glBufferData(GL_TEXTURE_BUFFER, sizes[i], NULL, GL_STREAM_DRAW);
+		glBindTexture(GL_TEXTURE_BUFFER, textures[i]);
+		glTexBuffer(GL_TEXTURE_BUFFER, formats[i], buffers[i]);
+	}
+	glBindTexture(GL_TEXTURE_BUFFER, 0);
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+
+void Lights::clean_up()
+{
+	glDeleteTextures(3, textures);
+	glDeleteBuffers(3, buffers);
+	delete bounds;
+	bounds = NULL;
+}
+
+void Lights::set_evening(bool evening)
+{
+	Lights::evening = evening;
+	sun_color = evening ? glm::vec3(0.2f, 0.2f, 0.35f) : glm::vec3(1.0f, 1.0f, 1.0f);
+	if (evening) points = base;
+	else points.clear();
+}
+
+void Lights::update(double time)
+{
+	if (!evening) return;
+	for (size_t i = 0; i < points.size() && i < base.size(); i++)
+	{
+		float flicker = 0.85f + 0.15f * (float)(sin(time * 7.0 + i * 1.3) * sin(time * 3.1 + i));
+		points[i].color = base[i].color * flicker;
+	}
+}
+
+// Slice 0 is everything closer than CLUSTER_NEAR, the same formula is in the fragment shaders
+int Lights::slice(float depth)
+{
+	int s = (int)floor(log(glm::max(depth, 1e-4f)) * slice_scale - slice_bias) + 1;
+	return glm::clamp(s, 0, CLUSTER_Z - 1);
+}
+
+void Lights::build_bounds(const glm::mat4 & projection)
+{
+	// Planes back out of glm::perspective's matrix
+	bounds_projection = projection;
+	near_plane = projection[3][2] / (projection[2][2] - 1.0f);
+	far_plane = projection[3][2] / (projection[2][2] + 1.0f);
+	slice_scale = (CLUSTER_Z - 1) / log(far_plane / CLUSTER_NEAR);
+	slice_bias = slice_scale * log(CLUSTER_NEAR);
+
+	for (int z = 0; z < CLUSTER_Z; z++)
+	{
+		float depth_near = z == 0 ? near_plane : CLUSTER_NEAR * pow(far_plane / CLUSTER_NEAR, (z - 1) / (float)(CLUSTER_Z - 1));
+		float depth_far = z == 0 ? CLUSTER_NEAR : CLUSTER_NEAR * pow(far_plane / CLUSTER_NEAR, z / (float)(CLUSTER_Z - 1));
+		for (int y = 0; y < CLUSTER_Y; y++)
+		{
+			for (int x = 0; x < CLUSTER_X; x++)
+			{
+				// The tile's edges in NDC, scaled out to both ends of the slice (view space looks down -z)
+				float x0 = (-1.0f + 2.0f * x / CLUSTER_X) / projection[0][0], x1 = (-1.0f + 2.0f * (x + 1) / CLUSTER_X) / projection[0][0];
+				float y0 = (-1.0f + 2.0f * y / CLUSTER_Y) / projection[1][1], y1 = (-1.0f + 2.0f * (y + 1) / CLUSTER_Y) / projection[1][1];
+				int c = x + CLUSTER_X * (y + CLUSTER_Y * z);
+				bounds->min_x[c] = glm::min(x0 * depth_near, x0 * depth_far);
+				bounds->max_x[c] = glm::max(x1 * depth_near, x1 * depth_far);
+				bounds->min_y[c] = glm::min(y0 * depth_near, y0 * depth_far);
+				bounds->max_y[c] = glm::max(y1 * depth_near, y1 * depth_far);
+				bounds->min_z[c] = -depth_far;
+				bounds->max_z[c] = -depth_near;
+			}
+		}
+	}
+}
+
+// Adds the light to every cluster its sphere touches, only looking at the slices its depth covers
+void Lights::bin(int light, glm::vec3 center, float radius)
+{
+	float depth = -center.z;
+	int first = slice(depth - radius);
+	int last = slice(depth + radius);
+	float r2 = radius * radius;
+
+	for (int z = first; z <= last; z++)
+	{
+		int start = z * CLUSTER_X * CLUSTER_Y;
+		int end = start + CLUSTER_X * CLUSTER_Y;
+#ifdef LIGHTS_SSE
+		// Squared distance from the centre to each box, four boxes at a time
+		__m128 cx = _mm_set1_ps(center.x), cy = _mm_set1_ps(center.y), cz = _mm_set1_ps(center.z);
+		__m128 limit = _mm_set1_ps(r2), zero = _mm_setzero_ps();
+		for (int c = start; c < end; c += 4)
+		{
+			__m128 dx = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(bounds->min_x + c), cx), _mm_sub_ps(cx, _mm_loadu_ps(bounds->max_x + c))), zero);
+			__m128 dy = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(bounds->min_y + c), cy), _mm_sub_ps(cy, _mm_loadu_ps(bounds->max_y + c))), zero);
+			__m128 dz = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(bounds->min_z + c), cz), _mm_sub_ps(cz, _mm_loadu_ps(bounds->max_z + c))), zero);
+			__m128 d2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+			int mask = _mm_movemask_ps(_mm_cmple_ps(d2, limit));
+			for (int i = 0; mask != 0; i++, mask >>= 1)
+			{
+				if (!(mask & 1)) continue;
+				hits.push_back(c + i);
+				hits.push_back(light);
+				counts[c + i]++;
+			}
+		}
+#else
+		for (int c = start; c < end; c++)
+		{
+			float dx = glm::max(glm::max(bounds->min_x[c] - center.x, center.x - bounds->max_x[c]), 0.0f);
+			float dy = glm::max(glm::max(bounds->min_y[c] - center.y, center.y - bounds->max_y[c]), 0.0f);
+			float dz = glm::max(glm::max(bounds->min_z[c] - center.z, center.z - bounds->max_z[c]), 0.0f);
+			if (dx * dx + dy * dy + dz * dz > r2) continue;
+			hits.push_back(c);
+			hits.push_back(light);
+			counts[c]++;
+		}
+#endif
+	}
+}
+
+void Lights::build(const glm::mat4 & view, const glm::mat4 & projection)
+{
+	PROFILE_ZONE("light clusters");
+	if (projection != bounds_projection) build_bounds(projection);
+
+	std::fill(counts.begin(), counts.end(), 0);
+	hits.clear();
+	int count = (int)std::min(points.size(), (size_t)CLUSTER_MAX_LIGHTS);
+	for (int i = 0; i < count; i++)
+	{
+		const PointLight & light = points[i];
+		light_data[i * 8] = light.position.x;
+		light_data[i * 8 + 1] = light.position.y;
+		light_data[i * 8 + 2] = light.position.z;
+		light_data[i * 8 + 3] = light.radius;
+		light_data[i * 8 + 4] = light.color.x;
+		light_data[i * 8 + 5] = light.color.y;
+		light_data[i * 8 + 6] = light.color.z;
+		light_data[i * 8 + 7] = 0.0f;
+
+		glm::vec3 center = glm::vec3(view * glm::vec4(light.position, 1.0f));
+		if (-center.z + light.radius < near_plane || -center.z - light.radius > far_plane) continue;
+		bin(i, center, light.radius);
+	}
+
+	// Offsets from the counts, then each cluster's lights in light order. Anything past the index
+	// buffer is dropped and counted, those clusters just miss some lights.
+	GLuint offset = 0;
+	for (int c = 0; c < CLUSTER_COUNT; c++)
+	{
+		GLuint n = std::min(counts[c], (GLuint)CLUSTER_MAX_INDICES - offset);
+		overflows += counts[c] - n;
+		busiest = std::max(busiest, n);
+		grid[c * 2] = offset;
+		grid[c * 2 + 1] = n;
+		offset += n;
+		counts[c] = 0;
+	}
+	for (size_t i = 0; i < hits.size(); i += 2)
+	{
+		GLuint c = hits[i];
+		if (counts[c] >= grid[c * 2 + 1]) continue;
+		indices[grid[c * 2] + counts[c]++] = hits[i + 1];
+	}
+	builds++;
+	references += offset;
+
+	// Orphan first, the previous pass may still be reading them
+	const void * data[3] = { &light_data[0], &grid[0], &indices[0] };
+	GLsizeiptr sizes[3] = { (GLsizeiptr)(light_data.size() * sizeof(GLfloat)), (GLsizeiptr)(grid.size() * sizeof(GLuint)), (GLsizeiptr)(indices.size() * sizeof(GLuint)) };
+	GLsizeiptr used[3] = { (GLsizeiptr)(std::max(count, 1) * 8 * sizeof(GLfloat)), sizes[1], (GLsizeiptr)(std::max(offset, 1u) * sizeof(GLuint)) };
+	for (int i = 0; i < 3; i++)
+	{
+		glBindBuffer(GL_TEXTURE_BUFFER, buffers[i]);
+		glBufferData(GL_TEXTURE_BUFFER, sizes[i], NULL, GL_STREAM_DRAW);
+		glBufferSubData(GL_TEXTURE_BUFFER, 0, used[i], data[i]);
+		glActiveTexture(GL_TEXTURE0 + CLUSTER_TEXTURE_UNIT + i);
+		glBindTexture(GL_TEXTURE_BUFFER, textures[i]);
+	}
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+	glActiveTexture(GL_TEXTURE0);
+}
+
+void Lights::apply(GLuint program)
+{
+	glUniform1i(glGetUniformLocation(program, "pointLights"), CLUSTER_TEXTURE_UNIT);
+	glUniform1i(glGetUniformLocation(program, "clusterGrid"), CLUSTER_TEXTURE_UNIT + 1);
+	glUniform1i(glGetUniformLocation(program, "clusterLights"), CLUSTER_TEXTURE_UNIT + 2);
+	glUniform2f(glGetUniformLocation(program, "clusterTile"), (float)DynamicResolution::render_width() / CLUSTER_X, (float)DynamicResolution::render_height() / CLUSTER_Y);
+	glUniform4f(glGetUniformLocation(program, "clusterDepth"), near_plane, far_plane, slice_scale, slice_bias);
+}
+
+void Lights::report()
+{
+	printf("Lights: %s, %d point lights, %d clusters\n", evening ? "evening" : "day", (int)points.size(), CLUSTER_COUNT);
+	if (builds == 0) return;
+	printf("  %.2f lights per cluster on average, %u in the busiest, %lld references dropped over %lld builds\n",
+		(double)references / builds / CLUSTER_COUNT, busiest, overflows, builds);
+}
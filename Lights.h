@@ -0,0 +1,83 @@
+#pragma once
+#ifndef _LIGHTS_H_
+#define _LIGHTS_H_
+
+#define GLFW_INCLUDE_GLEXT
+#ifdef __APPLE__
+#define GLFW_INCLUDE_GLCOREARB
+#else
+#include <GL/glew.h>
+#endif
+#include <GLFW/glfw3.h>
+// Use of degrees is deprecated. Use radians instead.
+#ifndef GLM_FORCE_RADIANS
+#define GLM_FORCE_RADIANS
+#endif
+#include <glm/glm.hpp>
+
+#include <vector>
+
+// Cluster grid: screen tiles times depth slices. Slice 0 runs from the near plane to CLUSTER_NEAR,
+// the rest split CLUSTER_NEAR..far plane exponentially so clusters stay roughly cube shaped.
+#define CLUSTER_X 16
+#define CLUSTER_Y 9
+#define CLUSTER_Z 24
+#define CLUSTER_COUNT (CLUSTER_X * CLUSTER_Y * CLUSTER_Z)
+#define CLUSTER_NEAR 5.0f
+#define CLUSTER_MAX_LIGHTS 1024
+#define CLUSTER_MAX_INDICES (CLUSTER_COUNT * 32)	// Light references over the whole grid
+#define CLUSTER_TEXTURE_UNIT 8		// Lights, grid and indices on this unit and the next two, clear of Water's 0-5
+
+struct PointLight
+{
+	glm::vec3 position;		// World space
+	float radius;			// Falls off to nothing here
+	glm::vec3 color;
+};
+
+// The sun plus any number of point lights, shaded with clustered forward lighting. Every pass, build()
+// bins the point lights into a view space cluster grid on the CPU, testing each light's sphere
+// against four cluster boxes at a time with SSE. Three texture buffers go to the GPU: the lights,
+// an (offset, count) pair per cluster and the light indices. shader.frag and terrainShader.frag
+// find their cluster from gl_FragCoord and only loop over the lights in it.
+class Lights
+{
+public:
+	static glm::vec3 sun_direction;		// Towards the sun
+	static glm::vec3 sun_color;
+	static std::vector<PointLight> points;
+	static bool evening;	// Dimmed sun and the torches lit
+
+	static void init();
+	static void clean_up();
+	static void set_evening(bool evening);
+	static void update(double time);	// Flickers the torches
+	static void build(const glm::mat4 & view, const glm::mat4 & projection);	// Once per pass, before anything lit draws
+	static void apply(GLuint program);	// Cluster uniforms for a lit program, after glUseProgram. The sun is set by each draw.
+	static void report();
+
+private:
+	struct ClusterBounds		// View space boxes, a structure of arrays so SSE loads four at once
+	{
+		float min_x[CLUSTER_COUNT], min_y[CLUSTER_COUNT], min_z[CLUSTER_COUNT];
+		float max_x[CLUSTER_COUNT], max_y[CLUSTER_COUNT], max_z[CLUSTER_COUNT];
+	};
+
+	static std::vector<PointLight> base;	// Unflickered torches
+	static ClusterBounds * bounds;
+	static glm::mat4 bounds_projection;		// bounds are rebuilt when the projection changes
+	static float near_plane, far_plane;
+	static float slice_scale, slice_bias;
+	static GLuint buffers[3], textures[3];	// Lights, grid, indices
+	static std::vector<GLfloat> light_data;
+	static std::vector<GLuint> grid, indices, counts;
+	static std::vector<GLuint> hits;		// Cluster and light pairs, in light order
+	static long long builds, references, overflows;
+	static GLuint busiest;
+
+	static void build_bounds(const glm::mat4 & projection);
+	static int slice(float depth);
+	static void bin(int light, glm::vec3 center, float radius);
+};
+
+#endif
@@ -0,0 +1,152 @@
+#include "Lz4.h"
+
+#include <string.h>
+#include <vector>
+
+static unsigned int read32(const unsigned char * p)
+{
+	unsigned int value;
+	memcpy(&value, p, 4);
+	return value;
+}
+
+static unsigned int hash4(unsigned int value)
+{
+	return (value * 2654435761u) >> (32 - LZ4_HASH_BITS);
+}
+
+// Lengths that don't fit the token's nibble continue in bytes of 255 plus a remainder
+static unsigned char * write_length(unsigned char * out, int length)
+{
+	for (; length >= 255; length -= 255) *out++ = 255;
+	*out++ = (unsigned char)length;
+	return out;
+}
+
+int Lz4::bound(int size)
+{
+	return size + size / 255 + 16;
+}
+
+int Lz4::compress(const char * source, int size, char * dest, int capacity)
+{
+	const unsigned char * src = (const unsigned char *)source;
+	unsigned char * out = (unsigned char *)dest;
+	unsigned char * out_end = out + capacity;
+	std::vector<int> table(1 << LZ4_HASH_BITS, -1);	// Last position each 4 byte sequence was seen
+
+	int anchor = 0;	// Start of the literals not written yet
+	int i = 0;
+	int match_start_limit = size - LZ4_MATCH_LIMIT;
+	int match_end_limit = size - LZ4_LAST_LITERALS;
+	while (i < match_start_limit)
+	{
+		unsigned int sequence = read32(src + i);
+		unsigned int hash = hash4(sequence);
+		int candidate = table[hash];
+		table[hash] = i;
+		if (candidate < 0 || i - candidate > LZ4_MAX_OFFSET || read32(src + candidate) != sequence)
+		{
+			i++;
+			continue;
+		}
+
+		// Grow the match backwards into the pending literals, then forwards as far as allowed
+		while (i > anchor && candidate > 0 && src[i - 1] == src[candidate - 1])
+		{
+			i--;
+			candidate--;
+		}
+		int length = LZ4_MIN_MATCH;
+		while (i + length < match_end_limit && src[i + length] == src[candidate + length]) length++;
+
+		int literals = i - anchor;
+		int match = length - LZ4_MIN_MATCH;
+		if (out + 1 + literals / 255 + 1 + literals + 2 + match / 255 + 1 > out_end) return 0;
+
+		unsigned char * token = out++;
+		*token = (unsigned char)(((literals < 15 ? literals : 15) << 4) | (match < 15 ? match : 15));
+		if (literals >= 15) out = write_length(out, literals - 15);
+		memcpy(out, src + anchor, literals);
+		out += literals;
+		int offset = i - candidate;
+		*out++ = (unsigned char)(offset & 0xff);
+		*out++ = (unsigned char)(offset >> 8);
+		if (match >= 15) out = write_length(out, match - 15);
+
+		i += length;
+		anchor = i;
+		if (i - 2 >= 0 && i - 2 < match_start_limit) table[hash4(read32(src + i - 2))] = i - 2;	// Helps runs find each other
+	}
+
+	// Whatever is left goes out as a final literal-only sequence
+	int literals = size - anchor;
+	if (out + 1 + literals / 255 + 1 + literals > out_end) return 0;
+	*out++ = (unsigned char)((literals < 15 ? literals : 15) << 4);
+	if (literals >= 15) out = write_length(out, literals - 15);
+	memcpy(out, src + anchor, literals);
+	out += literals;
+	return (int)(out - (unsigned char *)dest);
+}
+
+bool Lz4::decompress(const char * source, int packed_size, char * dest, int size)
+{
+	const unsigned char * in = (const unsigned char *)source;
+	const unsigned char * in_end = in + packed_size;
+	unsigned char * out = (unsigned char *)dest;
+	unsigned char * out_end = out + size;
+
+	while (in < in_end)
+	{
+		unsigned int token = *in++;
+
+		size_t literals = token >> 4;
+		if (literals == 15)
+		{
+			unsigned char more;
+			do
+			{
+				if (in >= in_end) return false;
+				more = *in++;
+				literals += more;
+			} while (more == 255);
+		}
+		if (literals > (size_t)(in_end - in) || literals > (size_t)(out_end - out)) return false;
+		memcpy(out, in, literals);
+		out += literals;
+		in += literals;
+		if (in == in_end) break;	// The last sequence has no match
+
+		if (in_end - in < 2) return false;
+		size_t offset = in[0] | (in[1] << 8);
+		in += 2;
+		if (offset == 0 || offset > (size_t)(out - (unsigned char *)dest)) return false;
+
+		size_t length = token & 15;
+		if (length == 15)
+		{
+			unsigned char more;
+			do
+			{
+				if (in >= in_end) return false;
+				more = *in++;
+				length += more;
+			} while (more == 255);
+		}
+		length += LZ4_MIN_MATCH;
+		if (length > (size_t)(out_end - out)) return false;
+
+		// Overlapping matches repeat the bytes just written, so those have to go one at a time
+		const unsigned char * match = out - offset;
+		if (offset >= length)
+		{
+			memcpy(out, match, length);
+		}
+		else
+		{
+			for (size_t k = 0; k < length; k++) out[k] = match[k];
+		}
+		out += length;
+	}
+	return out == out_end;
+}
@@ -0,0 +1,23 @@
+#pragma once
+#ifndef _LZ4_H_
+#define _LZ4_H_
+
+#define LZ4_HASH_BITS 16		// Match finder table size, 64K entries
+#define LZ4_MAX_OFFSET 65535	// Matches can reach this far back
+#define LZ4_MIN_MATCH 4
+#define LZ4_LAST_LITERALS 5		// The format requires the block to end in at least this many literals
+#define LZ4_MATCH_LIMIT 12		// ...and no match may start closer than this to the end
+
+// LZ4 block format, compatible with the reference implementation's LZ4_compress_default and
+// LZ4_decompress_safe. Greedy single-probe match finder: fast to pack, and unpacking is mostly memcpy.
+class Lz4
+{
+public:
+	static int bound(int size);	// Worst case compressed size
+	// Returns the compressed size, or 0 if it didn't fit in capacity
+	static int compress(const char * source, int size, char * dest, int capacity);
+	// Fails on corrupt input or if the result isn't exactly size bytes
+	static bool decompress(const char * source, int packed_size, char * dest, int size);
+};
+
+#endif
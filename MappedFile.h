@@ -0,0 +1,35 @@
+#pragma once
+#ifndef _MAPPEDFILE_H_
+#define _MAPPEDFILE_H_
+
+#include <stddef.h>
+
+// Read-only memory mapping of a whole file. The OS pages it in on demand, so there is no copy
+// into a heap buffer and no per-call read overhead.
+class MappedFile
+{
+public:
+	MappedFile();
+	~MappedFile();
+
+	bool open(const char * path);
+	void close();
+
+	const char * data() const { return view; }
+	size_t size() const { return length; }
+
+private:
+	const char * view;
+	size_t length;
+#ifdef _WIN32
+	void * file;	// HANDLEs, kept as void * so windows.h stays out of the header
+	void * mapping;
+#else
+	int fd;
+#endif
+
+	MappedFile(const MappedFile &);	// Not copyable, the mapping has one owner
+	MappedFile & operator=(const MappedFile &);
+};
+
+#endif
@@ -0,0 +1,150 @@
+#include "MeshCache.h"
+#include "Profiler.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <iostream>
+#include <algorithm>
+
+// On disk: this header, then vertices, normals (3 floats per vertex each) and the 32 bit indices.
+// Every field is 4 or 8 bytes and the header is 176 bytes, so the streams stay aligned in the mapping.
+struct MeshCacheHeader
+{
+	char magic[4];	// "MESH"
+	unsigned int version;
+	unsigned long long source_size;
+	unsigned long long source_mtime;
+	unsigned int vertex_count;
+	unsigned int index_count;
+	float bounds_min[3];
+	float bounds_max[3];
+	float transform[16];
+	unsigned int lod_count;
+	MeshLod lods[MESH_LOD_LEVELS];	// Ranges of the index stream
+};
+
+void MeshCache::cache_path(const char * source, char * out, int size)
+{
+	// Swap the extension: ../assets/object_files/Anchor.obj -> ../assets/object_files/Anchor.mesh
+	const char * dot = strrchr(source, '.');
+	const char * slash = strrchr(source, '/');
+	int length = (dot && (!slash || dot > slash)) ? (int)(dot - source) : (int)strlen(source);
+	snprintf(out, size, "%.*s%s", length, source, MESH_CACHE_EXTENSION);
+}
+
+bool MeshCache::load(const char * source, VFSFile & file, MeshCacheView & view)
+{
+	PROFILE_ZONE("MeshCache::load");
+	char path[512];
+	cache_path(source, path, sizeof(path));
+	if (!VFS::open(path, file)) return false;	// No cache yet
+
+	MeshCacheHeader header;
+	if (file.size() < sizeof(header))
+	{
+		file.close();
+		return false;
+	}
+	memcpy(&header, file.data(), sizeof(header));
+	if (memcmp(header.magic, "MESH", 4) != 0 || header.version != MESH_CACHE_VERSION)
+	{
+		file.close();
+		return false;
+	}
+
+	// Rebuild if the OBJ changed since the cache was written. Without the OBJ the cache is all we have.
+	unsigned long long source_size, source_mtime;
+	if (VFS::stat(source, source_size, source_mtime) && (source_size != header.source_size || source_mtime != header.source_mtime))
+	{
+		std::cout << path << " is out of date, reparsing " << source << std::endl;
+		file.close();
+		return false;
+	}
+
+	unsigned long long expected = sizeof(header) + (unsigned long long)header.vertex_count * 6 * sizeof(float) + (unsigned long long)header.index_count * sizeof(unsigned int);
+	if (file.size() != expected)
+	{
+		std::cerr << path << " is truncated, reparsing " << source << std::endl;
+		file.close();
+		return false;
+	}
+
+	const char * data = file.data() + sizeof(header);
+	view.vertex_count = header.vertex_count;
+	view.index_count = header.index_count;
+	view.vertices = (const float *)data;
+	view.normals = view.vertices + header.vertex_count * 3;
+	view.indices = (const unsigned int *)(view.normals + header.vertex_count * 3);
+	view.min = glm::vec3(header.bounds_min[0], header.bounds_min[1], header.bounds_min[2]);
+	view.max = glm::vec3(header.bounds_max[0], header.bounds_max[1], header.bounds_max[2]);
+	memcpy(&view.transform[0][0], header.transform, sizeof(header.transform));
+	view.lod_count = header.lod_count;
+	memcpy(view.lods, header.lods, sizeof(header.lods));
+	bool lods_ok = view.lod_count > 0 && view.lod_count <= MESH_LOD_LEVELS;
+	for (unsigned int i = 0; lods_ok && i < view.lod_count; i++)
+		lods_ok = (unsigned long long)view.lods[i].offset + view.lods[i].count <= view.index_count;
+	if (!lods_ok)
+	{
+		std::cerr << path << " has bad LOD ranges, reparsing " << source << std::endl;
+		file.close();
+		return false;
+	}
+	return true;
+}
+
+bool MeshCache::write(const char * source, const std::vector<float> & vertices, const std::vector<float> & normals,
+	const std::vector<unsigned int> & indices, const std::vector<MeshLod> & lods, glm::vec3 min, glm::vec3 max, const glm::mat4 & transform)
+{
+	PROFILE_ZONE("MeshCache::write");
+	unsigned long long source_size, source_mtime;
+	if (!VFS::stat(source, source_size, source_mtime)) return false;
+
+	MeshCacheHeader header;
+	memcpy(header.magic, "MESH", 4);
+	header.version = MESH_CACHE_VERSION;
+	header.source_size = source_size;
+	header.source_mtime = source_mtime;
+	header.vertex_count = (unsigned int)(vertices.size() / 3);
+	header.index_count = (unsigned int)indices.size();
+	header.bounds_min[0] = min.x;
+	header.bounds_min[1] = min.y;
+	header.bounds_min[2] = min.z;
+	header.bounds_max[0] = max.x;
+	header.bounds_max[1] = max.y;
+	header.bounds_max[2] = max.z;
+	memcpy(header.transform, &transform[0][0], sizeof(header.transform));
+	memset(header.lods, 0, sizeof(header.lods));
+	header.lod_count = (unsigned int)std::min(lods.size(), (size_t)MESH_LOD_LEVELS);
+	if (header.lod_count > 0) memcpy(header.lods, &lods[0], header.lod_count * sizeof(MeshLod));
+
+	// Write to a temporary file and swap it in, so a crash never leaves a half written cache behind
+	char path[512], temp[520];
+	cache_path(source, path, sizeof(path));
+	snprintf(temp, sizeof(temp), "%s.tmp", path);
+	FILE * fp = fopen(temp, "wb");
+	if (fp == NULL)
+	{
+		std::cerr << "could not write mesh cache " << temp << std::endl;
+		return false;
+	}
+	bool ok = fwrite(&header, sizeof(header), 1, fp) == 1;
+	if (!vertices.empty()) ok = ok && fwrite(&vertices[0], sizeof(float), vertices.size(), fp) == vertices.size();
+	if (!normals.empty()) ok = ok && fwrite(&normals[0], sizeof(float), normals.size(), fp) == normals.size();
+	if (!indices.empty()) ok = ok && fwrite(&indices[0], sizeof(unsigned int), indices.size(), fp) == indices.size();
+	ok = fclose(fp) == 0 && ok;
+	if (!ok)
+	{
+		std::cerr << "could not write mesh cache " << temp << std::endl;
+		remove(temp);
+		return false;
+	}
+
+	remove(path);	// rename won't replace an existing file on Windows
+	if (rename(temp, path) != 0)
+	{
+		std::cerr << "could not write mesh cache " << path << std::endl;
+		remove(temp);
+		return false;
+	}
+	return true;
+}
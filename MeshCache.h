@@ -0,0 +1,48 @@
+#pragma once
+#ifndef _MESHCACHE_H_
+#define _MESHCACHE_H_
+
+// Use of degrees is deprecated. Use radians instead.
+#ifndef GLM_FORCE_RADIANS
+#define GLM_FORCE_RADIANS
+#endif
+#include <glm/vec3.hpp>
+#include <glm/mat4x4.hpp>
+#include <vector>
+
+#include "VFS.h"
+#include "MeshSimplifier.h"
+
+#define MESH_CACHE_EXTENSION ".mesh"	// Written next to the OBJ it came from
+#define MESH_CACHE_VERSION 2			// Bump when parse/optimise output changes so old caches get rebuilt
+
+// A mesh cache file mapped into memory. The streams point straight into the mapping and are only
+// valid while the VFSFile it was loaded with stays open.
+struct MeshCacheView
+{
+	const float * vertices;		// xyz per vertex
+	const float * normals;		// xyz per vertex
+	const unsigned int * indices;	// Every LOD's indices, one after the other
+	unsigned int vertex_count;
+	unsigned int index_count;
+	unsigned int lod_count;
+	MeshLod lods[MESH_LOD_LEVELS];
+	glm::vec3 min;
+	glm::vec3 max;
+	glm::mat4 transform;	// OBJObject's origPos: centres the model and scales it to 10 units
+};
+
+// Binary cache of a parsed, welded and optimised OBJ so later launches skip parsing entirely.
+// The header stores the source's size and modification time, a cache that doesn't match is ignored.
+class MeshCache
+{
+public:
+	static bool load(const char * source, VFSFile & file, MeshCacheView & view);
+	static bool write(const char * source, const std::vector<float> & vertices, const std::vector<float> & normals,
+		const std::vector<unsigned int> & indices, const std::vector<MeshLod> & lods, glm::vec3 min, glm::vec3 max, const glm::mat4 & transform);
+
+private:
+	static void cache_path(const char * source, char * out, int size);
+};
+
+#endif
@@ -0,0 +1,240 @@
+#include "MeshOptimizer.h"
+
+#include <math.h>
+#include <string.h>
+#include <unordered_map>
+
+// Hash key for welding, compares the exact float bits so only truly identical corners merge
+struct WeldKey
+{
+	float v[6];
+
+	bool operator==(const WeldKey & other) const { return memcmp(v, other.v, sizeof(v)) == 0; }
+};
+
+struct WeldHash
+{
+	size_t operator()(const WeldKey & key) const
+	{
+		// FNV-1a over the raw bytes
+		const unsigned char * bytes = (const unsigned char *)key.v;
+		size_t hash = 2166136261u;
+		for (unsigned int i = 0; i < sizeof(key.v); i++)
+		{
+			hash ^= bytes[i];
+			hash *= 16777619u;
+		}
+		return hash;
+	}
+};
+
+void MeshOptimizer::weld(const std::vector<glm::vec3> & positions, const std::vector<glm::vec3> & normals,
+	std::vector<float> & out_vertices, std::vector<float> & out_normals, std::vector<unsigned int> & out_indices)
+{
+	std::unordered_map<WeldKey, unsigned int, WeldHash> welded;
+	welded.reserve(positions.size());
+	out_indices.reserve(out_indices.size() + positions.size());
+
+	for (unsigned int i = 0; i < positions.size(); i++)
+	{
+		WeldKey key;
+		key.v[0] = positions[i].x;
+		key.v[1] = positions[i].y;
+		key.v[2] = positions[i].z;
+		key.v[3] = normals[i].x;
+		key.v[4] = normals[i].y;
+		key.v[5] = normals[i].z;
+
+		std::unordered_map<WeldKey, unsigned int, WeldHash>::iterator it = welded.find(key);
+		if (it != welded.end())
+		{
+			out_indices.push_back(it->second);
+			continue;
+		}
+
+		unsigned int index = (unsigned int)(out_vertices.size() / 3);
+		welded[key] = index;
+		out_indices.push_back(index);
+		out_vertices.insert(out_vertices.end(), key.v, key.v + 3);
+		out_normals.insert(out_normals.end(), key.v + 3, key.v + 6);
+	}
+}
+
+// Forsyth's vertex score: vertices near the front of the cache and with few triangles left score highest
+static float vertex_score(int cache_position, unsigned int live_triangles)
+{
+	if (live_triangles == 0) return -1.0f;	// Nothing left to draw with it
+
+	float score = 0.0f;
+	if (cache_position >= 0)
+	{
+		if (cache_position < 3)
+		{
+			// Used by the last triangle, scored a bit lower so strips don't get favoured over fans
+			score = 0.75f;
+		}
+		else
+		{
+			float scale = 1.0f / (VERTEX_CACHE_SIZE - 3);
+			score = powf(1.0f - (cache_position - 3) * scale, 1.5f);
+		}
+	}
+
+	// Boost vertices with few triangles left so they get finished off instead of left stranded
+	score += 2.0f * powf((float)live_triangles, -0.5f);
+	return score;
+}
+
+void MeshOptimizer::optimize_vertex_cache(std::vector<unsigned int> & indices, unsigned int vertex_count)
+{
+	unsigned int triangle_count = (unsigned int)indices.size() / 3;
+	if (triangle_count == 0) return;
+
+	// Triangles using each vertex, packed into one array. live[v] shrinks as triangles get emitted.
+	std::vector<unsigned int> live(vertex_count, 0);
+	for (unsigned int i = 0; i < indices.size(); i++) live[indices[i]]++;
+	std::vector<unsigned int> offsets(vertex_count + 1, 0);
+	for (unsigned int v = 0; v < vertex_count; v++) offsets[v + 1] = offsets[v] + live[v];
+	std::vector<unsigned int> adjacency(indices.size());
+	std::vector<unsigned int> fill(offsets.begin(), offsets.end() - 1);
+	for (unsigned int i = 0; i < indices.size(); i++) adjacency[fill[indices[i]]++] = i / 3;
+
+	std::vector<int> cache_position(vertex_count, -1);
+	std::vector<float> score(vertex_count);
+	for (unsigned int v = 0; v < vertex_count; v++) score[v] = vertex_score(-1, live[v]);
+
+	std::vector<float> triangle_score(triangle_count);
+	std::vector<bool> emitted(triangle_count, false);
+	int best = -1;
+	float best_score = -1.0f;
+	for (unsigned int t = 0; t < triangle_count; t++)
+	{
+		triangle_score[t] = score[indices[t * 3]] + score[indices[t * 3 + 1]] + score[indices[t * 3 + 2]];
+		if (triangle_score[t] > best_score)
+		{
+			best_score = triangle_score[t];
+			best = t;
+		}
+	}
+
+	std::vector<unsigned int> output;
+	output.reserve(indices.size());
+	std::vector<unsigned int> cache, next_cache;
+	cache.reserve(VERTEX_CACHE_SIZE + 3);
+	next_cache.reserve(VERTEX_CACHE_SIZE + 3);
+	unsigned int scan = 0;
+
+	while (output.size() < indices.size())
+	{
+		if (best < 0)
+		{
+			// Nothing in the cache has triangles left, start again from the next unused triangle
+			while (emitted[scan]) scan++;
+			best = scan;
+		}
+
+		const unsigned int * tri = &indices[best * 3];
+		emitted[best] = true;
+		output.insert(output.end(), tri, tri + 3);
+
+		// Take the triangle out of its vertices' adjacency lists
+		for (int k = 0; k < 3; k++)
+		{
+			unsigned int v = tri[k];
+			unsigned int * list = &adjacency[offsets[v]];
+			for (unsigned int j = 0; j < live[v]; j++)
+			{
+				if (list[j] == (unsigned int)best)
+				{
+					list[j] = list[live[v] - 1];
+					break;
+				}
+			}
+			live[v]--;
+		}
+
+		// LRU update: this triangle's vertices move to the front
+		next_cache.clear();
+		for (int k = 0; k < 3; k++)
+			if (next_cache.empty() || (next_cache[0] != tri[k] && (next_cache.size() < 2 || next_cache[1] != tri[k])))
+				next_cache.push_back(tri[k]);
+		for (unsigned int i = 0; i < cache.size(); i++)
+			if (cache[i] != tri[0] && cache[i] != tri[1] && cache[i] != tri[2])
+				next_cache.push_back(cache[i]);
+
+		for (unsigned int i = 0; i < next_cache.size(); i++)
+		{
+			unsigned int v = next_cache[i];
+			cache_position[v] = i < VERTEX_CACHE_SIZE ? (int)i : -1;
+			score[v] = vertex_score(cache_position[v], live[v]);
+		}
+
+		// Only triangles touching the cache (or just evicted from it) changed score
+		best = -1;
+		best_score = -1.0f;
+		for (unsigned int i = 0; i < next_cache.size(); i++)
+		{
+			unsigned int v = next_cache[i];
+			const unsigned int * list = &adjacency[offsets[v]];
+			for (unsigned int j = 0; j < live[v]; j++)
+			{
+				unsigned int t = list[j];
+				triangle_score[t] = score[indices[t * 3]] + score[indices[t * 3 + 1]] + score[indices[t * 3 + 2]];
+				if (triangle_score[t] > best_score)
+				{
+					best_score = triangle_score[t];
+					best = t;
+				}
+			}
+		}
+
+		if (next_cache.size() > VERTEX_CACHE_SIZE) next_cache.resize(VERTEX_CACHE_SIZE);
+		cache.swap(next_cache);
+	}
+
+	indices.swap(output);
+}
+
+void MeshOptimizer::optimize_vertex_fetch(std::vector<unsigned int> & indices, std::vector<float> & vertices, std::vector<float> & normals)
+{
+	unsigned int vertex_count = (unsigned int)(vertices.size() / 3);
+	std::vector<unsigned int> remap(vertex_count, (unsigned int)-1);
+	std::vector<float> new_vertices, new_normals;
+	new_vertices.reserve(vertices.size());
+	new_normals.reserve(normals.size());
+
+	for (unsigned int i = 0; i < indices.size(); i++)
+	{
+		unsigned int v = indices[i];
+		if (remap[v] == (unsigned int)-1)
+		{
+			remap[v] = (unsigned int)(new_vertices.size() / 3);
+			new_vertices.insert(new_vertices.end(), &vertices[v * 3], &vertices[v * 3] + 3);
+			new_normals.insert(new_normals.end(), &normals[v * 3], &normals[v * 3] + 3);
+		}
+		indices[i] = remap[v];
+	}
+
+	// Vertices no triangle uses are dropped
+	vertices.swap(new_vertices);
+	normals.swap(new_normals);
+}
+
+float MeshOptimizer::acmr(const std::vector<unsigned int> & indices, unsigned int vertex_count)
+{
+	if (indices.size() < 3) return 0.0f;
+
+	// FIFO cache: a vertex stays cached until ACMR_CACHE_SIZE misses have happened after it
+	std::vector<unsigned int> cached_at(vertex_count, 0);
+	unsigned int misses = 0;
+	for (unsigned int i = 0; i < indices.size(); i++)
+	{
+		unsigned int v = indices[i];
+		if (cached_at[v] == 0 || misses - cached_at[v] >= ACMR_CACHE_SIZE)
+		{
+			misses++;
+			cached_at[v] = misses;	// Miss numbers start at 1, so 0 means never seen
+		}
+	}
+	return (float)misses / (indices.size() / 3);
+}
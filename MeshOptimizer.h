@@ -0,0 +1,27 @@
+#pragma once
+#ifndef _MESHOPTIMIZER_H_
+#define _MESHOPTIMIZER_H_
+
+#include <glm/vec3.hpp>
+#include <vector>
+
+#define VERTEX_CACHE_SIZE 32	// LRU size the triangle order is tuned for
+#define ACMR_CACHE_SIZE 16		// FIFO size used when reporting ACMR, a typical post-transform cache
+
+// Index buffer optimisations for triangle lists. Positions and normals are kept as flat float
+// arrays (xyz per vertex) the way OBJObject uploads them.
+class MeshOptimizer
+{
+public:
+	// Builds an indexed mesh from one position/normal pair per triangle corner, merging identical pairs
+	static void weld(const std::vector<glm::vec3> & positions, const std::vector<glm::vec3> & normals,
+		std::vector<float> & out_vertices, std::vector<float> & out_normals, std::vector<unsigned int> & out_indices);
+	// Reorders triangles so consecutive ones reuse recently transformed vertices (Forsyth's algorithm)
+	static void optimize_vertex_cache(std::vector<unsigned int> & indices, unsigned int vertex_count);
+	// Renumbers vertices in the order the index buffer first uses them, so fetches walk memory forwards
+	static void optimize_vertex_fetch(std::vector<unsigned int> & indices, std::vector<float> & vertices, std::vector<float> & normals);
+	// Average cache miss ratio: vertex shader runs per triangle, 3 is no reuse and ~0.5 is the best a grid can do
+	static float acmr(const std::vector<unsigned int> & indices, unsigned int vertex_count);
+};
+
+#endif
@@ -0,0 +1,328 @@
+#include "MeshSimplifier.h"
+#include "MeshOptimizer.h"
+#include "Profiler.h"
+
+#include <math.h>
+#include <algorithm>
+#include <queue>
+#include <unordered_map>
+
+#define BORDER_WEIGHT 10.0	// Keeps open edges (the stones have them) from shrinking inwards
+
+// Sum of squared distances to a set of planes, stored as the symmetric 4x4 matrix. weight is the
+// total area that went in so the error can be normalised back into a distance.
+struct Quadric
+{
+	double a2, ab, ac, ad, b2, bc, bd, c2, cd, d2;
+	double weight;
+};
+
+static void quadric_zero(Quadric & q)
+{
+	q.a2 = q.ab = q.ac = q.ad = q.b2 = q.bc = q.bd = q.c2 = q.cd = q.d2 = q.weight = 0.0;
+}
+
+// Plane ax + by + cz + d = 0 with (a, b, c) unit length, scaled by w
+static void quadric_add_plane(Quadric & q, double a, double b, double c, double d, double w)
+{
+	q.a2 += w * a * a; q.ab += w * a * b; q.ac += w * a * c; q.ad += w * a * d;
+	q.b2 += w * b * b; q.bc += w * b * c; q.bd += w * b * d;
+	q.c2 += w * c * c; q.cd += w * c * d;
+	q.d2 += w * d * d;
+	q.weight += w;
+}
+
+static void quadric_add(Quadric & q, const Quadric & r)
+{
+	q.a2 += r.a2; q.ab += r.ab; q.ac += r.ac; q.ad += r.ad;
+	q.b2 += r.b2; q.bc += r.bc; q.bd += r.bd;
+	q.c2 += r.c2; q.cd += r.cd;
+	q.d2 += r.d2;
+	q.weight += r.weight;
+}
+
+// Mean squared distance from p to the planes
+static double quadric_error(const Quadric & q, const float * p)
+{
+	double x = p[0], y = p[1], z = p[2];
+	double error = q.a2 * x * x + 2.0 * q.ab * x * y + 2.0 * q.ac * x * z + 2.0 * q.ad * x
+		+ q.b2 * y * y + 2.0 * q.bc * y * z + 2.0 * q.bd * y
+		+ q.c2 * z * z + 2.0 * q.cd * z
+		+ q.d2;
+	return q.weight > 0.0 ? fabs(error) / q.weight : 0.0;
+}
+
+static void triangle_normal(const float * p0, const float * p1, const float * p2, double * n)
+{
+	double e1[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+	double e2[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+	n[0] = e1[1] * e2[2] - e1[2] * e2[1];
+	n[1] = e1[2] * e2[0] - e1[0] * e2[2];
+	n[2] = e1[0] * e2[1] - e1[1] * e2[0];
+}
+
+// Moving vertex from onto vertex to, with the cost of doing so
+struct Collapse
+{
+	double cost;
+	unsigned int from;
+	unsigned int to;
+	unsigned int from_version;
+	unsigned int to_version;
+
+	bool operator>(const Collapse & other) const { return cost > other.cost; }
+};
+
+float MeshSimplifier::simplify(const std::vector<float> & vertices, const std::vector<float> & normals,
+	const std::vector<unsigned int> & indices, unsigned int target_index_count, std::vector<unsigned int> & out)
+{
+	PROFILE_ZONE("MeshSimplifier::simplify");
+	out.clear();
+	unsigned int vertex_count = (unsigned int)(vertices.size() / 3);
+	unsigned int triangle_count = (unsigned int)(indices.size() / 3);
+	const float * positions = vertices.empty() ? NULL : &vertices[0];
+
+	// Welding kept vertices with different normals apart, but they are one point on the surface.
+	// Collapse on positions so hard edges can't tear open, and pick the matching normal at the end.
+	std::vector<unsigned int> order(vertex_count);
+	for (unsigned int i = 0; i < vertex_count; i++) order[i] = i;
+	std::sort(order.begin(), order.end(), [positions](unsigned int a, unsigned int b) {
+		const float * pa = positions + a * 3;
+		const float * pb = positions + b * 3;
+		if (pa[0] != pb[0]) return pa[0] < pb[0];
+		if (pa[1] != pb[1]) return pa[1] < pb[1];
+		return pa[2] < pb[2];
+	});
+	std::vector<unsigned int> remap(vertex_count);
+	std::vector<unsigned int> wedge_start(vertex_count), wedge_end(vertex_count);	// Range of order sharing the position
+	for (unsigned int i = 0; i < vertex_count;)
+	{
+		unsigned int j = i + 1;
+		const float * p = positions + order[i] * 3;
+		while (j < vertex_count && positions[order[j] * 3] == p[0] && positions[order[j] * 3 + 1] == p[1] && positions[order[j] * 3 + 2] == p[2]) j++;
+		for (unsigned int k = i; k < j; k++) remap[order[k]] = order[i];
+		wedge_start[order[i]] = i;
+		wedge_end[order[i]] = j;
+		i = j;
+	}
+
+	std::vector<unsigned int> triangles(indices.size());
+	std::vector<char> dead(triangle_count, 0);
+	unsigned int live = triangle_count;
+	for (unsigned int i = 0; i < indices.size(); i++) triangles[i] = remap[indices[i]];
+	for (unsigned int t = 0; t < triangle_count; t++)
+	{
+		unsigned int * tri = &triangles[t * 3];
+		if (tri[0] == tri[1] || tri[1] == tri[2] || tri[0] == tri[2])
+		{
+			dead[t] = 1;
+			live--;
+		}
+	}
+
+	// Each vertex starts with the planes of the triangles around it, weighted by area
+	std::vector<Quadric> quadrics(vertex_count);
+	for (unsigned int i = 0; i < vertex_count; i++) quadric_zero(quadrics[i]);
+	std::vector<std::vector<unsigned int> > vertex_triangles(vertex_count);
+	std::unordered_map<unsigned long long, unsigned int> edges;	// Edge -> number of triangles using it
+	for (unsigned int t = 0; t < triangle_count; t++)
+	{
+		if (dead[t]) continue;
+		unsigned int * tri = &triangles[t * 3];
+		double n[3];
+		triangle_normal(positions + tri[0] * 3, positions + tri[1] * 3, positions + tri[2] * 3, n);
+		double length = sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+		for (int k = 0; k < 3; k++)
+		{
+			vertex_triangles[tri[k]].push_back(t);
+			unsigned int a = std::min(tri[k], tri[(k + 1) % 3]), b = std::max(tri[k], tri[(k + 1) % 3]);
+			edges[((unsigned long long)a << 32) | b]++;
+		}
+		if (length == 0.0) continue;
+
+		const float * p = positions + tri[0] * 3;
+		double a = n[0] / length, b = n[1] / length, c = n[2] / length;
+		double d = -(a * p[0] + b * p[1] + c * p[2]);
+		for (int k = 0; k < 3; k++) quadric_add_plane(quadrics[tri[k]], a, b, c, d, length * 0.5);
+	}
+
+	// Edges with only one triangle are borders. Add a plane through the edge, perpendicular to the
+	// triangle, so collapses along the border are cheap and collapses across it are expensive.
+	for (unsigned int t = 0; t < triangle_count; t++)
+	{
+		if (dead[t]) continue;
+		unsigned int * tri = &triangles[t * 3];
+		double n[3];
+		triangle_normal(positions + tri[0] * 3, positions + tri[1] * 3, positions + tri[2] * 3, n);
+		for (int k = 0; k < 3; k++)
+		{
+			unsigned int v0 = tri[k], v1 = tri[(k + 1) % 3];
+			if (edges[((unsigned long long)std::min(v0, v1) << 32) | std::max(v0, v1)] != 1) continue;
+
+			const float * p0 = positions + v0 * 3;
+			const float * p1 = positions + v1 * 3;
+			double e[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+			double plane[3] = { e[1] * n[2] - e[2] * n[1], e[2] * n[0] - e[0] * n[2], e[0] * n[1] - e[1] * n[0] };
+			double length = sqrt(plane[0] * plane[0] + plane[1] * plane[1] + plane[2] * plane[2]);
+			if (length == 0.0) continue;
+			plane[0] /= length;
+			plane[1] /= length;
+			plane[2] /= length;
+			double d = -(plane[0] * p0[0] + plane[1] * p0[1] + plane[2] * p0[2]);
+			double w = (e[0] * e[0] + e[1] * e[1] + e[2] * e[2]) * BORDER_WEIGHT;
+			quadric_add_plane(quadrics[v0], plane[0], plane[1], plane[2], d, w);
+			quadric_add_plane(quadrics[v1], plane[0], plane[1], plane[2], d, w);
+		}
+	}
+
+	// Cheapest collapses first. Entries go stale when either end changes, the versions catch that.
+	std::vector<unsigned int> version(vertex_count, 0);
+	std::vector<unsigned int> collapsed_to(vertex_count);
+	for (unsigned int i = 0; i < vertex_count; i++) collapsed_to[i] = i;
+	std::priority_queue<Collapse, std::vector<Collapse>, std::greater<Collapse> > queue;
+	auto push_edge = [&](unsigned int a, unsigned int b) {
+		Quadric q = quadrics[a];
+		quadric_add(q, quadrics[b]);
+		double a_to_b = quadric_error(q, positions + b * 3);
+		double b_to_a = quadric_error(q, positions + a * 3);
+		Collapse c;
+		c.cost = std::min(a_to_b, b_to_a);
+		c.from = a_to_b <= b_to_a ? a : b;
+		c.to = a_to_b <= b_to_a ? b : a;
+		c.from_version = version[c.from];
+		c.to_version = version[c.to];
+		queue.push(c);
+	};
+	for (std::unordered_map<unsigned long long, unsigned int>::iterator it = edges.begin(); it != edges.end(); ++it)
+		push_edge((unsigned int)(it->first >> 32), (unsigned int)(it->first & 0xffffffffu));
+
+	unsigned int target_triangles = target_index_count / 3;
+	double worst = 0.0;
+	std::vector<unsigned int> neighbours;
+	while (live > target_triangles && !queue.empty())
+	{
+		Collapse c = queue.top();
+		queue.pop();
+		if (collapsed_to[c.from] != c.from || collapsed_to[c.to] != c.to) continue;
+		if (version[c.from] != c.from_version || version[c.to] != c.to_version) continue;
+
+		// Refuse collapses that would fold a surviving triangle over or squash it flat
+		bool flips = false;
+		const float * target = positions + c.to * 3;
+		std::vector<unsigned int> & around = vertex_triangles[c.from];
+		for (unsigned int i = 0; i < around.size() && !flips; i++)
+		{
+			unsigned int t = around[i];
+			unsigned int * tri = &triangles[t * 3];
+			if (dead[t] || tri[0] == c.to || tri[1] == c.to || tri[2] == c.to) continue;
+
+			const float * p[3];
+			for (int k = 0; k < 3; k++) p[k] = positions + tri[k] * 3;
+			double before[3], after[3];
+			triangle_normal(p[0], p[1], p[2], before);
+			for (int k = 0; k < 3; k++) if (tri[k] == c.from) p[k] = target;
+			triangle_normal(p[0], p[1], p[2], after);
+			double dot = before[0] * after[0] + before[1] * after[1] + before[2] * after[2];
+			double after_length = after[0] * after[0] + after[1] * after[1] + after[2] * after[2];
+			flips = dot <= 0.0 || after_length == 0.0;
+		}
+		if (flips) continue;
+
+		// Move everything attached to from onto to. Triangles that had both are gone.
+		collapsed_to[c.from] = c.to;
+		quadric_add(quadrics[c.to], quadrics[c.from]);
+		for (unsigned int i = 0; i < around.size(); i++)
+		{
+			unsigned int t = around[i];
+			if (dead[t]) continue;
+			unsigned int * tri = &triangles[t * 3];
+			if (tri[0] == c.to || tri[1] == c.to || tri[2] == c.to)
+			{
+				dead[t] = 1;
+				live--;
+				continue;
+			}
+			for (int k = 0; k < 3; k++) if (tri[k] == c.from) tri[k] = c.to;
+			vertex_triangles[c.to].push_back(t);
+		}
+		around.clear();
+		worst = std::max(worst, c.cost);
+		version[c.to]++;
+
+		// Drop dead triangles from to's list while gathering its new neighbours to requeue
+		std::vector<unsigned int> & to_triangles = vertex_triangles[c.to];
+		neighbours.clear();
+		unsigned int kept = 0;
+		for (unsigned int i = 0; i < to_triangles.size(); i++)
+		{
+			unsigned int t = to_triangles[i];
+			if (dead[t]) continue;
+			to_triangles[kept++] = t;
+			for (int k = 0; k < 3; k++) if (triangles[t * 3 + k] != c.to) neighbours.push_back(triangles[t * 3 + k]);
+		}
+		to_triangles.resize(kept);
+		std::sort(neighbours.begin(), neighbours.end());
+		neighbours.erase(std::unique(neighbours.begin(), neighbours.end()), neighbours.end());
+		for (unsigned int i = 0; i < neighbours.size(); i++) push_edge(c.to, neighbours[i]);
+	}
+
+	// Back to real vertices: a corner keeps its own vertex if it didn't move, otherwise takes the
+	// vertex at its new position whose normal is closest to the one it had
+	out.reserve(live * 3);
+	for (unsigned int t = 0; t < triangle_count; t++)
+	{
+		if (dead[t]) continue;
+		for (int k = 0; k < 3; k++)
+		{
+			unsigned int original = indices[t * 3 + k];
+			unsigned int position = triangles[t * 3 + k];
+			if (remap[original] == position)
+			{
+				out.push_back(original);
+				continue;
+			}
+
+			const float * n = &normals[original * 3];
+			unsigned int best = position;
+			float best_dot = -2.0f;
+			for (unsigned int w = wedge_start[position]; w < wedge_end[position]; w++)
+			{
+				const float * m = &normals[order[w] * 3];
+				float dot = n[0] * m[0] + n[1] * m[1] + n[2] * m[2];
+				if (dot > best_dot)
+				{
+					best_dot = dot;
+					best = order[w];
+				}
+			}
+			out.push_back(best);
+		}
+	}
+
+	return (float)sqrt(worst);
+}
+
+void MeshSimplifier::build_lods(const std::vector<float> & vertices, const std::vector<float> & normals,
+	std::vector<unsigned int> & indices, std::vector<MeshLod> & lods)
+{
+	PROFILE_ZONE("MeshSimplifier::build_lods");
+	lods.clear();
+	MeshLod full = { 0, (unsigned int)indices.size(), 0.0f };
+	lods.push_back(full);
+
+	// Each level starts from the one before it, errors add up along the way
+	std::vector<unsigned int> current(indices), next;
+	float error = 0.0f;
+	for (int level = 1; level < MESH_LOD_LEVELS; level++)
+	{
+		unsigned int target = (unsigned int)(current.size() / 3 * MESH_LOD_RATIO) * 3;
+		error += simplify(vertices, normals, current, target, next);
+		if (next.empty() || next.size() > current.size() * 9 / 10) break;	// Nothing left that can collapse safely
+
+		MeshOptimizer::optimize_vertex_cache(next, (unsigned int)(vertices.size() / 3));
+		MeshLod lod = { (unsigned int)indices.size(), (unsigned int)next.size(), error };
+		lods.push_back(lod);
+		indices.insert(indices.end(), next.begin(), next.end());
+		current.swap(next);
+	}
+}
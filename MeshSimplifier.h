@@ -0,0 +1,35 @@
+#pragma once
+#ifndef _MESHSIMPLIFIER_H_
+#define _MESHSIMPLIFIER_H_
+
+#include <vector>
+
+#define MESH_LOD_LEVELS 4		// Full detail plus up to three simplified levels
+#define MESH_LOD_RATIO 0.5f		// Each level keeps about this fraction of the previous level's triangles
+#define LOD_PIXEL_ERROR 0.5f	// Draw the coarsest level whose error projects to at most this many pixels. The
+								// quadric error is an average, the worst vertex moves 2-3x further than it says.
+#define LOD_REFLECTION_BIAS 4.0f	// Reflection/refraction textures are distorted anyway, accept 4x the error there
+
+// One level of detail: a range of the mesh's index buffer. Every level indexes the same vertices.
+struct MeshLod
+{
+	unsigned int offset;	// First index
+	unsigned int count;		// Number of indices
+	float error;			// How far the surface may have moved from full detail, in model units
+};
+
+// Quadric error edge collapse (Garland & Heckbert) over the flat xyz arrays OBJObject uploads.
+// Collapses only ever move a vertex onto one of its neighbours, so simplified levels reuse the
+// original vertex buffer and only need their own indices.
+class MeshSimplifier
+{
+public:
+	// Collapses edges until about target_index_count indices are left. Returns the error of the result.
+	static float simplify(const std::vector<float> & vertices, const std::vector<float> & normals,
+		const std::vector<unsigned int> & indices, unsigned int target_index_count, std::vector<unsigned int> & out);
+	// Appends the simplified levels to indices (LOD 0 stays first) and describes every level in lods
+	static void build_lods(const std::vector<float> & vertices, const std::vector<float> & normals,
+		std::vector<unsigned int> & indices, std::vector<MeshLod> & lods);
+};
+
+#endif
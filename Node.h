@@ -17,7 +17,7 @@ class Node
 {
 public:
 	virtual void draw(glm::mat4 C) = 0;
-	virtual void update() = 0;
+	virtual void update(float dt) = 0;	// dt: seconds since the last update
 };
 
 #endif
\ No newline at end of file
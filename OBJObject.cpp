@@ -1,6 +1,12 @@
 #include "OBJObject.h"
 #include "Window.h"
+#include "AssetLoader.h"
+#include "ResourceCache.h"
+#include "MeshOptimizer.h"
+#include "MeshSimplifier.h"
+#include "ObjParser.h"
 #include <vector>
+#include <string>
 
 OBJObject::OBJObject(const char *filepath)
 {
@@ -11,13 +17,12 @@ OBJObject::OBJObject(const char *filepath)
 	this->yOffset = 0.0f;
 	this->zOffset = 0.0f;
 	this->rotateDir = ' ';
-	parse(filepath);
 	this->angle = 0.0f;
 	this->scale = 1.0f;
 	this->x = 0.0f;
 	this->y = 0.0f;
 	this->z = 0.0f;
-	init();
+	load(filepath);
 }
 
 OBJObject::OBJObject(const char *filepath, float scale, float xOffset, float yOffset, float zOffset, char rotateDir)
@@ -30,113 +35,114 @@ OBJObject::OBJObject(const char *filepath, float scale, float xOffset, float yOf
 	this->rotateDir = rotateDir;
 	toWorld = glm::translate(glm::mat4(1.0f), glm::vec3(xOffset, yOffset, zOffset)) * toWorld;
 	origPos = toWorld;
-	parse(filepath);
 	this->angle = 0.0f;
 	this->scale = scale;
 	this->x = xOffset;
 	this->y = yOffset;
 	this->z = zOffset;
-	init();
+	load(filepath);
+}
+
+// Parse on a loader thread, then create the GL buffers back on the main thread.
+// Moving/rotating/scaling only touches toWorld, so it is safe to do while the parse runs.
+void OBJObject::load(const char *filepath)
+{
+	ready = false;
+	boundsMin = glm::vec3(0.0f);
+	boundsMax = glm::vec3(0.0f);
+	radius = 0.0f;
+
+	// Objects loading the same file share one mesh. The first one parses it, the rest pick it up in draw.
+	bool created;
+	VAO = ResourceCache::acquire(RESOURCE_MESH, std::string("mesh:") + filepath, []() { GLuint id; glGenVertexArrays(1, &id); return id; }, &created);
+	if (!created) return;
+	ResourceCache::begin_loading(RESOURCE_MESH, VAO, 1);
+
+	std::string path = filepath;
+	AssetLoader::load([this, path]() { parse(path.c_str()); }, [this]() {
+		init();
+		ResourceCache::end_loading(RESOURCE_MESH, VAO);
+	});
 }
 
 OBJObject::~OBJObject()
 {
-	// Delete previously generated buffers. Note that forgetting to do this can waste GPU memory in a 
-	// large project! This could crash the graphics driver due to memory leaks, or slow down application performance!
-	glDeleteVertexArrays(1, &VAO);
-	glDeleteBuffers(2, &VBO[0]);
-	glDeleteBuffers(1, &EBO);
+	// The VAO and its buffers are deleted once the last object using the mesh lets go of it
+	ResourceCache::release(RESOURCE_MESH, VAO);
+}
+
+// Radius of the bounding sphere once origPos has scaled the longest side to 10
+static float bounding_radius(glm::vec3 min, glm::vec3 max)
+{
+	glm::vec3 size = max - min;
+	float maxDist = glm::max(size.x, glm::max(size.y, size.z));
+	return maxDist > 0.0f ? 0.5f * glm::length(size) * 10.0f / maxDist : 0.0f;
 }
 
 void OBJObject::parse(const char *filepath)
 {
-	float xMax = LONG_MIN;
-	float xMin = LONG_MAX;
-	float yMax = LONG_MIN;
-	float yMin = LONG_MAX;
-	float zMax = LONG_MIN;
-	float zMin = LONG_MAX;
-	std::vector<glm::vec3> rawVertices;
-	std::vector<glm::vec3> rawNormals;
-	std::vector<std::pair<unsigned int, unsigned int>> rawIndices;
-	// Populate the face indices, vertices, and normals vectors with the OBJ Object data
-	FILE* objFile = fopen(filepath, "rb");
-	if (objFile == NULL)
-	{
-		exit(-1);
-	}
-	while (!feof(objFile))
-	{
-		char c1 = fgetc(objFile);
-		if (c1 != 'v' && c1 != 'f') continue;
-		if (c1 == 'v')
-		{
-			char c2 = fgetc(objFile);
-			if (c2 == 'n')
-			{
-				GLfloat x, y, z;
-				//Vertex normals (vn) have x, y, z coordinates
-				fscanf(objFile, "%f %f %f", &x, &y, &z);
-				rawNormals.push_back(glm::vec3(x, y, z));
-			}
-			else if (c2 == ' ')
-			{
-				GLfloat x, y, z;
-				//Vertices (v) have x, y, z coordinates
-				fscanf(objFile, "%f %f %f", &x, &y, &z);
-				rawVertices.push_back(glm::vec3(x, y, z));
-				if (x > xMax) xMax = x;
-				if (x < xMin) xMin = x;
-				if (y > yMax) yMax = y;
-				if (y < yMin) yMin = y;
-				if (z > zMax) zMax = z;
-				if (z < zMin) zMin = z;
-			}
-		}
-		else if (c1 == 'f')
-		{
-			if (fgetc(objFile) != ' ') continue;
-			unsigned int v1, v2, v3, vn1, vn2, vn3, vt1, vt2, vt3;
-			fscanf(objFile, "%u/%u/%u %u/%u/%u %u/%u/%u", &v1, &vt1, &vn1, &v2, &vt2, &vn2, &v3, &vt3, &vn3);
-			v1 -= 1;
-			v2 -= 1;
-			v3 -= 1;
-			vn1 -= 1;
-			vn2 -= 1;
-			vn3 -= 1;
-			rawIndices.push_back(std::pair<unsigned int, unsigned int>(v1, vn1));
-			rawIndices.push_back(std::pair<unsigned int, unsigned int>(v2, vn2));
-			rawIndices.push_back(std::pair<unsigned int, unsigned int>(v3, vn3));
-		}
-		else
-		{
-		}
-	}
-	fclose(objFile);
-	for (unsigned int i = 0; i < rawIndices.size(); i++)
+	PROFILE_ZONE("OBJObject::parse");
+
+	// A cache from an earlier launch is already welded and optimised, init uploads straight out of the mapping
+	if (MeshCache::load(filepath, cacheFile, cacheView))
 	{
-		indices.push_back(i);
-		vertices.push_back(rawVertices[rawIndices[i].first].x);
-		vertices.push_back(rawVertices[rawIndices[i].first].y);
-		vertices.push_back(rawVertices[rawIndices[i].first].z);
-		normals.push_back(rawNormals[rawIndices[i].second].x);
-		normals.push_back(rawNormals[rawIndices[i].second].y);
-		normals.push_back(rawNormals[rawIndices[i].second].z);
+		origPos = cacheView.transform;
+		lods.assign(cacheView.lods, cacheView.lods + cacheView.lod_count);
+		boundsMin = cacheView.min;
+		boundsMax = cacheView.max;
+		radius = bounding_radius(boundsMin, boundsMax);
+		return;
 	}
-	float xDist = xMax - xMin;
-	float yDist = yMax - yMin;
-	float zDist = zMax - zMin;
-	float xCenter = xMin + (xDist / 2.0f);
-	float yCenter = yMin + (yDist / 2.0f);
-	float zCenter = zMin + (zDist / 2.0f);
+
+	ObjMesh mesh;
+	if (!ObjParser::parse(filepath, mesh)) return;	// Nothing to draw, init leaves the mesh empty
+
+	// Weld identical corners into shared vertices, then order triangles for the post-transform
+	// cache and vertices for fetch locality
+	MeshOptimizer::weld(mesh.positions, mesh.normals, vertices, normals, indices);
+	unsigned int vertexCount = (unsigned int)(vertices.size() / 3);
+	float weldedACMR = MeshOptimizer::acmr(indices, vertexCount);
+	MeshOptimizer::optimize_vertex_cache(indices, vertexCount);
+	MeshOptimizer::optimize_vertex_fetch(indices, vertices, normals);
+	printf("%s: %u corners -> %u vertices, ACMR %.2f -> %.2f\n", filepath, (unsigned int)mesh.positions.size(),
+		(unsigned int)(vertices.size() / 3), weldedACMR, MeshOptimizer::acmr(indices, (unsigned int)(vertices.size() / 3)));
+	float xDist = mesh.max.x - mesh.min.x;
+	float yDist = mesh.max.y - mesh.min.y;
+	float zDist = mesh.max.z - mesh.min.z;
+	float xCenter = mesh.min.x + (xDist / 2.0f);
+	float yCenter = mesh.min.y + (yDist / 2.0f);
+	float zCenter = mesh.min.z + (zDist / 2.0f);
 	float maxDist = glm::max(xDist, glm::max(yDist, zDist));
 	origPos = glm::scale(glm::mat4(1.0f), glm::vec3(10.0f / maxDist, 10.0f / maxDist, 10.0f / maxDist)) * glm::translate(glm::mat4(1.0f), glm::vec3(-xCenter, -yCenter, -zCenter));
+	boundsMin = mesh.min;
+	boundsMax = mesh.max;
+	radius = bounding_radius(boundsMin, boundsMax);
+
+	// Simplified levels go on the end of the index buffer. Errors are kept in the normalised
+	// units origPos scales to, so draw only has to account for toWorld.
+	MeshSimplifier::build_lods(vertices, normals, indices, lods);
+	for (unsigned int i = 0; i < lods.size(); i++)
+	{
+		lods[i].error *= 10.0f / maxDist;
+		printf("%s: LOD %u has %u triangles, error %.4f\n", filepath, i, lods[i].count / 3, lods[i].error);
+	}
+
+	// Next launch can skip all of the above
+	if (!indices.empty()) MeshCache::write(filepath, vertices, normals, indices, lods, mesh.min, mesh.max, origPos);
 }
 
 void OBJObject::init()
 {
-	// Create array object and buffers. Remember to delete your buffers when the object is destroyed!
-	glGenVertexArrays(1, &VAO);
+	// Upload straight from the mapped cache file if parse found one, otherwise from what it built
+	bool cached = cacheFile.data() != NULL;
+	size_t vertexFloats = cached ? cacheView.vertex_count * 3 : vertices.size();
+	size_t indexCount = cached ? cacheView.index_count : indices.size();
+	if (indexCount == 0) return;	// File was missing or had no faces, the shared mesh stays empty
+	const float * vertexData = cached ? cacheView.vertices : &vertices[0];
+	const float * normalData = cached ? cacheView.normals : &normals[0];
+	const unsigned int * indexData = cached ? cacheView.indices : &indices[0];
+
+	// Create buffers, the VAO comes from the resource cache. Remember to delete your buffers when the object is destroyed!
 	glGenBuffers(2, &VBO[0]);
 	glGenBuffers(1, &EBO);
 
@@ -149,7 +155,7 @@ void OBJObject::init()
 	glBindBuffer(GL_ARRAY_BUFFER, VBO[0]);
 	// glBufferData populates the most recently bound buffer with data starting at the 3rd argument and ending after
 	// the 2nd argument number of indices. How does OpenGL know how long an index spans? Go to glVertexAttribPointer.
-	glBufferData(GL_ARRAY_BUFFER, vertices.size()*sizeof(GLfloat), &(vertices[0]), GL_STATIC_DRAW);
+	glBufferData(GL_ARRAY_BUFFER, vertexFloats * sizeof(GLfloat), vertexData, GL_STATIC_DRAW);
 	// Enable the usage of layout location 0 (check the vertex shader to see what this is)
 	glEnableVertexAttribArray(0);
 	// 1: x should be the same as the number passed into the line "layout (location = x)" in the vertex shader. In this case, it's 0. Valid values are 0 to GL_MAX_UNIFORM_LOCATIONS.
@@ -163,26 +169,50 @@ void OBJObject::init()
 	// We've sent the vertex data over to OpenGL, but there's still something missing.
 	// In what order should it draw those vertices? That's why we'll need a GL_ELEMENT_ARRAY_BUFFER for this.
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size()*sizeof(int), &(indices[0]), GL_STATIC_DRAW);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexCount * sizeof(unsigned int), indexData, GL_STATIC_DRAW);
 
 	// Unbind the currently bound buffer so that we don't accidentally make unwanted changes to it.
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
 
 	glBindBuffer(GL_ARRAY_BUFFER, VBO[1]);
-	glBufferData(GL_ARRAY_BUFFER, normals.size() * sizeof(GLfloat), &(normals[0]), GL_STATIC_DRAW);
+	glBufferData(GL_ARRAY_BUFFER, vertexFloats * sizeof(GLfloat), normalData, GL_STATIC_DRAW);
 	glEnableVertexAttribArray(1);
 	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), (GLvoid*)0);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(int), &(indices[0]), GL_STATIC_DRAW);
 
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
 	// Unbind the VAO now so we don't accidentally tamper with it.
 	// NOTE: You must NEVER unbind the element array buffer associated with a VAO!
 	glBindVertexArray(0);
+
+	// Hand the buffers to the cache so they live as long as the shared mesh
+	std::vector<GLuint> buffers;
+	buffers.push_back(VBO[0]);
+	buffers.push_back(VBO[1]);
+	buffers.push_back(EBO);
+	MeshBounds bounds = { origPos, boundsMin, boundsMax, radius };
+	ResourceCache::attach_buffers(VAO, buffers, lods, bounds);
+	ResourceCache::add_size(RESOURCE_MESH, VAO, vertexFloats * 2 * sizeof(GLfloat) + indexCount * sizeof(unsigned int));
+
+	// The GPU has its copy now
+	cacheFile.close();
 }
 
-void OBJObject::draw(GLuint shaderProgram, glm::vec3 objColor, glm::vec3 lightColor, glm::vec3 lightDir, glm::vec3 camPos, glm::vec4 materialParams, bool toon)
+void OBJObject::draw(GLuint shaderProgram, glm::vec3 objColor, glm::vec3 lightColor, glm::vec3 lightDir, glm::vec3 camPos, glm::vec4 materialParams)
 {
+	if (!ready)
+	{
+		if (!ResourceCache::is_loaded(RESOURCE_MESH, VAO)) return;	// Still loading
+		// Objects that didn't parse the mesh themselves get its placement and size from the cache too
+		const MeshBounds & bounds = ResourceCache::bounds(VAO);
+		lods = ResourceCache::lods(VAO);
+		origPos = bounds.transform;
+		boundsMin = bounds.min;
+		boundsMax = bounds.max;
+		radius = bounds.radius;
+		ready = true;
+	}
+	if (lods.empty()) return;	// Mesh failed to load
+
 	//Material Params: ambient, diffuse, specular, shininess
 	// Calculate the combination of the model and view (camera inverse) matrices
 	glm::mat4 model = toWorld * origPos;
@@ -205,10 +235,6 @@ void OBJObject::draw(GLuint shaderProgram, glm::vec3 objColor, glm::vec3 lightCo
 	uSpec = glGetUniformLocation(shaderProgram, "specularModifier");
 	uShine = glGetUniformLocation(shaderProgram, "shininess");
 
-	uMode = glGetUniformLocation(shaderProgram, "mode");
-
-	uToon = glGetUniformLocation(shaderProgram, "toon");
-
 	// Now send these values to the shader program
 	glUniformMatrix4fv(uProjection, 1, GL_FALSE, &Window::P[0][0]);
 	glUniformMatrix4fv(uModel, 1, GL_FALSE, &model[0][0]);
@@ -222,8 +248,6 @@ void OBJObject::draw(GLuint shaderProgram, glm::vec3 objColor, glm::vec3 lightCo
 	glUniform1fv(uDif, 1, &materialParams.y);
 	glUniform1fv(uSpec, 1, &materialParams.z);
 	glUniform1fv(uShine, 1, &materialParams.w);
-	glUniform1i(uMode, 0);
-	glUniform1i(uToon, toon);
 
 	// Send clipping plane to relevant shaders
 	glUniform4f(glGetUniformLocation(shaderProgram, "plane"), 0.0, Window::plane_vec_dir, 0.0, Window::water_level);
@@ -231,11 +255,39 @@ void OBJObject::draw(GLuint shaderProgram, glm::vec3 objColor, glm::vec3 lightCo
 	// Now draw the object. We simply need to bind the VAO associated with it.
 	glBindVertexArray(VAO);
 	// Tell OpenGL to draw with triangles, using the number of indices, the type of the indices, and the offset to start from
-	glDrawElements(GL_TRIANGLES, indices.size()*sizeof(int), GL_UNSIGNED_INT, 0);
+	const MeshLod & lod = lods[select_lod()];
+	glDrawElements(GL_TRIANGLES, (GLsizei)lod.count, GL_UNSIGNED_INT, (GLvoid*)(lod.offset * sizeof(GLuint)));
 	// Unbind the VAO when we're done so we don't accidentally draw extra stuff or tamper with its bound buffers
 	glBindVertexArray(0);
 }
 
+// Bounding sphere radius after toWorld's scale, the largest axis so it always contains the model
+float OBJObject::world_radius() const
+{
+	float scale = glm::max(glm::length(glm::vec3(toWorld[0])), glm::max(glm::length(glm::vec3(toWorld[1])), glm::length(glm::vec3(toWorld[2]))));
+	return radius * scale;
+}
+
+// Coarsest level whose error still projects to under LOD_PIXEL_ERROR pixels (times the pass's bias)
+int OBJObject::select_lod()
+{
+	if (!Window::lod_enabled) return 0;
+
+	// toWorld may scale the model, take the largest axis so the error is never underestimated
+	float scale = glm::max(glm::length(glm::vec3(toWorld[0])), glm::max(glm::length(glm::vec3(toWorld[1])), glm::length(glm::vec3(toWorld[2]))));
+	float distance = glm::length(glm::vec3(toWorld[3]) - Window::cam_pos) - radius * scale;
+	distance = glm::max(distance, 0.1f);	// Camera inside the bounds, use the near plane
+
+	// P[1][1] is cot(fov / 2), so this is how many pixels one world unit covers at that distance
+	float pixels = Window::P[1][1] * DynamicResolution::render_height() * 0.5f / distance;
+	float allowed = LOD_PIXEL_ERROR * Window::lod_bias;
+	for (int i = (int)lods.size() - 1; i > 0; i--)
+	{
+		if (lods[i].error * scale * pixels <= allowed) return i;
+	}
+	return 0;
+}
+
 void OBJObject::update()
 {
 }
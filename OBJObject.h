@@ -14,6 +14,8 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <vector>
 
+#include "MeshCache.h"
+
 class OBJObject
 {
 private:
@@ -34,6 +36,15 @@ private:
 	float y;
 	float z;
 	char rotateDir;
+	bool ready;		// Shared mesh has loaded and lods, origPos and the bounds are set
+	std::vector<MeshLod> lods;	// Index ranges from full detail down, filled by parse or copied from the shared mesh
+	glm::vec3 boundsMin, boundsMax;	// Model space, before origPos
+	float radius;	// Bounding sphere around the centred, normalised model
+	VFSFile cacheFile;		// Binary mesh cache, mapped from parse until init has uploaded it
+	MeshCacheView cacheView;
+
+	void load(const char* filepath);
+	int select_lod();
 
 public:
 	OBJObject(const char* filepath);
@@ -42,7 +53,7 @@ public:
 
 	void parse(const char* filepath);
 	void init();
-	void draw(GLuint, glm::vec3 objColor, glm::vec3 lightColor, glm::vec3 lightDir, glm::vec3 camPos, glm::vec4 materialParams, bool toon);
+	void draw(GLuint, glm::vec3 objColor, glm::vec3 lightColor, glm::vec3 lightDir, glm::vec3 camPos, glm::vec4 materialParams);
 	void update();
 	void move(float x, float y, float z);
 	void resize(float amt);
@@ -53,10 +64,13 @@ public:
 	void resetScale();
 
 	glm::vec3 getPosition();
+	glm::vec3 center() const { return glm::vec3(toWorld[3]); }	// Of the bounding sphere, in world space
+	float world_radius() const;
+	bool isReady() { return ready; }
 
 	// These variables are needed for the shader program
 	GLuint VBO[2], VAO, EBO;
-	GLuint uProjection, uModel, uView, uObjColor, uLightColor, uLightDir, uCamPos, uAmb, uDif, uSpec, uShine, uMode, uModelView, uToon;
+	GLuint uProjection, uModel, uView, uObjColor, uLightColor, uLightDir, uCamPos, uAmb, uDif, uSpec, uShine, uModelView;
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,474 @@
+#include "ObjParser.h"
+#include "VFS.h"
+#include "Profiler.h"
+#include "ThreadPool.h"
+
+#include <limits.h>
+#include <float.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include <condition_variable>
+#include <iostream>
+#include <mutex>
+
+#include <glm/glm.hpp>
+
+#define CORNER_V_RELATIVE 1		// Index was negative, counts back from the end of this chunk's vertices
+#define CORNER_VN_RELATIVE 2
+#define CORNER_NO_NORMAL 4
+
+// Face corner as read from one chunk. Negative OBJ indices can only be resolved once we know how many
+// vertices the chunks before this one defined.
+struct ChunkCorner
+{
+	int v;
+	int vn;
+	int flags;
+};
+
+struct ObjChunk
+{
+	const char * begin;
+	const char * end;
+	std::vector<glm::vec3> positions;
+	std::vector<glm::vec3> normals;
+	std::vector<ChunkCorner> corners;	// Already triangulated, three per triangle
+	glm::vec3 min;
+	glm::vec3 max;
+};
+
+static const double powers_of_ten[] = {
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+static inline const char * skip_space(const char * p, const char * end)
+{
+	while (p < end && (*p == ' ' || *p == '\t' || *p == '\r')) p++;
+	return p;
+}
+
+static inline bool is_digit(char c)
+{
+	return c >= '0' && c <= '9';
+}
+
+// Hand rolled replacement for std::from_chars (not in our compiler): sign, digits, fraction, exponent.
+// Exact for the short decimals exporters write, within an ulp or so otherwise.
+static bool parse_float(const char *& p, const char * end, float & out)
+{
+	p = skip_space(p, end);
+	bool negative = false;
+	if (p < end && (*p == '-' || *p == '+'))
+	{
+		negative = *p == '-';
+		p++;
+	}
+
+	unsigned long long mantissa = 0;
+	int digits = 0;
+	int exponent = 0;
+	bool any = false;
+	for (; p < end && is_digit(*p); p++)
+	{
+		any = true;
+		if (digits < 19)
+		{
+			mantissa = mantissa * 10 + (*p - '0');
+			if (mantissa) digits++;
+		}
+		else exponent++;	// Past what fits, just track the magnitude
+	}
+	if (p < end && *p == '.')
+	{
+		for (p++; p < end && is_digit(*p); p++)
+		{
+			any = true;
+			if (digits < 19)
+			{
+				mantissa = mantissa * 10 + (*p - '0');
+				if (mantissa) digits++;
+				exponent--;
+			}
+		}
+	}
+	if (!any) return false;
+
+	if (p < end && (*p == 'e' || *p == 'E'))
+	{
+		const char * q = p + 1;
+		bool exp_negative = false;
+		if (q < end && (*q == '-' || *q == '+'))
+		{
+			exp_negative = *q == '-';
+			q++;
+		}
+		if (q < end && is_digit(*q))
+		{
+			int e = 0;
+			for (; q < end && is_digit(*q); q++)
+				if (e < 10000) e = e * 10 + (*q - '0');
+			exponent += exp_negative ? -e : e;
+			p = q;
+		}
+	}
+
+	double value = (double)mantissa;
+	if (exponent < 0) value = exponent >= -22 ? value / powers_of_ten[-exponent] : value * pow(10.0, exponent);
+	else if (exponent > 0) value = exponent <= 22 ? value * powers_of_ten[exponent] : value * pow(10.0, exponent);
+	out = (float)(negative ? -value : value);
+	return true;
+}
+
+static bool parse_int(const char *& p, const char * end, int & out)
+{
+	bool negative = false;
+	if (p < end && (*p == '-' || *p == '+'))
+	{
+		negative = *p == '-';
+		p++;
+	}
+	if (p >= end || !is_digit(*p)) return false;
+	long long value = 0;
+	for (; p < end && is_digit(*p); p++)
+		if (value < INT_MAX) value = value * 10 + (*p - '0');
+	out = (int)(negative ? -value : value);
+	return true;
+}
+
+// Workers for the chunks. Separate from the asset loader's pool since parse() already runs on one of those.
+static ThreadPool & chunk_pool()
+{
+	static ThreadPool pool(ThreadPool::default_threads(), "obj parser");
+	return pool;
+}
+
+static void parse_chunk(ObjChunk & chunk)
+{
+	PROFILE_ZONE("ObjParser::parse_chunk");
+	chunk.min = glm::vec3(FLT_MAX);
+	chunk.max = glm::vec3(-FLT_MAX);
+	std::vector<ChunkCorner> polygon;
+
+	const char * p = chunk.begin;
+	const char * end = chunk.end;
+	while (p < end)
+	{
+		const char * line_end = (const char *)memchr(p, '\n', end - p);
+		if (line_end == NULL) line_end = end;
+		p = skip_space(p, line_end);
+
+		if (line_end - p >= 2 && p[0] == 'v' && (p[1] == ' ' || p[1] == '\t'))
+		{
+			glm::vec3 v(0.0f);
+			p += 2;
+			parse_float(p, line_end, v.x);
+			parse_float(p, line_end, v.y);
+			parse_float(p, line_end, v.z);
+			chunk.positions.push_back(v);
+			chunk.min = glm::min(chunk.min, v);
+			chunk.max = glm::max(chunk.max, v);
+		}
+		else if (line_end - p >= 3 && p[0] == 'v' && p[1] == 'n')
+		{
+			glm::vec3 n(0.0f);
+			p += 2;
+			parse_float(p, line_end, n.x);
+			parse_float(p, line_end, n.y);
+			parse_float(p, line_end, n.z);
+			chunk.normals.push_back(n);
+		}
+		else if (line_end - p >= 2 && p[0] == 'f' && (p[1] == ' ' || p[1] == '\t'))
+		{
+			p += 2;
+			polygon.clear();
+			while (true)
+			{
+				p = skip_space(p, line_end);
+				ChunkCorner corner;
+				corner.vn = 0;
+				corner.flags = CORNER_NO_NORMAL;
+				if (!parse_int(p, line_end, corner.v) || corner.v == 0) break;
+				if (p < line_end && *p == '/')
+				{
+					p++;
+					int vt;
+					parse_int(p, line_end, vt);	// Texture coordinates aren't used, v//vn leaves this empty
+					if (p < line_end && *p == '/')
+					{
+						p++;
+						if (parse_int(p, line_end, corner.vn) && corner.vn != 0) corner.flags = 0;
+					}
+				}
+
+				// Positive indices are 1 based and absolute, negative ones count back from the latest vertex
+				if (corner.v > 0) corner.v -= 1;
+				else
+				{
+					corner.v += (int)chunk.positions.size();
+					corner.flags |= CORNER_V_RELATIVE;
+				}
+				if (!(corner.flags & CORNER_NO_NORMAL))
+				{
+					if (corner.vn > 0) corner.vn -= 1;
+					else
+					{
+						corner.vn += (int)chunk.normals.size();
+						corner.flags |= CORNER_VN_RELATIVE;
+					}
+				}
+				polygon.push_back(corner);
+
+				// Skip anything left of a malformed token so the loop always advances
+				while (p < line_end && *p != ' ' && *p != '\t' && *p != '\r') p++;
+			}
+
+			// Fan triangulation, fine for the convex polygons modelling tools export
+			for (unsigned int k = 1; k + 1 < polygon.size(); k++)
+			{
+				chunk.corners.push_back(polygon[0]);
+				chunk.corners.push_back(polygon[k]);
+				chunk.corners.push_back(polygon[k + 1]);
+			}
+		}
+		p = line_end + 1;
+	}
+}
+
+bool ObjParser::parse(const char * path, ObjMesh & mesh)
+{
+	PROFILE_ZONE("ObjParser::parse");
+	VFSFile file;
+	if (!VFS::open(path, file))
+	{
+		std::cerr << "could not open obj file " << path << std::endl;
+		return false;
+	}
+	mesh.file_bytes = file.size();
+
+	// Cut the file into roughly equal chunks, each ending just after a newline
+	size_t size = file.size();
+	size_t threads = chunk_pool().size() + 1;
+	size_t chunk_count = size / OBJ_MIN_CHUNK_BYTES;
+	if (chunk_count > threads) chunk_count = threads;
+	if (chunk_count < 1) chunk_count = 1;
+
+	std::vector<ObjChunk> chunks(chunk_count);
+	const char * begin = file.data();
+	const char * end = file.data() + size;
+	const char * cursor = begin;
+	for (size_t i = 0; i < chunk_count; i++)
+	{
+		const char * split = i + 1 == chunk_count ? end : begin + size * (i + 1) / chunk_count;
+		if (split < cursor) split = cursor;
+		if (split < end)
+		{
+			const char * newline = (const char *)memchr(split, '\n', end - split);
+			split = newline ? newline + 1 : end;
+		}
+		chunks[i].begin = cursor;
+		chunks[i].end = split;
+		cursor = split;
+	}
+
+	// Hand every chunk but the first to the pool, the calling thread takes the first
+	std::mutex lock;
+	std::condition_variable finished;
+	size_t remaining = chunk_count - 1;
+	for (size_t i = 1; i < chunk_count; i++)
+	{
+		chunk_pool().enqueue([&chunks, &lock, &finished, &remaining, i]() {
+			parse_chunk(chunks[i]);
+			std::lock_guard<std::mutex> guard(lock);
+			if (--remaining == 0) finished.notify_one();
+		});
+	}
+	if (size > 0) parse_chunk(chunks[0]);
+	{
+		std::unique_lock<std::mutex> guard(lock);
+		finished.wait(guard, [&remaining]() { return remaining == 0; });
+	}
+
+	// Stitch the chunks together: offset each chunk's relative indices by what came before it
+	PROFILE_ZONE("ObjParser::merge");
+	std::vector<glm::vec3> positions, normals;
+	size_t corner_total = 0;
+	mesh.min = glm::vec3(FLT_MAX);
+	mesh.max = glm::vec3(-FLT_MAX);
+	for (size_t i = 0; i < chunk_count; i++)
+	{
+		positions.insert(positions.end(), chunks[i].positions.begin(), chunks[i].positions.end());
+		normals.insert(normals.end(), chunks[i].normals.begin(), chunks[i].normals.end());
+		corner_total += chunks[i].corners.size();
+		if (!chunks[i].positions.empty())
+		{
+			mesh.min = glm::min(mesh.min, chunks[i].min);
+			mesh.max = glm::max(mesh.max, chunks[i].max);
+		}
+	}
+
+	mesh.positions.clear();
+	mesh.normals.clear();
+	mesh.positions.reserve(corner_total);
+	mesh.normals.reserve(corner_total);
+	int v_base = 0, vn_base = 0;
+	unsigned int skipped = 0;
+	for (size_t i = 0; i < chunk_count; i++)
+	{
+		const std::vector<ChunkCorner> & corners = chunks[i].corners;
+		for (size_t c = 0; c + 2 < corners.size(); c += 3)
+		{
+			int v[3], vn[3];
+			bool valid = true, has_normals = true;
+			for (int k = 0; k < 3; k++)
+			{
+				const ChunkCorner & corner = corners[c + k];
+				v[k] = corner.v + ((corner.flags & CORNER_V_RELATIVE) ? v_base : 0);
+				vn[k] = corner.vn + ((corner.flags & CORNER_VN_RELATIVE) ? vn_base : 0);
+				if (v[k] < 0 || v[k] >= (int)positions.size()) valid = false;
+				if ((corner.flags & CORNER_NO_NORMAL) || vn[k] < 0 || vn[k] >= (int)normals.size()) has_normals = false;
+			}
+			if (!valid)
+			{
+				skipped++;
+				continue;
+			}
+
+			glm::vec3 face_normal(0.0f, 1.0f, 0.0f);
+			if (!has_normals)
+			{
+				glm::vec3 n = glm::cross(positions[v[1]] - positions[v[0]], positions[v[2]] - positions[v[0]]);
+				float length = glm::length(n);
+				if (length > 0.0f) face_normal = n / length;
+			}
+			for (int k = 0; k < 3; k++)
+			{
+				mesh.positions.push_back(positions[v[k]]);
+				mesh.normals.push_back(has_normals ? normals[vn[k]] : face_normal);
+			}
+		}
+		v_base += (int)chunks[i].positions.size();
+		vn_base += (int)chunks[i].normals.size();
+	}
+
+	if (skipped) std::cerr << path << ": skipped " << skipped << " triangles with out of range indices" << std::endl;
+	return true;
+}
+
+bool ObjParser::parse_legacy(const char * path, ObjMesh & mesh)
+{
+	float xMax = LONG_MIN;
+	float xMin = LONG_MAX;
+	float yMax = LONG_MIN;
+	float yMin = LONG_MAX;
+	float zMax = LONG_MIN;
+	float zMin = LONG_MAX;
+	std::vector<glm::vec3> rawVertices;
+	std::vector<glm::vec3> rawNormals;
+	std::vector<std::pair<unsigned int, unsigned int>> rawIndices;
+	// Populate the face indices, vertices, and normals vectors with the OBJ Object data
+	FILE* objFile = fopen(path, "rb");
+	if (objFile == NULL)
+	{
+		return false;
+	}
+	while (!feof(objFile))
+	{
+		char c1 = fgetc(objFile);
+		if (c1 != 'v' && c1 != 'f') continue;
+		if (c1 == 'v')
+		{
+			char c2 = fgetc(objFile);
+			if (c2 == 'n')
+			{
+				float x, y, z;
+				//Vertex normals (vn) have x, y, z coordinates
+				fscanf(objFile, "%f %f %f", &x, &y, &z);
+				rawNormals.push_back(glm::vec3(x, y, z));
+			}
+			else if (c2 == ' ')
+			{
+				float x, y, z;
+				//Vertices (v) have x, y, z coordinates
+				fscanf(objFile, "%f %f %f", &x, &y, &z);
+				rawVertices.push_back(glm::vec3(x, y, z));
+				if (x > xMax) xMax = x;
+				if (x < xMin) xMin = x;
+				if (y > yMax) yMax = y;
+				if (y < yMin) yMin = y;
+				if (z > zMax) zMax = z;
+				if (z < zMin) zMin = z;
+			}
+		}
+		else if (c1 == 'f')
+		{
+			if (fgetc(objFile) != ' ') continue;
+			unsigned int v1, v2, v3, vn1, vn2, vn3, vt1, vt2, vt3;
+			fscanf(objFile, "%u/%u/%u %u/%u/%u %u/%u/%u", &v1, &vt1, &vn1, &v2, &vt2, &vn2, &v3, &vt3, &vn3);
+			rawIndices.push_back(std::pair<unsigned int, unsigned int>(v1 - 1, vn1 - 1));
+			rawIndices.push_back(std::pair<unsigned int, unsigned int>(v2 - 1, vn2 - 1));
+			rawIndices.push_back(std::pair<unsigned int, unsigned int>(v3 - 1, vn3 - 1));
+		}
+	}
+	mesh.file_bytes = ftell(objFile);
+	fclose(objFile);
+
+	mesh.positions.clear();
+	mesh.normals.clear();
+	for (unsigned int i = 0; i + 2 < rawIndices.size(); i += 3)
+	{
+		bool valid = true;
+		for (int k = 0; k < 3; k++)
+			if (rawIndices[i + k].first >= rawVertices.size() || rawIndices[i + k].second >= rawNormals.size()) valid = false;
+		if (!valid) continue;
+		for (int k = 0; k < 3; k++)
+		{
+			mesh.positions.push_back(rawVertices[rawIndices[i + k].first]);
+			mesh.normals.push_back(rawNormals[rawIndices[i + k].second]);
+		}
+	}
+	mesh.min = glm::vec3(xMin, yMin, zMin);
+	mesh.max = glm::vec3(xMax, yMax, zMax);
+	return true;
+}
+
+void ObjParser::benchmark(const std::vector<const char *> & paths)
+{
+	// Best of a few runs each, so the first run's cold file cache doesn't count against either parser
+	const int RUNS = 5;
+	double legacy_total = 0.0, parse_total = 0.0, bytes_total = 0.0;
+	printf("%-40s %10s %12s %12s %8s\n", "model", "MB", "legacy MB/s", "mapped MB/s", "speedup");
+	for (unsigned int i = 0; i < paths.size(); i++)
+	{
+		double best[2] = { DBL_MAX, DBL_MAX };
+		ObjMesh meshes[2];
+		bool ok = true;
+		for (int run = 0; run < RUNS && ok; run++)
+		{
+			for (int which = 0; which < 2; which++)
+			{
+				std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+				ok = ok && (which == 0 ? parse_legacy(paths[i], meshes[0]) : parse(paths[i], meshes[1]));
+				double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+				if (seconds < best[which]) best[which] = seconds;
+			}
+		}
+		if (!ok)
+		{
+			printf("%-40s could not be read\n", paths[i]);
+			continue;
+		}
+		if (meshes[0].positions.size() != meshes[1].positions.size())
+			printf("%s: parsers disagree (%u vs %u corners)\n", paths[i], (unsigned int)meshes[0].positions.size(), (unsigned int)meshes[1].positions.size());
+
+		double mb = meshes[1].file_bytes / (1024.0 * 1024.0);
+		printf("%-40s %10.2f %12.1f %12.1f %7.1fx\n", paths[i], mb, mb / best[0], mb / best[1], best[0] / best[1]);
+		legacy_total += best[0];
+		parse_total += best[1];
+		bytes_total += mb;
+	}
+	if (bytes_total > 0.0)
+		printf("%-40s %10.2f %12.1f %12.1f %7.1fx\n", "total", bytes_total, bytes_total / legacy_total, bytes_total / parse_total, legacy_total / parse_total);
+}
@@ -0,0 +1,36 @@
+#pragma once
+#ifndef _OBJPARSER_H_
+#define _OBJPARSER_H_
+
+// Use of degrees is deprecated. Use radians instead.
+#ifndef GLM_FORCE_RADIANS
+#define GLM_FORCE_RADIANS
+#endif
+#include <glm/vec3.hpp>
+#include <vector>
+
+#define OBJ_MIN_CHUNK_BYTES (128 * 1024)	// Smaller files aren't worth splitting across threads
+
+// Triangle soup from an OBJ file: one position/normal per corner, ready for MeshOptimizer::weld
+struct ObjMesh
+{
+	std::vector<glm::vec3> positions;
+	std::vector<glm::vec3> normals;
+	glm::vec3 min;	// Bounds of every v in the file
+	glm::vec3 max;
+	size_t file_bytes;
+};
+
+// Wavefront OBJ reader. The file is memory mapped (through the VFS) and cut into line aligned chunks that are parsed
+// on their own threads, then stitched back together. Faces can be v, v/vt, v//vn or v/vt/vn with any
+// number of corners (fanned into triangles) and negative (relative) indices. Faces without normals
+// get a flat face normal.
+class ObjParser
+{
+public:
+	static bool parse(const char * path, ObjMesh & mesh);
+	static bool parse_legacy(const char * path, ObjMesh & mesh);	// The old fgetc/fscanf reader, kept for --bench-obj
+	static void benchmark(const std::vector<const char *> & paths);
+};
+
+#endif
@@ -0,0 +1,155 @@
+#include "OcclusionQueries.h"
+#include "Window.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+#include <stdio.h>
+
+bool OcclusionQueries::enabled = true;
+GLuint OcclusionQueries::queries[OCCLUSION_PASSES][OCCLUSION_MAX_OBJECTS];
+bool OcclusionQueries::issued[OCCLUSION_PASSES][OCCLUSION_MAX_OBJECTS];
+OcclusionQueries::Stats OcclusionQueries::stats[OCCLUSION_PASSES];
+OcclusionPass OcclusionQueries::pass = OCCLUSION_MAIN;
+GLuint OcclusionQueries::program = 0;
+GLuint OcclusionQueries::boxVAO = 0;
+GLuint OcclusionQueries::boxVBO = 0;
+GLuint OcclusionQueries::boxEBO = 0;
+
+static const char * pass_names[OCCLUSION_PASSES] = { "reflection", "refraction", "main" };
+
+void OcclusionQueries::init()
+{
+	for (int p = 0; p < OCCLUSION_PASSES; p++)
+	{
+		glGenQueries(OCCLUSION_MAX_OBJECTS, queries[p]);
+		for (int i = 0; i < OCCLUSION_MAX_OBJECTS; i++) issued[p][i] = false;
+		Stats empty = { 0, 0, 0, 0 };
+		stats[p] = empty;
+	}
+
+	// Unit cube from -1 to 1, scaled to each object's bounding sphere
+	GLfloat corners[8 * 3];
+	for (int i = 0; i < 8; i++)
+	{
+		corners[i * 3] = (i & 1) ? 1.0f : -1.0f;
+		corners[i * 3 + 1] = (i & 2) ? 1.0f : -1.0f;
+		corners[i * 3 + 2] = (i & 4) ? 1.0f : -1.0f;
+	}
+	static const GLuint faces[36] = { 0, 2, 1, 1, 2, 3, 4, 5, 6, 5, 7, 6, 0, 1, 4, 1, 5, 4, 2, 6, 3, 3, 6, 7, 0, 4, 2, 2, 4, 6, 1, 3, 5, 3, 7, 5 };
+	glGenVertexArrays(1, &boxVAO);
+	glGenBuffers(1, &boxVBO);
+	glGenBuffers(1, &boxEBO);
+	glBindVertexArray(boxVAO);
+	glBindBuffer(GL_ARRAY_BUFFER, boxVBO);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(corners), corners, GL_STATIC_DRAW);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), (GLvoid*)0);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, boxEBO);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(faces), faces, GL_STATIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	// NOTE: You must NEVER unbind the element array buffer associated with a VAO!
+	glBindVertexArray(0);
+}
+
+void OcclusionQueries::clean_up()
+{
+	for (int p = 0; p < OCCLUSION_PASSES; p++) glDeleteQueries(OCCLUSION_MAX_OBJECTS, queries[p]);
+	glDeleteVertexArrays(1, &boxVAO);
+	glDeleteBuffers(1, &boxVBO);
+	glDeleteBuffers(1, &boxEBO);
+}
+
+void OcclusionQueries::set_pass(OcclusionPass pass)
+{
+	OcclusionQueries::pass = pass;
+}
+
+bool OcclusionQueries::begin_draw(int object)
+{
+	if (!enabled || object >= OCCLUSION_MAX_OBJECTS || !issued[pass][object]) return false;
+	glBeginConditionalRender(queries[pass][object], GL_QUERY_NO_WAIT);
+	return true;
+}
+
+void OcclusionQueries::end_draw(bool conditional)
+{
+	if (conditional) glEndConditionalRender();
+}
+
+void OcclusionQueries::begin_tests(GLuint program)
+{
+	OcclusionQueries::program = program;
+	if (!enabled) return;
+	glUseProgram(program);
+	glUniformMatrix4fv(glGetUniformLocation(program, "projection"), 1, GL_FALSE, &Window::P[0][0]);
+	glUniformMatrix4fv(glGetUniformLocation(program, "view"), 1, GL_FALSE, &Window::V[0][0]);
+	glUniform4f(glGetUniformLocation(program, "plane"), 0.0, Window::plane_vec_dir, 0.0, Window::water_level);
+
+	// Boxes only test against the depth buffer, they must not change it
+	glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+	glDepthMask(GL_FALSE);
+	glDisable(GL_CULL_FACE);
+	glBindVertexArray(boxVAO);
+}
+
+void OcclusionQueries::test(int object, glm::vec3 center, float radius)
+{
+	if (object >= OCCLUSION_MAX_OBJECTS) return;
+	if (!enabled || radius <= 0.0f)	// Off, or the mesh hasn't loaded yet
+	{
+		issued[pass][object] = false;
+		return;
+	}
+
+	// What last frame's query said, which is what this frame's conditional render went by
+	Stats & s = stats[pass];
+	if (issued[pass][object])
+	{
+		GLuint available = 0;
+		glGetQueryObjectuiv(queries[pass][object], GL_QUERY_RESULT_AVAILABLE, &available);
+		if (!available) s.late++;
+		else
+		{
+			GLuint visible = 0;
+			glGetQueryObjectuiv(queries[pass][object], GL_QUERY_RESULT, &visible);
+			if (!visible) s.occluded++;
+		}
+	}
+	s.tests++;
+
+	// Too close and the near plane cuts off the box faces in front of us, so it could wrongly fail
+	if (glm::length(Window::cam_pos - center) < radius * 1.7321f + OCCLUSION_NEAR_MARGIN)
+	{
+		s.near++;
+		issued[pass][object] = false;
+		return;
+	}
+
+	glm::mat4 model = glm::translate(glm::mat4(1.0f), center) * glm::scale(glm::mat4(1.0f), glm::vec3(radius));
+	glm::mat4 modelview = Window::V * model;
+	glUniformMatrix4fv(glGetUniformLocation(program, "model"), 1, GL_FALSE, &model[0][0]);
+	glUniformMatrix4fv(glGetUniformLocation(program, "modelview"), 1, GL_FALSE, &modelview[0][0]);
+	glBeginQuery(GL_ANY_SAMPLES_PASSED, queries[pass][object]);
+	glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
+	glEndQuery(GL_ANY_SAMPLES_PASSED);
+	issued[pass][object] = true;
+}
+
+void OcclusionQueries::end_tests()
+{
+	if (!enabled) return;
+	glBindVertexArray(0);
+	glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+	glDepthMask(GL_TRUE);
+}
+
+void OcclusionQueries::report()
+{
+	printf("Occlusion culling %s\n", enabled ? "on" : "off");
+	for (int p = 0; p < OCCLUSION_PASSES; p++)
+	{
+		const Stats & s = stats[p];
+		if (s.tests == 0) continue;
+		printf("  %-10s %lld tests, %.1f%% occluded, %.1f%% results late, %.1f%% too close to test\n", pass_names[p], s.tests,
+			100.0 * s.occluded / s.tests, 100.0 * s.late / s.tests, 100.0 * s.near / s.tests);
+	}
+}
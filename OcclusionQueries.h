@@ -0,0 +1,70 @@
+#pragma once
+#ifndef _OCCLUSIONQUERIES_H_
+#define _OCCLUSIONQUERIES_H_
+
+#define GLFW_INCLUDE_GLEXT
+#ifdef __APPLE__
+#define GLFW_INCLUDE_GLCOREARB
+#else
+#include <GL/glew.h>
+#endif
+#include <GLFW/glfw3.h>
+// Use of degrees is deprecated. Use radians instead.
+#ifndef GLM_FORCE_RADIANS
+#define GLM_FORCE_RADIANS
+#endif
+#include <glm/glm.hpp>
+
+#define OCCLUSION_MAX_OBJECTS 16
+#define OCCLUSION_NEAR_MARGIN 1.0f	// Camera this close to a box always draws, the box's near faces would be clipped away
+
+enum OcclusionPass { OCCLUSION_REFLECTION, OCCLUSION_REFRACTION, OCCLUSION_MAIN, OCCLUSION_PASSES };
+
+// Hardware occlusion culling for the props, one GL_ANY_SAMPLES_PASSED query per object per pass.
+// After a pass's opaque geometry is down, each object's bounding box is drawn against that depth
+// buffer with colour and depth writes off. The same pass next frame draws the object inside
+// glBeginConditionalRender on that query with GL_QUERY_NO_WAIT, so the GPU skips it if no sample
+// passed and the CPU never waits for a result (an unfinished query just draws). Objects can pop in
+// a frame late when they come out from behind something.
+//
+// Results are only read back when they are already available, just before the query is reused,
+// for the per pass statistics.
+class OcclusionQueries
+{
+public:
+	static bool enabled;
+
+	static void init();
+	static void clean_up();
+	static void set_pass(OcclusionPass pass);
+
+	// Around an object's draw calls. begin returns whether a conditional render was started.
+	static bool begin_draw(int object);
+	static void end_draw(bool conditional);
+
+	// After the pass's opaque draws, queue each object's box test for next frame. program is a depth
+	// only variant of shader.*, the clip plane goes to it so boxes are cut like the objects are.
+	static void begin_tests(GLuint program);
+	static void test(int object, glm::vec3 center, float radius);
+	static void end_tests();
+
+	static void report();
+
+private:
+	struct Stats
+	{
+		long long tests;
+		long long occluded;		// Previous query found no samples, the draw was skipped
+		long long late;			// Result wasn't back in time, drawn regardless
+		long long near;			// Camera inside the box, not tested
+	};
+
+	static GLuint queries[OCCLUSION_PASSES][OCCLUSION_MAX_OBJECTS];
+	static bool issued[OCCLUSION_PASSES][OCCLUSION_MAX_OBJECTS];
+	static Stats stats[OCCLUSION_PASSES];
+	static OcclusionPass pass;
+	static GLuint program;
+	static GLuint boxVAO, boxVBO, boxEBO;
+};
+
+#endif
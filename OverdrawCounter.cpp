@@ -0,0 +1,84 @@
+#include "OverdrawCounter.h"
+#include "Window.h"
+
+#include <stdio.h>
+#include <iostream>
+
+bool OverdrawCounter::invocations = false;
+GLuint OverdrawCounter::queries[OVERDRAW_BUFFERS];
+bool OverdrawCounter::issued[OVERDRAW_BUFFERS];
+double OverdrawCounter::pixels[OVERDRAW_BUFFERS];
+int OverdrawCounter::current = 0;
+double OverdrawCounter::samples[OVERDRAW_WINDOW];
+int OverdrawCounter::count = 0;
+int OverdrawCounter::next = 0;
+
+void OverdrawCounter::init()
+{
+#ifdef __APPLE__
+	invocations = false;	// No pipeline statistics in the 4.1 core profile
+#else
+	invocations = GLEW_ARB_pipeline_statistics_query ? true : false;
+#endif
+	if (!invocations) std::cout << "ARB_pipeline_statistics_query not supported, overdraw counts multisamples that passed the depth test" << std::endl;
+	glGenQueries(OVERDRAW_BUFFERS, queries);
+	for (int i = 0; i < OVERDRAW_BUFFERS; i++) issued[i] = false;
+}
+
+void OverdrawCounter::clean_up()
+{
+	glDeleteQueries(OVERDRAW_BUFFERS, queries);
+}
+
+void OverdrawCounter::begin()
+{
+	// The slot about to be reused was issued OVERDRAW_BUFFERS frames ago
+	current = (current + 1) % OVERDRAW_BUFFERS;
+	collect(current);
+
+	double area = (double)DynamicResolution::width(RES_MAIN) * DynamicResolution::height(RES_MAIN);
+	if (!invocations)
+	{
+		GLint multisamples = 0;
+		glGetIntegerv(GL_SAMPLES, &multisamples);
+		if (multisamples > 1) area *= multisamples;
+	}
+	pixels[current] = area;
+	glBeginQuery(invocations ? GL_FRAGMENT_SHADER_INVOCATIONS_ARB : GL_SAMPLES_PASSED, queries[current]);
+}
+
+void OverdrawCounter::end()
+{
+	glEndQuery(invocations ? GL_FRAGMENT_SHADER_INVOCATIONS_ARB : GL_SAMPLES_PASSED);
+	issued[current] = true;
+}
+
+void OverdrawCounter::collect(int query)
+{
+	if (!issued[query]) return;
+	issued[query] = false;
+
+	// Still not done after a few frames means the GPU is far behind, drop the sample rather than wait
+	GLuint available = 0;
+	glGetQueryObjectuiv(queries[query], GL_QUERY_RESULT_AVAILABLE, &available);
+	if (!available || pixels[query] <= 0.0) return;
+
+	GLuint64 result = 0;
+	glGetQueryObjectui64v(queries[query], GL_QUERY_RESULT, &result);
+	samples[next] = result / pixels[query];
+	next = (next + 1) % OVERDRAW_WINDOW;
+	if (count < OVERDRAW_WINDOW) count++;
+}
+
+void OverdrawCounter::report(const char * label)
+{
+	if (count == 0)
+	{
+		std::cout << "Overdraw: no samples yet" << std::endl;
+		return;
+	}
+	double total = 0.0;
+	for (int i = 0; i < count; i++) total += samples[i];
+	printf("Overdraw (%s): %.2f %s per pixel in the main pass, %d frame average\n", label, total / count,
+		invocations ? "fragment shader invocations" : "samples passed", count);
+}
@@ -0,0 +1,45 @@
+#pragma once
+#ifndef _OVERDRAWCOUNTER_H_
+#define _OVERDRAWCOUNTER_H_
+
+#define GLFW_INCLUDE_GLEXT
+#ifdef __APPLE__
+#define GLFW_INCLUDE_GLCOREARB
+#else
+#include <GL/glew.h>
+#endif
+#include <GLFW/glfw3.h>
+
+#ifndef GL_FRAGMENT_SHADER_INVOCATIONS_ARB
+#define GL_FRAGMENT_SHADER_INVOCATIONS_ARB 0x82F4
+#endif
+
+#define OVERDRAW_BUFFERS 3		// Queries in flight, read back a few frames late so nothing stalls
+#define OVERDRAW_WINDOW 120		// Frames in the rolling average
+
+// Counts fragment shader invocations over the main pass's opaque draws, divided by the pixels it rendered
+// that's how many times each pixel got shaded. Needs ARB_pipeline_statistics_query, without it
+// falls back to GL_SAMPLES_PASSED, which counts multisamples that passed the depth test instead.
+class OverdrawCounter
+{
+public:
+	static void init();
+	static void clean_up();
+	static void begin();	// One begin/end pair per frame
+	static void end();
+	static void report(const char * label);	// Prints the rolling average
+
+private:
+	static bool invocations;	// Pipeline statistics, otherwise samples passed
+	static GLuint queries[OVERDRAW_BUFFERS];
+	static bool issued[OVERDRAW_BUFFERS];
+	static double pixels[OVERDRAW_BUFFERS];	// Window size when each query ran
+	static int current;
+	static double samples[OVERDRAW_WINDOW];
+	static int count;
+	static int next;
+
+	static void collect(int query);
+};
+
+#endif
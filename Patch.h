@@ -17,31 +17,24 @@
 
 #include <vector>
 
+#include "BezierEvaluator.h"
+
+#define PATCH_PIXELS_PER_SEGMENT 8.0f	// Screen length the GPU path aims for per tessellated edge
+#define PATCH_MAX_LEVEL 64.0f			// GL guarantees at least this much, see GL_MAX_TESS_GEN_LEVEL
+
+// Bezier patch math. The patches in the scene are drawn by PatchNetwork.
 class Patch
 {
 public:
-	Patch(glm::vec3 position, glm::vec3 pts[16]);
-	~Patch();
+	// Whether the GPU can tessellate (GL 4.0), so PatchNetwork can take the patch.* programs. Needs the GL context.
+	static void init();
+	static bool tessellation;
 
-	void reinitialize(bool simple);
-	void draw(GLuint, glm::vec3 objColor, glm::vec3 lightColor, glm::vec3 lightDir, glm::vec3 camPos, glm::vec4 materialParams, bool toon, bool simple);
 	static glm::vec3 genSingleCurvePoint(float t, glm::vec3 p0, glm::vec3 p1, glm::vec3 p2, glm::vec3 p3);
 	static glm::vec3 genSingleCurveTangent(float t, glm::vec3 p0, glm::vec3 p1, glm::vec3 p2, glm::vec3 p3);
 	static std::pair<glm::vec3, glm::vec3> genSinglePatchPoint(float u, float v, glm::vec3 pts[16]);
 	static std::vector<glm::vec3> genCurvePoints(glm::vec3 start, glm::vec3 cp1, glm::vec3 cp2, glm::vec3 end, int numPoints);
 	static std::vector<glm::vec3> genPatchPoints(glm::vec3 pts[16], int pointsPerCurve);
-
-	glm::mat4 toWorld;
-	std::vector<GLfloat> vertices;
-	std::vector<GLfloat> normals;
-	std::vector<GLuint> indices;
-	std::vector<GLfloat> simpleVerts;
-	std::vector<GLfloat> simpleNorms;
-	std::vector<GLuint> simpleIndices;
-
-	// These variables are needed for the shader program
-	GLuint VBO[2], VAO, EBO;
-	GLuint uProjection, uModel, uView, uObjColor, uLightColor, uLightDir, uCamPos, uAmb, uDif, uSpec, uShine, uMode, uModelView, uToon;
 };
 
 #endif
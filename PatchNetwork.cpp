@@ -0,0 +1,545 @@
+#include "PatchNetwork.h"
+#include "Patch.h"
+#include "Window.h"
+#include "Profiler.h"
+
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <iostream>
+#include <map>
+#include <tuple>
+
+typedef std::tuple<float, float, float> PointKey;
+
+static PointKey point_key(const glm::vec3 & p)
+{
+	return PointKey(p.x, p.y, p.z);
+}
+
+PatchNetwork::PatchNetwork(glm::vec3 position) : index_count(0), built(false), evaluator(PATCH_NETWORK_SAMPLES)
+{
+	toWorld = glm::translate(glm::mat4(1.0f), position);
+	VAO = EBO = controlVAO = controlVBO = 0;
+	VBO[0] = VBO[1] = 0;
+}
+
+PatchNetwork::~PatchNetwork()
+{
+	glDeleteVertexArrays(1, &VAO);
+	glDeleteBuffers(2, &VBO[0]);
+	glDeleteBuffers(1, &EBO);
+	glDeleteVertexArrays(1, &controlVAO);
+	glDeleteBuffers(1, &controlVBO);
+}
+
+int PatchNetwork::add_patch(const glm::vec3 pts[16])
+{
+	if (built)
+	{
+		std::cerr << "PatchNetwork: patches have to be added before build()" << std::endl;
+		return -1;
+	}
+	NetworkPatch patch;
+	memcpy(patch.control, pts, sizeof(patch.control));
+	for (int e = 0; e < 4; e++)
+	{
+		patch.neighbour[e] = -1;
+		patch.neighbour_edge[e] = 0;
+		patch.reversed[e] = false;
+	}
+	patch.level = PATCH_NETWORK_MAX_LEVEL;
+	patch.dirty = true;
+	patch.center = glm::vec3(0.0f);
+	patch.radius = 0.0f;
+	patches.push_back(patch);
+	return (int)patches.size() - 1;
+}
+
+// Control point indices along an edge, in the direction its samples run
+void PatchNetwork::edge_controls(int edge, int out[4])
+{
+	static const int table[4][4] = { { 0, 1, 2, 3 }, { 3, 7, 11, 15 }, { 12, 13, 14, 15 }, { 0, 4, 8, 12 } };
+	for (int i = 0; i < 4; i++) out[i] = table[edge][i];
+}
+
+// Sample k along an edge
+void PatchNetwork::edge_sample(int edge, int k, int & u, int & v)
+{
+	const int last = PATCH_NETWORK_SAMPLES - 1;
+	switch (edge)
+	{
+	case 0: u = k; v = 0; break;
+	case 1: u = last; v = k; break;
+	case 2: u = k; v = last; break;
+	default: u = 0; v = k; break;
+	}
+}
+
+void PatchNetwork::find_neighbours()
+{
+	// Edges keyed by their end points in either order, then checked point by point
+	std::map<std::pair<PointKey, PointKey>, std::pair<int, int> > edges;
+	for (int p = 0; p < (int)patches.size(); p++)
+	{
+		for (int e = 0; e < 4; e++)
+		{
+			int c[4];
+			edge_controls(e, c);
+			PointKey a = point_key(patches[p].control[c[0]]), b = point_key(patches[p].control[c[3]]);
+			std::pair<PointKey, PointKey> key = a < b ? std::make_pair(a, b) : std::make_pair(b, a);
+			std::map<std::pair<PointKey, PointKey>, std::pair<int, int> >::iterator found = edges.find(key);
+			if (found == edges.end())
+			{
+				edges[key] = std::make_pair(p, e);
+				continue;
+			}
+
+			int q = found->second.first, f = found->second.second;
+			if (patches[q].neighbour[f] >= 0) continue;	// Already paired, more than two patches on an edge don't weld
+			int d[4];
+			edge_controls(f, d);
+			bool forward = true, backward = true;
+			for (int i = 0; i < 4; i++)
+			{
+				forward = forward && patches[p].control[c[i]] == patches[q].control[d[i]];
+				backward = backward && patches[p].control[c[i]] == patches[q].control[d[3 - i]];
+			}
+			if (!forward && !backward) continue;	// Same ends, different curve
+
+			patches[p].neighbour[e] = q;
+			patches[p].neighbour_edge[e] = f;
+			patches[p].reversed[e] = !forward;
+			patches[q].neighbour[f] = p;
+			patches[q].neighbour_edge[f] = e;
+			patches[q].reversed[f] = !forward;
+		}
+	}
+}
+
+void PatchNetwork::weld()
+{
+	const int n = PATCH_NETWORK_SAMPLES;
+	const int last = n - 1;
+	const GLuint none = 0xFFFFFFFF;
+	GLuint next = 0;
+
+	// Corners by position too, patches meeting only diagonally share one without sharing an edge.
+	// The surface passes exactly through its corner control points, so exact keys are safe.
+	std::map<PointKey, GLuint> corners;
+
+	for (int p = 0; p < (int)patches.size(); p++)
+	{
+		NetworkPatch & patch = patches[p];
+		patch.vertex.assign(n * n, none);
+		for (int v = 0; v < n; v++)
+		{
+			for (int u = 0; u < n; u++)
+			{
+				GLuint id = none;
+
+				// Take the vertex of an already welded neighbour if the sample is on their edge
+				const bool on_edge[4] = { v == 0, u == last, v == last, u == 0 };
+				for (int e = 0; e < 4 && id == none; e++)
+				{
+					int q = patch.neighbour[e];
+					if (!on_edge[e] || q < 0 || q >= p) continue;
+					int k = (e == 0 || e == 2) ? u : v;
+					if (patch.reversed[e]) k = last - k;
+					int qu, qv;
+					edge_sample(patch.neighbour_edge[e], k, qu, qv);
+					id = patches[q].vertex[qv * n + qu];
+				}
+
+				bool corner = (u == 0 || u == last) && (v == 0 || v == last);
+				if (corner)
+				{
+					int c = (v == 0 ? 0 : 12) + (u == 0 ? 0 : 3);
+					PointKey key = point_key(patch.control[c]);
+					std::map<PointKey, GLuint>::iterator found = corners.find(key);
+					if (id == none && found != corners.end()) id = found->second;
+					if (id == none) id = next++;
+					corners[key] = id;
+				}
+				if (id == none) id = next++;
+				patch.vertex[v * n + u] = id;
+			}
+		}
+	}
+
+	// Only border samples can be welded to another patch's
+	std::vector<std::vector<int> > owners(next);
+	for (int p = 0; p < (int)patches.size(); p++)
+	{
+		for (int v = 0; v < n; v++)
+		{
+			for (int u = 0; u < n; u += (v == 0 || v == last) ? 1 : last)
+			{
+				std::vector<int> & owner = owners[patches[p].vertex[v * n + u]];
+				if (owner.empty() || owner.back() != p) owner.push_back(p);
+			}
+		}
+	}
+	for (GLuint id = 0; id < next; id++)
+	{
+		for (size_t i = 0; i < owners[id].size(); i++)
+		{
+			for (size_t j = 0; j < owners[id].size(); j++)
+			{
+				std::vector<int> & touching = patches[owners[id][i]].touching;
+				if (i != j && std::find(touching.begin(), touching.end(), owners[id][j]) == touching.end()) touching.push_back(owners[id][j]);
+			}
+		}
+	}
+
+	vertices.assign(next * 3, 0.0f);
+	normals.assign(next * 3, 0.0f);
+	is_stale.assign(next, false);
+	std::cout << "PatchNetwork: " << patches.size() << " patches welded into " << next << " vertices (" << patches.size() * n * n << " samples)" << std::endl;
+}
+
+void PatchNetwork::evaluate_dirty()
+{
+	PROFILE_ZONE("PatchNetwork::evaluate_dirty");
+	const int area = PATCH_NETWORK_SAMPLES * PATCH_NETWORK_SAMPLES;
+
+	// One batch for everything that moved, then copied into that patch's slot of the full set
+	std::vector<glm::vec3> controls;
+	changed.clear();
+	for (int p = 0; p < (int)patches.size(); p++)
+	{
+		if (!patches[p].dirty) continue;
+		controls.insert(controls.end(), patches[p].control, patches[p].control + 16);
+		changed.push_back(p);
+
+		// Bounds for picking levels
+		NetworkPatch & patch = patches[p];
+		glm::vec3 low = patch.control[0], high = patch.control[0];
+		for (int i = 1; i < 16; i++)
+		{
+			low = glm::min(low, patch.control[i]);
+			high = glm::max(high, patch.control[i]);
+		}
+		patch.center = 0.5f * (low + high);
+		patch.radius = 0.5f * glm::length(high - low);
+		patch.dirty = false;
+	}
+	if (changed.empty()) return;
+
+	evaluator.evaluate(&controls[0], (int)changed.size(), moved);
+	for (int c = 0; c < 3; c++)
+	{
+		samples.position[c].resize(patches.size() * area);
+		samples.normal[c].resize(patches.size() * area);
+	}
+	samples.samples = PATCH_NETWORK_SAMPLES;
+	samples.patches = (int)patches.size();
+	for (size_t i = 0; i < changed.size(); i++)
+	{
+		for (int c = 0; c < 3; c++)
+		{
+			memcpy(&samples.position[c][changed[i] * area], &moved.position[c][i * area], area * sizeof(float));
+			memcpy(&samples.normal[c][changed[i] * area], &moved.normal[c][i * area], area * sizeof(float));
+		}
+	}
+}
+
+void PatchNetwork::refresh_vertices()
+{
+	PROFILE_ZONE("PatchNetwork::refresh_vertices");
+	const int n = PATCH_NETWORK_SAMPLES;
+	const int last = n - 1;
+
+	// Every vertex of a moved patch is rewritten, including the ones it shares with patches that didn't move
+	stale.clear();
+	for (size_t i = 0; i < changed.size(); i++)
+	{
+		const std::vector<GLuint> & vertex = patches[changed[i]].vertex;
+		for (size_t s = 0; s < vertex.size(); s++)
+		{
+			GLuint id = vertex[s];
+			if (is_stale[id]) continue;
+			is_stale[id] = true;
+			stale.push_back(id);
+			normals[id * 3] = normals[id * 3 + 1] = normals[id * 3 + 2] = 0.0f;
+		}
+	}
+
+	// Welded vertices get the average of every patch's unit normal there, smooth across the seams.
+	// Patches that didn't move only add their border samples, nothing else of theirs is shared.
+	std::vector<int> neighbours;
+	for (size_t i = 0; i < changed.size(); i++)
+	{
+		int p = changed[i];
+		for (int s = 0; s < n * n; s++) add_sample(p, s % n, s / n);
+		for (size_t t = 0; t < patches[p].touching.size(); t++)
+		{
+			int q = patches[p].touching[t];
+			if (std::find(changed.begin(), changed.end(), q) == changed.end() && std::find(neighbours.begin(), neighbours.end(), q) == neighbours.end()) neighbours.push_back(q);
+		}
+	}
+	for (size_t i = 0; i < neighbours.size(); i++)
+	{
+		for (int v = 0; v < n; v++)
+		{
+			for (int u = 0; u < n; u += (v == 0 || v == last) ? 1 : last)
+			{
+				if (is_stale[patches[neighbours[i]].vertex[v * n + u]]) add_sample(neighbours[i], u, v);
+			}
+		}
+	}
+
+	std::sort(stale.begin(), stale.end());
+	for (size_t i = 0; i < stale.size(); i++) is_stale[stale[i]] = false;
+}
+
+void PatchNetwork::add_sample(int patch, int u, int v)
+{
+	GLuint id = patches[patch].vertex[v * PATCH_NETWORK_SAMPLES + u];
+	glm::vec3 position = samples.get_position(patch, u, v);
+	glm::vec3 normal = samples.get_normal(patch, u, v);
+	float length = glm::length(normal);
+	if (length > 0.0f) normal /= length;
+	vertices[id * 3] = position.x;
+	vertices[id * 3 + 1] = position.y;
+	vertices[id * 3 + 2] = position.z;
+	normals[id * 3] += normal.x;
+	normals[id * 3 + 1] += normal.y;
+	normals[id * 3 + 2] += normal.z;
+}
+
+void PatchNetwork::build_indices()
+{
+	PROFILE_ZONE("PatchNetwork::build_indices");
+	const int n = PATCH_NETWORK_SAMPLES;
+	const int last = n - 1;
+	indices.clear();
+
+	for (int p = 0; p < (int)patches.size(); p++)
+	{
+		const NetworkPatch & patch = patches[p];
+		int step = 1 << (PATCH_NETWORK_MAX_LEVEL - patch.level);
+
+		// An edge is drawn at the coarser of the two levels that meet there
+		int edge_step[4];
+		for (int e = 0; e < 4; e++)
+		{
+			int level = patch.level;
+			if (patch.neighbour[e] >= 0) level = std::min(level, patches[patch.neighbour[e]].level);
+			edge_step[e] = 1 << (PATCH_NETWORK_MAX_LEVEL - level);
+		}
+
+		// Samples on a coarser edge snap back to that edge's vertices, the triangles that collapse are dropped
+		GLuint corner[4];
+		for (int v = 0; v < last; v += step)
+		{
+			for (int u = 0; u < last; u += step)
+			{
+				const int cu[4] = { u, u + step, u + step, u };
+				const int cv[4] = { v, v, v + step, v + step };
+				for (int i = 0; i < 4; i++)
+				{
+					int su = cu[i], sv = cv[i];
+					if (sv == 0) su = su / edge_step[0] * edge_step[0];
+					else if (sv == last) su = su / edge_step[2] * edge_step[2];
+					if (su == 0) sv = sv / edge_step[3] * edge_step[3];
+					else if (su == last) sv = sv / edge_step[1] * edge_step[1];
+					corner[i] = patch.vertex[sv * n + su];
+				}
+
+				// Counter clockwise seen from the cross(dP/du, dP/dv) side
+				const int triangles[2][3] = { { 0, 1, 2 }, { 0, 2, 3 } };
+				for (int t = 0; t < 2; t++)
+				{
+					GLuint a = corner[triangles[t][0]], b = corner[triangles[t][1]], c = corner[triangles[t][2]];
+					if (a == b || b == c || a == c) continue;
+					indices.push_back(a);
+					indices.push_back(b);
+					indices.push_back(c);
+				}
+			}
+		}
+	}
+	index_count = (GLsizei)indices.size();
+}
+
+void PatchNetwork::upload_vertices()
+{
+	PROFILE_ZONE("PatchNetwork::upload_vertices");
+	// Runs of the vertices refresh_vertices rewrote. A moved patch's own vertices are mostly one
+	// block, the ones it shares are scattered through its neighbours', so close gaps are sent along.
+	const size_t max_gap = 8;
+	for (size_t i = 0; i < stale.size();)
+	{
+		size_t j = i + 1;
+		while (j < stale.size() && stale[j] - stale[j - 1] <= max_gap) j++;
+		GLintptr offset = stale[i] * 3 * sizeof(GLfloat);
+		GLsizeiptr size = (stale[j - 1] - stale[i] + 1) * 3 * sizeof(GLfloat);
+		glBindBuffer(GL_ARRAY_BUFFER, VBO[0]);
+		glBufferSubData(GL_ARRAY_BUFFER, offset, size, &vertices[stale[i] * 3]);
+		glBindBuffer(GL_ARRAY_BUFFER, VBO[1]);
+		glBufferSubData(GL_ARRAY_BUFFER, offset, size, &normals[stale[i] * 3]);
+		i = j;
+	}
+	if (controlVBO != 0)
+	{
+		glBindBuffer(GL_ARRAY_BUFFER, controlVBO);
+		for (size_t i = 0; i < changed.size(); i++)
+		{
+			int p = changed[i];
+			glBufferSubData(GL_ARRAY_BUFFER, p * sizeof(patches[p].control), sizeof(patches[p].control), &patches[p].control[0].x);
+		}
+	}
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void PatchNetwork::build()
+{
+	PROFILE_ZONE("PatchNetwork::build");
+	if (built || patches.empty()) return;
+	built = true;
+
+	find_neighbours();
+	weld();
+	evaluate_dirty();
+	refresh_vertices();
+	build_indices();
+
+	// Sized for the finest level everywhere, later updates only overwrite
+	const int n = PATCH_NETWORK_SAMPLES;
+	size_t max_indices = patches.size() * (n - 1) * (n - 1) * 6;
+	glGenVertexArrays(1, &VAO);
+	glGenBuffers(2, &VBO[0]);
+	glGenBuffers(1, &EBO);
+	glBindVertexArray(VAO);
+	glBindBuffer(GL_ARRAY_BUFFER, VBO[0]);
+	glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(GLfloat), &vertices[0], GL_DYNAMIC_DRAW);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), (GLvoid*)0);
+	glBindBuffer(GL_ARRAY_BUFFER, VBO[1]);
+	glBufferData(GL_ARRAY_BUFFER, normals.size() * sizeof(GLfloat), &normals[0], GL_DYNAMIC_DRAW);
+	glEnableVertexAttribArray(1);
+	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), (GLvoid*)0);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, max_indices * sizeof(GLuint), NULL, GL_DYNAMIC_DRAW);
+	glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, indices.size() * sizeof(GLuint), &indices[0]);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	// NOTE: You must NEVER unbind the element array buffer associated with a VAO!
+	glBindVertexArray(0);
+
+	// Every patch's control points back to back, one GL_PATCHES draw for the lot
+	if (Patch::tessellation)
+	{
+		std::vector<glm::vec3> controls;
+		for (int p = 0; p < (int)patches.size(); p++) controls.insert(controls.end(), patches[p].control, patches[p].control + 16);
+		glGenVertexArrays(1, &controlVAO);
+		glGenBuffers(1, &controlVBO);
+		glBindVertexArray(controlVAO);
+		glBindBuffer(GL_ARRAY_BUFFER, controlVBO);
+		glBufferData(GL_ARRAY_BUFFER, controls.size() * sizeof(glm::vec3), &controls[0].x, GL_DYNAMIC_DRAW);
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), (GLvoid*)0);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		glBindVertexArray(0);
+	}
+}
+
+void PatchNetwork::set_control_points(int patch, const glm::vec3 pts[16])
+{
+	if (patch < 0 || patch >= (int)patches.size()) return;
+	if (memcmp(patches[patch].control, pts, sizeof(patches[patch].control)) == 0) return;	// Unchanged, nothing to redo
+	memcpy(patches[patch].control, pts, sizeof(patches[patch].control));
+	patches[patch].dirty = true;
+}
+
+int PatchNetwork::select_level(const NetworkPatch & patch, glm::vec3 cam_pos, float pixel_scale) const
+{
+	// Cells per side the patch needs for PATCH_NETWORK_PIXELS_PER_SEGMENT, rounded up to a power of two
+	glm::vec3 center = glm::vec3(toWorld * glm::vec4(patch.center, 1.0f));
+	float distance = glm::length(cam_pos - center) - patch.radius;
+	if (distance <= 0.1f) return PATCH_NETWORK_MAX_LEVEL;	// Camera is inside the bounds
+	float pixels = 2.0f * patch.radius * pixel_scale / distance;
+	float cells = pixels / PATCH_NETWORK_PIXELS_PER_SEGMENT;
+	if (cells <= 1.0f) return 0;
+	int level = (int)ceil(log2(cells));
+	return std::min(level, PATCH_NETWORK_MAX_LEVEL);
+}
+
+glm::vec3 PatchNetwork::center() const
+{
+	glm::vec3 sum(0.0f);
+	for (size_t p = 0; p < patches.size(); p++) sum += patches[p].center;
+	if (!patches.empty()) sum /= (float)patches.size();
+	return glm::vec3(toWorld * glm::vec4(sum, 1.0f));
+}
+
+void PatchNetwork::update(glm::vec3 cam_pos, float pixel_scale, bool simple)
+{
+	PROFILE_ZONE("PatchNetwork::update");
+	if (!built) return;
+
+	bool moved_any = false;
+	for (int p = 0; p < (int)patches.size() && !moved_any; p++) moved_any = patches[p].dirty;
+	if (moved_any)
+	{
+		evaluate_dirty();
+		refresh_vertices();
+		upload_vertices();
+	}
+
+	bool changed = false;
+	for (int p = 0; p < (int)patches.size(); p++)
+	{
+		int level = simple ? 0 : select_level(patches[p], cam_pos, pixel_scale);
+		if (level == patches[p].level) continue;
+		patches[p].level = level;
+		changed = true;
+	}
+	if (changed)
+	{
+		build_indices();
+		// The element array binding belongs to the VAO, so go through it (and leave it bound to it)
+		glBindVertexArray(VAO);
+		glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, indices.size() * sizeof(GLuint), &indices[0]);
+		glBindVertexArray(0);
+	}
+}
+
+void PatchNetwork::draw(GLuint shaderProgram, glm::vec3 objColor, glm::vec3 lightColor, glm::vec3 lightDir, glm::vec3 camPos, glm::vec4 materialParams, bool tessellated)
+{
+	if (!built) return;
+
+	glm::mat4 modelview = Window::V * toWorld;
+	glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "projection"), 1, GL_FALSE, &Window::P[0][0]);
+	glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "model"), 1, GL_FALSE, &toWorld[0][0]);
+	glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "view"), 1, GL_FALSE, &Window::V[0][0]);
+	glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "modelview"), 1, GL_FALSE, &modelview[0][0]);
+	glUniform3fv(glGetUniformLocation(shaderProgram, "objectColor"), 1, &(objColor.x));
+	glUniform3fv(glGetUniformLocation(shaderProgram, "lightColor"), 1, &(lightColor.x));
+	glUniform3fv(glGetUniformLocation(shaderProgram, "lightDir"), 1, &(lightDir.x));
+	glUniform3fv(glGetUniformLocation(shaderProgram, "camPos"), 1, &(camPos.x));
+	glUniform1f(glGetUniformLocation(shaderProgram, "ambientModifier"), materialParams.x);
+	glUniform1f(glGetUniformLocation(shaderProgram, "diffuseModifier"), materialParams.y);
+	glUniform1f(glGetUniformLocation(shaderProgram, "specularModifier"), materialParams.z);
+	glUniform1f(glGetUniformLocation(shaderProgram, "shininess"), materialParams.w);
+	glUniform4f(glGetUniformLocation(shaderProgram, "plane"), 0.0, Window::plane_vec_dir, 0.0, Window::water_level);
+
+	glDisable(GL_CULL_FACE);
+
+	if (tessellated && controlVAO != 0)
+	{
+		// The control shader sizes each patch from its own bounds on screen
+		glUniform1f(glGetUniformLocation(shaderProgram, "pixel_scale"), Window::P[1][1] * DynamicResolution::render_height() * 0.5f);
+		glUniform1f(glGetUniformLocation(shaderProgram, "pixels_per_segment"), PATCH_PIXELS_PER_SEGMENT * Window::lod_bias);
+		glUniform1f(glGetUniformLocation(shaderProgram, "max_level"), PATCH_MAX_LEVEL);
+		glBindVertexArray(controlVAO);
+		glPatchParameteri(GL_PATCH_VERTICES, 16);
+		glDrawArrays(GL_PATCHES, 0, (GLsizei)patches.size() * 16);
+	}
+	else
+	{
+		glBindVertexArray(VAO);
+		glDrawElements(GL_TRIANGLES, index_count, GL_UNSIGNED_INT, 0);
+	}
+	glBindVertexArray(0);
+}
@@ -0,0 +1,104 @@
+#pragma once
+#ifndef _PATCHNETWORK_H_
+#define _PATCHNETWORK_H_
+
+#define GLFW_INCLUDE_GLEXT
+#ifdef __APPLE__
+#define GLFW_INCLUDE_GLCOREARB
+#else
+#include <GL/glew.h>
+#endif
+#include <GLFW/glfw3.h>
+// Use of degrees is deprecated. Use radians instead.
+#ifndef GLM_FORCE_RADIANS
+#define GLM_FORCE_RADIANS
+#endif
+#include <glm/mat4x4.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <vector>
+
+#include "BezierEvaluator.h"
+
+#define PATCH_NETWORK_MAX_LEVEL 4	// Finest level, 2^4 + 1 = 17 samples per side. Level 0 is just the corners.
+#define PATCH_NETWORK_SAMPLES ((1 << PATCH_NETWORK_MAX_LEVEL) + 1)
+#define PATCH_NETWORK_PIXELS_PER_SEGMENT 12.0f	// Screen length a grid cell aims for when picking levels
+
+// Bicubic Bezier patches that meet along shared edges (identical edge control points, either
+// direction), tessellated into one vertex and index buffer and drawn in one call.
+//
+// Every patch is evaluated once at the finest level and the samples on shared edges and corners are
+// welded into single vertices with averaged normals. Coarser levels are every 2nd, 4th... sample of
+// the same grid, so changing a patch's level only rebuilds indices. Each patch picks its own level
+// from its size on screen, and along an edge between two levels the finer patch snaps its edge
+// samples to the coarser one's vertices, so there are no T-junctions or cracks.
+//
+// With GL 4.0 the same control points go to the GPU as GL_PATCHES, one draw for the whole network.
+class PatchNetwork
+{
+public:
+	PatchNetwork(glm::vec3 position);
+	~PatchNetwork();
+
+	int add_patch(const glm::vec3 pts[16]);	// Before build(), 16 points in rows of 4 along u
+	void build();							// Welds the edges and creates the buffers. Needs the GL context.
+
+	// Moved patches have to keep shared edge control points shared or the welds tear
+	void set_control_points(int patch, const glm::vec3 pts[16]);
+	// Once per frame: re-evaluates moved patches and picks every patch's level, simple forces level 0
+	void update(glm::vec3 cam_pos, float pixel_scale, bool simple);
+	// program is shader.* for the welded mesh, patch.* + shader.frag when tessellated
+	void draw(GLuint shaderProgram, glm::vec3 objColor, glm::vec3 lightColor, glm::vec3 lightDir, glm::vec3 camPos, glm::vec4 materialParams, bool tessellated);
+
+	int patch_count() const { return (int)patches.size(); }
+	int vertex_count() const { return (int)vertices.size() / 3; }
+	int triangle_count() const { return index_count / 3; }
+	glm::vec3 center() const;	// Average of the patch bounds, world space
+
+	glm::mat4 toWorld;
+
+private:
+	struct NetworkPatch
+	{
+		glm::vec3 control[16];
+		int neighbour[4];		// Patch across each edge, -1 on the border. Edges are v = 0, u = 1, v = 1, u = 0.
+		int neighbour_edge[4];	// Which of its edges it is
+		bool reversed[4];		// The neighbour runs the edge the other way
+		int level;
+		bool dirty;
+		glm::vec3 center;		// Bounds of the control points, the surface stays inside them
+		float radius;
+		std::vector<GLuint> vertex;	// Welded vertex for each finest level sample, v * samples + u
+		std::vector<int> touching;	// Other patches sharing a welded vertex with this one, along an edge or at a corner
+	};
+
+	std::vector<NetworkPatch> patches;
+	std::vector<GLfloat> vertices;
+	std::vector<GLfloat> normals;
+	std::vector<GLuint> indices;
+	GLsizei index_count;
+	bool built;
+
+	BezierEvaluator<3> evaluator;
+	BezierSamples samples;	// Finest level samples of every patch, kept so moved patches are re-evaluated alone
+	BezierSamples moved;
+	std::vector<int> changed;		// Patches the last evaluate_dirty re-evaluated
+	std::vector<GLuint> stale;		// Welded vertices the last refresh_vertices rewrote, sorted
+	std::vector<bool> is_stale;
+
+	GLuint VAO, VBO[2], EBO;
+	GLuint controlVAO, controlVBO;
+
+	static void edge_controls(int edge, int out[4]);
+	static void edge_sample(int edge, int k, int & u, int & v);
+	void find_neighbours();
+	void weld();
+	void evaluate_dirty();
+	void refresh_vertices();
+	void add_sample(int patch, int u, int v);
+	void build_indices();
+	void upload_vertices();
+	int select_level(const NetworkPatch & patch, glm::vec3 cam_pos, float pixel_scale) const;
+};
+
+#endif
@@ -0,0 +1,113 @@
+#include "Profiler.h"
+
+#include <stdio.h>
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+
+std::mutex Profiler::buffers_lock;
+std::vector<Profiler::ThreadBuffer *> Profiler::buffers;
+
+static const std::chrono::steady_clock::time_point profiler_epoch = std::chrono::steady_clock::now();
+
+long long Profiler::now()
+{
+	return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - profiler_epoch).count();
+}
+
+Profiler::ThreadBuffer * Profiler::get_buffer()
+{
+	// Allocated once per thread on its first zone, every zone after that is lock free
+	static thread_local ThreadBuffer * buffer = NULL;
+	if (buffer == NULL)
+	{
+		buffer = new ThreadBuffer();
+		buffer->claimed = 0;
+		buffer->count = 0;
+		buffer->name = NULL;
+
+		std::lock_guard<std::mutex> lock(buffers_lock);
+		buffer->tid = (int)buffers.size() + 1;
+		buffers.push_back(buffer);
+	}
+	return buffer;
+}
+
+void Profiler::record(const char * name, long long start, long long end)
+{
+	ThreadBuffer * buffer = get_buffer();
+	unsigned long long index = buffer->count.load(std::memory_order_relaxed);
+	// Claim first, so a write_trace that sees any of this write also sees the slot is being reused
+	buffer->claimed.store(index + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	Slot & e = buffer->events[index % PROFILER_EVENTS_PER_THREAD];
+	e.name.store(name, std::memory_order_relaxed);
+	e.start.store(start, std::memory_order_relaxed);
+	e.end.store(end, std::memory_order_relaxed);
+	// Publish the event to write_trace
+	buffer->count.store(index + 1, std::memory_order_release);
+}
+
+void Profiler::set_thread_name(const char * name)
+{
+	get_buffer()->name = name;
+}
+
+bool Profiler::write_trace(const char * path)
+{
+	FILE * fp = fopen(path, "w");
+	if (fp == NULL)
+	{
+		std::cerr << "could not open " << path << " for the profiler trace" << std::endl;
+		return false;
+	}
+
+	std::lock_guard<std::mutex> lock(buffers_lock);
+	unsigned long long written = 0;
+	std::vector<Event> copy;
+	copy.reserve(PROFILER_EVENTS_PER_THREAD);
+	fprintf(fp, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+	bool first = true;
+	for (unsigned int i = 0; i < buffers.size(); i++)
+	{
+		ThreadBuffer * buffer = buffers[i];
+
+		// Thread name metadata so Chrome/Perfetto labels the tracks
+		if (buffer->name)
+		{
+			fprintf(fp, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}", first ? "" : ",\n", buffer->tid, buffer->name);
+			first = false;
+		}
+
+		// Only the newest PROFILER_EVENTS_PER_THREAD events are still in the ring. The thread keeps
+		// recording while this copies, so afterwards drop the oldest ones it may have overwritten
+		unsigned long long count = buffer->count.load(std::memory_order_acquire);
+		unsigned long long begin = count > PROFILER_EVENTS_PER_THREAD ? count - PROFILER_EVENTS_PER_THREAD : 0;
+		copy.clear();
+		for (unsigned long long j = begin; j < count; j++)
+		{
+			const Slot & slot = buffer->events[j % PROFILER_EVENTS_PER_THREAD];
+			Event e;
+			e.name = slot.name.load(std::memory_order_relaxed);
+			e.start = slot.start.load(std::memory_order_relaxed);
+			e.end = slot.end.load(std::memory_order_relaxed);
+			copy.push_back(e);
+		}
+		std::atomic_thread_fence(std::memory_order_acquire);
+		unsigned long long claimed = buffer->claimed.load(std::memory_order_relaxed);
+		unsigned long long intact = claimed > PROFILER_EVENTS_PER_THREAD ? claimed - PROFILER_EVENTS_PER_THREAD : 0;
+
+		for (unsigned long long j = std::max(begin, intact); j < count; j++)
+		{
+			const Event & e = copy[(size_t)(j - begin)];
+			fprintf(fp, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%lld,\"dur\":%lld}", first ? "" : ",\n", e.name, buffer->tid, e.start, e.end - e.start);
+			first = false;
+			written++;
+		}
+	}
+	fprintf(fp, "\n]}\n");
+	fclose(fp);
+
+	std::cout << "Wrote " << written << " profiler zones to " << path << std::endl;
+	return true;
+}
@@ -0,0 +1,73 @@
+#pragma once
+#ifndef _PROFILER_H_
+#define _PROFILER_H_
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+#define PROFILER_EVENTS_PER_THREAD 65536	// Ring buffer size, oldest events get overwritten
+
+// Lightweight CPU profiler. Each thread writes finished zones into its own fixed-size buffer,
+// so recording a zone is two clock reads and a store with no locks or allocation.
+// The buffers can be dumped at any time as a Chrome/Perfetto trace (chrome://tracing).
+class Profiler
+{
+public:
+	struct Event
+	{
+		const char * name;	// Must be a string literal (or otherwise outlive the profiler)
+		long long start;	// Microseconds since the profiler started
+		long long end;
+	};
+
+	static long long now();	// Microseconds since the profiler started
+	static void record(const char * name, long long start, long long end);
+	static void set_thread_name(const char * name);
+	static bool write_trace(const char * path);
+
+private:
+	// Fields are atomics so write_trace can read a ring the thread is still writing to
+	struct Slot
+	{
+		std::atomic<const char *> name;
+		std::atomic<long long> start;
+		std::atomic<long long> end;
+	};
+
+	struct ThreadBuffer
+	{
+		Slot events[PROFILER_EVENTS_PER_THREAD];
+		std::atomic<unsigned long long> claimed;	// Bumped before a slot is written
+		std::atomic<unsigned long long> count;		// Bumped after, the events write_trace may read
+		const char * name;
+		int tid;
+	};
+
+	static std::mutex buffers_lock;
+	static std::vector<ThreadBuffer *> buffers;	// Never freed, threads may outlive any owner
+
+	static ThreadBuffer * get_buffer();
+};
+
+// Records the lifetime of the enclosing scope as one zone
+class ProfileZone
+{
+public:
+	ProfileZone(const char * name) : name(name), start(Profiler::now()) {}
+	~ProfileZone() { Profiler::record(name, start, Profiler::now()); }
+
+private:
+	const char * name;
+	long long start;
+};
+
+#ifdef NO_PROFILER
+#define PROFILE_ZONE(name)
+#else
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+#define PROFILE_ZONE(name) ProfileZone PROFILE_CONCAT(profile_zone_, __LINE__)(name)
+#endif
+
+#endif
@@ -0,0 +1,154 @@
+#include "ResourceCache.h"
+#include "ShaderCache.h"
+
+#include <stdio.h>
+#include <iostream>
+
+std::unordered_map<std::string, GLuint> ResourceCache::handles[RESOURCE_TYPES];
+std::unordered_map<GLuint, ResourceCache::Entry> ResourceCache::entries[RESOURCE_TYPES];
+int ResourceCache::hits[RESOURCE_TYPES];
+int ResourceCache::misses[RESOURCE_TYPES];
+
+GLuint ResourceCache::acquire(ResourceType type, const std::string & key, std::function<GLuint()> create, bool * created)
+{
+	std::unordered_map<std::string, GLuint>::iterator it = handles[type].find(key);
+	if (it != handles[type].end())
+	{
+		hits[type]++;
+		entries[type][it->second].refs++;
+		if (created) *created = false;
+		return it->second;
+	}
+
+	misses[type]++;
+	GLuint handle = create();
+	if (created) *created = true;
+	if (handle == 0) return 0;	// Failed to create, don't cache the failure
+
+	Entry entry;
+	entry.key = key;
+	entry.refs = 1;
+	entry.loading = 0;
+	entry.bytes = 0;
+	handles[type][key] = handle;
+	entries[type][handle] = entry;
+	return handle;
+}
+
+void ResourceCache::release(ResourceType type, GLuint handle)
+{
+	Entry * entry = find(type, handle);
+	if (entry == NULL) return;	// Never made it into the cache (0 or failed to create)
+	if (--entry->refs > 0) return;
+
+	destroy(type, handle, *entry);
+	handles[type].erase(entry->key);
+	entries[type].erase(handle);
+}
+
+GLuint ResourceCache::program(const char * vertex_path, const char * fragment_path, const std::string & defines)
+{
+	return program(vertex_path, NULL, NULL, fragment_path, defines);
+}
+
+GLuint ResourceCache::program(const char * vertex_path, const char * control_path, const char * evaluation_path, const char * fragment_path, const std::string & defines)
+{
+	std::string key = std::string(vertex_path) + "|" + (control_path ? control_path : "") + "|" + (evaluation_path ? evaluation_path : "") + "|" + fragment_path + "|" + defines;
+	return acquire(RESOURCE_PROGRAM, key, [=, &defines]() { return ShaderCache::load(vertex_path, control_path, evaluation_path, fragment_path, defines); });
+}
+
+void ResourceCache::begin_loading(ResourceType type, GLuint handle, int parts)
+{
+	Entry * entry = find(type, handle);
+	if (entry) entry->loading += parts;
+}
+
+void ResourceCache::end_loading(ResourceType type, GLuint handle)
+{
+	Entry * entry = find(type, handle);
+	if (entry && entry->loading > 0) entry->loading--;
+}
+
+bool ResourceCache::is_loaded(ResourceType type, GLuint handle)
+{
+	Entry * entry = find(type, handle);
+	return entry == NULL || entry->loading == 0;	// Uncached handles are whatever the caller made them
+}
+
+void ResourceCache::add_size(ResourceType type, GLuint handle, size_t bytes)
+{
+	Entry * entry = find(type, handle);
+	if (entry) entry->bytes += bytes;
+}
+
+void ResourceCache::attach_buffers(GLuint mesh, const std::vector<GLuint> & buffers, const std::vector<MeshLod> & lods, const MeshBounds & bounds)
+{
+	Entry * entry = find(RESOURCE_MESH, mesh);
+	if (entry == NULL) return;
+	entry->buffers = buffers;
+	entry->lods = lods;
+	entry->bounds = bounds;
+}
+
+const std::vector<MeshLod> & ResourceCache::lods(GLuint mesh)
+{
+	static const std::vector<MeshLod> none;
+	Entry * entry = find(RESOURCE_MESH, mesh);
+	return entry ? entry->lods : none;
+}
+
+const MeshBounds & ResourceCache::bounds(GLuint mesh)
+{
+	static const MeshBounds none = { glm::mat4(1.0f), glm::vec3(0.0f), glm::vec3(0.0f), 0.0f };
+	Entry * entry = find(RESOURCE_MESH, mesh);
+	return entry ? entry->bounds : none;
+}
+
+void ResourceCache::report()
+{
+	const char * names[RESOURCE_TYPES] = { "textures", "buffers", "meshes", "programs" };
+	printf("%-10s %8s %8s %8s %10s %9s\n", "resource", "resident", "users", "loading", "MB", "hit rate");
+	for (int type = 0; type < RESOURCE_TYPES; type++)
+	{
+		int users = 0, loading = 0;
+		size_t bytes = 0;
+		for (std::unordered_map<GLuint, Entry>::iterator it = entries[type].begin(); it != entries[type].end(); ++it)
+		{
+			users += it->second.refs;
+			loading += it->second.loading > 0 ? 1 : 0;
+			bytes += it->second.bytes;
+		}
+		int requests = hits[type] + misses[type];
+		printf("%-10s %8d %8d %8d %10.2f %8.1f%%\n", names[type], (int)entries[type].size(), users, loading,
+			bytes / (1024.0 * 1024.0), requests > 0 ? 100.0 * hits[type] / requests : 0.0);
+	}
+}
+
+ResourceCache::Entry * ResourceCache::find(ResourceType type, GLuint handle)
+{
+	if (handle == 0) return NULL;
+	std::unordered_map<GLuint, Entry>::iterator it = entries[type].find(handle);
+	return it == entries[type].end() ? NULL : &it->second;
+}
+
+void ResourceCache::destroy(ResourceType type, GLuint handle, Entry & entry)
+{
+	switch (type)
+	{
+	case RESOURCE_TEXTURE:
+		glDeleteTextures(1, &handle);
+		break;
+	case RESOURCE_BUFFER:
+		glDeleteBuffers(1, &handle);
+		break;
+	case RESOURCE_MESH:
+		glDeleteVertexArrays(1, &handle);
+		if (!entry.buffers.empty()) glDeleteBuffers((GLsizei)entry.buffers.size(), &entry.buffers[0]);
+		break;
+	case RESOURCE_PROGRAM:
+		glDeleteProgram(handle);
+		break;
+	default:
+		break;
+	}
+}
@@ -0,0 +1,84 @@
+#pragma once
+#ifndef _RESOURCECACHE_H_
+#define _RESOURCECACHE_H_
+
+#define GLFW_INCLUDE_GLEXT
+#ifdef __APPLE__
+#define GLFW_INCLUDE_GLCOREARB
+#else
+#include <GL/glew.h>
+#endif
+#include <GLFW/glfw3.h>
+
+#include <glm/vec3.hpp>
+#include <glm/mat4x4.hpp>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "MeshSimplifier.h"
+
+enum ResourceType
+{
+	RESOURCE_TEXTURE,
+	RESOURCE_BUFFER,
+	RESOURCE_MESH,		// A VAO plus the buffers attached to it
+	RESOURCE_PROGRAM,
+	RESOURCE_TYPES
+};
+
+// What a shared mesh's users need besides the buffers, worked out once by whoever parsed it
+struct MeshBounds
+{
+	glm::mat4 transform;	// Centres the model and scales its longest side to 10
+	glm::vec3 min, max;		// Model space, before transform
+	float radius;			// Bounding sphere after transform
+};
+
+// Reference counted GL objects keyed by where they came from (path plus whatever parameters change
+// the result). The first acquire creates the object, later ones share the same handle, and the
+// last release deletes it. Main thread only, like every other GL call.
+class ResourceCache
+{
+public:
+	// Shared handle for key, create() makes it on a miss. created tells the caller whether it has to fill it in.
+	static GLuint acquire(ResourceType type, const std::string & key, std::function<GLuint()> create, bool * created = NULL);
+	static void release(ResourceType type, GLuint handle);
+	static GLuint program(const char * vertex_path, const char * fragment_path, const std::string & defines = "");	// Shared ShaderCache::load
+	static GLuint program(const char * vertex_path, const char * control_path, const char * evaluation_path, const char * fragment_path, const std::string & defines = "");
+
+	// Whoever created a resource marks it loading until its data is in, sharers wait on is_loaded
+	static void begin_loading(ResourceType type, GLuint handle, int parts);
+	static void end_loading(ResourceType type, GLuint handle);
+	static bool is_loaded(ResourceType type, GLuint handle);
+
+	static void add_size(ResourceType type, GLuint handle, size_t bytes);	// Bytes resident on the GPU, for the report
+	static void attach_buffers(GLuint mesh, const std::vector<GLuint> & buffers, const std::vector<MeshLod> & lods, const MeshBounds & bounds);	// Deleted along with the VAO
+	static const std::vector<MeshLod> & lods(GLuint mesh);	// Index ranges of the mesh's levels of detail
+	static const MeshBounds & bounds(GLuint mesh);
+
+	static void report();
+
+private:
+	struct Entry
+	{
+		std::string key;
+		int refs;
+		int loading;
+		size_t bytes;
+		std::vector<GLuint> buffers;
+		std::vector<MeshLod> lods;
+		MeshBounds bounds;
+	};
+
+	static std::unordered_map<std::string, GLuint> handles[RESOURCE_TYPES];
+	static std::unordered_map<GLuint, Entry> entries[RESOURCE_TYPES];
+	static int hits[RESOURCE_TYPES];
+	static int misses[RESOURCE_TYPES];
+
+	static Entry * find(ResourceType type, GLuint handle);
+	static void destroy(ResourceType type, GLuint handle, Entry & entry);
+};
+
+#endif
@@ -0,0 +1,264 @@
+#include "ShaderCache.h"
+#include "shader.h"
+#include "VFS.h"
+#include "Profiler.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <iostream>
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#include <sys/types.h>
+#endif
+
+// Binary cache file: this header, then the driver's program binary
+struct ShaderCacheHeader
+{
+	char magic[4];	// "GLPB"
+	unsigned int version;
+	unsigned long long key;	// Full hash, the file name could collide with something else's
+	unsigned int format;	// Driver specific binary format from glGetProgramBinary
+	unsigned int length;
+};
+
+std::vector<ShaderCache::Compile> ShaderCache::compiling;
+std::string ShaderCache::driver;
+bool ShaderCache::binaries = false;
+bool ShaderCache::parallel = false;
+long long ShaderCache::setup_start = -1;
+int ShaderCache::from_cache = 0;
+int ShaderCache::compiled = 0;
+bool ShaderCache::reported = false;
+
+// FNV-1a, continued over several strings
+static unsigned long long hash_string(unsigned long long hash, const char * data, size_t size)
+{
+	for (size_t i = 0; i < size; i++)
+	{
+		hash ^= (unsigned char)data[i];
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+void ShaderCache::init()
+{
+	driver = std::string((const char *)glGetString(GL_VENDOR)) + "|" + (const char *)glGetString(GL_RENDERER) + "|" + (const char *)glGetString(GL_VERSION);
+
+	GLint formats = 0;
+#ifdef __APPLE__
+	glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+#else
+	if (GLEW_ARB_get_program_binary) glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+
+	// Let the driver use as many compiler threads as it likes
+	if (GLEW_KHR_parallel_shader_compile)
+	{
+		glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+		parallel = true;
+	}
+	else if (GLEW_ARB_parallel_shader_compile)
+	{
+		glMaxShaderCompilerThreadsARB(0xFFFFFFFF);
+		parallel = true;
+	}
+#endif
+	binaries = formats > 0;
+	std::cout << "Shader cache: program binaries " << (binaries ? "on" : "unsupported") << ", parallel compile " << (parallel ? "on" : "unsupported") << std::endl;
+}
+
+void ShaderCache::cache_path(unsigned long long key, char * out, int size)
+{
+	snprintf(out, size, "%s/%016llx.bin", SHADER_CACHE_DIR, key);
+}
+
+// GLSL wants #version before anything else, so the defines go on the line after it
+std::string ShaderCache::add_defines(const std::string & code, const std::string & defines)
+{
+	if (defines.empty()) return code;
+	size_t version = code.find("#version");
+	if (version == std::string::npos) return defines + code;
+	size_t line_end = code.find('\n', version);
+	if (line_end == std::string::npos) return code + "\n" + defines;
+	return code.substr(0, line_end + 1) + defines + code.substr(line_end + 1);
+}
+
+GLuint ShaderCache::load(const char * vertex_path, const char * fragment_path, const std::string & defines)
+{
+	return load(vertex_path, NULL, NULL, fragment_path, defines);
+}
+
+GLuint ShaderCache::load(const char * vertex_path, const char * control_path, const char * evaluation_path, const char * fragment_path, const std::string & defines)
+{
+	PROFILE_ZONE("ShaderCache::load");
+	if (setup_start < 0) setup_start = Profiler::now();
+
+	// Pipeline order, the tessellation stages can be missing
+	const char * paths[4] = { vertex_path, control_path, evaluation_path, fragment_path };
+	std::string code[4];
+	for (int i = 0; i < 4; i++)
+	{
+		if (paths[i] == NULL) continue;
+		VFSFile file;
+		if (!VFS::open(paths[i], file))
+		{
+			std::cerr << "could not open shader " << paths[i] << std::endl;
+			return 0;
+		}
+		code[i] = add_defines(std::string(file.data(), file.size()), defines);
+	}
+
+	// Anything that changes the binary goes into the key, the defines are part of the code by now.
+	// Each stage hashes its terminator too so the boundaries between stages count.
+	unsigned long long key = 14695981039346656037ull;
+	key = hash_string(key, driver.c_str(), driver.size() + 1);
+	for (int i = 0; i < 4; i++) key = hash_string(key, code[i].c_str(), code[i].size() + 1);
+
+	if (binaries)
+	{
+		GLuint program = load_binary(key);
+		if (program != 0)
+		{
+			from_cache++;
+			return program;
+		}
+	}
+
+	// Miss, compile from source. The handle is valid straight away but not usable until update() finishes it.
+	Compile compile;
+	compile.program = StartProgram(code[0].c_str(), code[3].c_str(), binaries, control_path ? code[1].c_str() : NULL, evaluation_path ? code[2].c_str() : NULL);
+	compile.name = vertex_path;
+	for (int i = 1; i < 4; i++)
+	{
+		if (paths[i]) compile.name += std::string(" + ") + paths[i];
+	}
+	if (!defines.empty()) compile.name += " [" + features_name(defines) + "]";
+	std::cout << "Compiling " << compile.name << (parallel ? " in the background" : "") << std::endl;
+	compile.key = key;
+	if (parallel) compiling.push_back(compile);
+	else finish(compile);
+	return compile.program;
+}
+
+// "#define TOON\n#define SKYBOX\n" -> "TOON SKYBOX", for the log
+std::string ShaderCache::features_name(const std::string & defines)
+{
+	std::string name;
+	size_t start = 0;
+	while (start < defines.size())
+	{
+		size_t end = defines.find('\n', start);
+		if (end == std::string::npos) end = defines.size();
+		std::string line = defines.substr(start, end - start);
+		if (line.compare(0, 8, "#define ") == 0) line = line.substr(8);
+		if (!line.empty()) name += (name.empty() ? "" : " ") + line;
+		start = end + 1;
+	}
+	return name;
+}
+
+void ShaderCache::update()
+{
+	for (size_t i = 0; i < compiling.size();)
+	{
+		GLint done = GL_FALSE;
+		glGetProgramiv(compiling[i].program, GL_COMPLETION_STATUS_KHR, &done);
+		if (!done)
+		{
+			i++;
+			continue;
+		}
+		finish(compiling[i]);
+		compiling.erase(compiling.begin() + i);
+	}
+
+	if (!reported && compiling.empty() && setup_start >= 0)
+	{
+		reported = true;
+		printf("Shader setup took %.1f ms: %d programs from the binary cache, %d compiled%s\n", (Profiler::now() - setup_start) / 1000.0,
+			from_cache, compiled, parallel ? " in parallel" : "");
+	}
+}
+
+void ShaderCache::finish(const Compile & compile)
+{
+	std::cout << "Finishing " << compile.name << std::endl;
+	compiled++;
+	if (FinishProgram(compile.program) && binaries) save_binary(compile.program, compile.key);
+}
+
+GLuint ShaderCache::load_binary(unsigned long long key)
+{
+	char path[256];
+	cache_path(key, path, sizeof(path));
+	VFSFile file;
+	if (!VFS::open(path, file)) return 0;
+
+	ShaderCacheHeader header;
+	if (file.size() < sizeof(header)) return 0;
+	memcpy(&header, file.data(), sizeof(header));
+	if (memcmp(header.magic, "GLPB", 4) != 0 || header.version != SHADER_CACHE_VERSION || header.key != key || file.size() != sizeof(header) + header.length)
+	{
+		std::cerr << path << " is not a cached program for these shaders, recompiling" << std::endl;
+		return 0;
+	}
+
+	// The driver can still refuse a binary it wrote itself, e.g. after an update that kept the version string
+	GLuint program = glCreateProgram();
+	glProgramBinary(program, header.format, file.data() + sizeof(header), (GLsizei)header.length);
+	GLint linked = GL_FALSE;
+	glGetProgramiv(program, GL_LINK_STATUS, &linked);
+	if (linked != GL_TRUE)
+	{
+		std::cout << path << " was rejected by the driver, recompiling" << std::endl;
+		glDeleteProgram(program);
+		return 0;
+	}
+	return program;
+}
+
+void ShaderCache::save_binary(GLuint program, unsigned long long key)
+{
+	PROFILE_ZONE("ShaderCache::save_binary");
+	GLint length = 0;
+	glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+	if (length <= 0) return;
+	std::vector<char> binary(length);
+	GLenum format = 0;
+	GLsizei written = 0;
+	glGetProgramBinary(program, length, &written, &format, &binary[0]);
+	if (written <= 0) return;
+
+	ShaderCacheHeader header;
+	memcpy(header.magic, "GLPB", 4);
+	header.version = SHADER_CACHE_VERSION;
+	header.key = key;
+	header.format = format;
+	header.length = (unsigned int)written;
+
+#ifdef _WIN32
+	_mkdir(SHADER_CACHE_DIR);
+#else
+	mkdir(SHADER_CACHE_DIR, 0755);
+#endif
+	// Write to a temporary file and swap it in, so a crash never leaves a half written binary behind
+	char path[256], temp[264];
+	cache_path(key, path, sizeof(path));
+	snprintf(temp, sizeof(temp), "%s.tmp", path);
+	FILE * fp = fopen(temp, "wb");
+	if (fp == NULL)
+	{
+		std::cerr << "could not write program binary " << temp << std::endl;
+		return;
+	}
+	bool ok = fwrite(&header, sizeof(header), 1, fp) == 1 && fwrite(&binary[0], 1, written, fp) == (size_t)written;
+	ok = fclose(fp) == 0 && ok;
+	remove(path);	// rename won't replace an existing file on Windows
+	if (!ok || rename(temp, path) != 0)
+	{
+		std::cerr << "could not write program binary " << path << std::endl;
+		remove(temp);
+	}
+}
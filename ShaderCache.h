@@ -0,0 +1,62 @@
+#pragma once
+#ifndef _SHADERCACHE_H_
+#define _SHADERCACHE_H_
+
+#define GLFW_INCLUDE_GLEXT
+#ifdef __APPLE__
+#define GLFW_INCLUDE_GLCOREARB
+#else
+#include <GL/glew.h>
+#endif
+#include <GLFW/glfw3.h>
+
+#include <string>
+#include <vector>
+
+#define SHADER_CACHE_DIR "../shader_cache"	// Linked program binaries, one file per program
+#define SHADER_CACHE_VERSION 1
+
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
+// Linked programs cached on disk with glGetProgramBinary, keyed by a hash of both sources and the
+// driver (vendor, renderer, version), so a driver update or an edited shader just misses. On a miss
+// the program is compiled from source, in the background when KHR_parallel_shader_compile is there,
+// and its binary written out once it has linked. defines (a block of #define lines) goes in right
+// after #version, so each shader permutation is its own program with its own cache entry. Main thread only.
+class ShaderCache
+{
+public:
+	static void init();	// Needs the GL context
+	static GLuint load(const char * vertex_path, const char * fragment_path, const std::string & defines = "");
+	static GLuint load(const char * vertex_path, const char * control_path, const char * evaluation_path, const char * fragment_path, const std::string & defines = "");	// With tessellation stages
+	static void update();	// Finish programs whose background compile is done, once per frame
+	static int pending() { return (int)compiling.size(); }	// Programs not usable yet
+
+private:
+	struct Compile
+	{
+		GLuint program;
+		std::string name;
+		unsigned long long key;
+	};
+
+	static std::vector<Compile> compiling;
+	static std::string driver;
+	static bool binaries;	// Driver can hand back program binaries
+	static bool parallel;	// Compiles and links run on driver threads
+	static long long setup_start;
+	static int from_cache;
+	static int compiled;
+	static bool reported;
+
+	static std::string add_defines(const std::string & code, const std::string & defines);
+	static std::string features_name(const std::string & defines);
+	static void cache_path(unsigned long long key, char * out, int size);
+	static GLuint load_binary(unsigned long long key);
+	static void save_binary(GLuint program, unsigned long long key);
+	static void finish(const Compile & compile);
+};
+
+#endif
@@ -0,0 +1,55 @@
+#include "ShaderVariants.h"
+#include "ResourceCache.h"
+
+#include <iostream>
+
+static const char * feature_names[SHADER_FEATURE_COUNT] = { "TOON", "SKYBOX", "NORMALS", "FLAT", "UNLIT", "DEPTH_ONLY" };
+
+ShaderVariants::ShaderVariants(const char * vertex_path, const char * fragment_path) : vertex_path(vertex_path), fragment_path(fragment_path)
+{
+	for (int i = 0; i < SHADER_VARIANTS; i++) programs[i] = 0;
+}
+
+ShaderVariants::ShaderVariants(const char * vertex_path, const char * control_path, const char * evaluation_path, const char * fragment_path) :
+	vertex_path(vertex_path), control_path(control_path), evaluation_path(evaluation_path), fragment_path(fragment_path)
+{
+	for (int i = 0; i < SHADER_VARIANTS; i++) programs[i] = 0;
+}
+
+ShaderVariants::~ShaderVariants()
+{
+	for (int i = 0; i < SHADER_VARIANTS; i++)
+	{
+		if (programs[i] != 0) ResourceCache::release(RESOURCE_PROGRAM, programs[i]);
+	}
+}
+
+std::string ShaderVariants::defines(unsigned int features)
+{
+	std::string block;
+	for (int i = 0; i < SHADER_FEATURE_COUNT; i++)
+	{
+		if (features & (1u << i)) block += std::string("#define ") + feature_names[i] + "\n";
+	}
+	return block;
+}
+
+void ShaderVariants::prepare(unsigned int features)
+{
+	features &= SHADER_VARIANTS - 1;
+	if (programs[features] != 0) return;
+	programs[features] = ResourceCache::program(vertex_path.c_str(), control_path.empty() ? NULL : control_path.c_str(),
+		evaluation_path.empty() ? NULL : evaluation_path.c_str(), fragment_path.c_str(), defines(features));
+}
+
+GLuint ShaderVariants::get(unsigned int features)
+{
+	features &= SHADER_VARIANTS - 1;
+	if (programs[features] == 0)
+	{
+		// Missed by prepare(). The display loop holds frames while ShaderCache has compiles pending, like at startup.
+		std::cout << "Variant 0x" << std::hex << features << std::dec << " of " << fragment_path << " was not prepared, compiling it now" << std::endl;
+		prepare(features);
+	}
+	return programs[features];
+}
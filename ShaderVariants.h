@@ -0,0 +1,52 @@
+#pragma once
+#ifndef _SHADERVARIANTS_H_
+#define _SHADERVARIANTS_H_
+
+#define GLFW_INCLUDE_GLEXT
+#ifdef __APPLE__
+#define GLFW_INCLUDE_GLCOREARB
+#else
+#include <GL/glew.h>
+#endif
+#include <GLFW/glfw3.h>
+
+#include <string>
+
+// Feature bits, each one set becomes a #define of the same name in both shaders
+enum ShaderFeature
+{
+	FEATURE_TOON = 1 << 0,		// Banded diffuse/specular and black silhouettes
+	FEATURE_SKYBOX = 1 << 1,	// shader.*: cube map lookup, view without translation
+	FEATURE_NORMALS = 1 << 2,	// shader.frag: normals as colour
+	FEATURE_FLAT = 1 << 3,		// shader.frag: solid black, for the curves
+	FEATURE_UNLIT = 1 << 4,		// terrainShader.frag: just the texture
+	FEATURE_DEPTH_ONLY = 1 << 5,	// Fragment shaders do nothing, for the depth prepass
+};
+#define SHADER_FEATURE_COUNT 6
+#define SHADER_VARIANTS (1 << SHADER_FEATURE_COUNT)
+
+// One vertex/fragment pair compiled once per feature combination instead of branching on uniforms
+// in every fragment. Variants come from ResourceCache::program, so they share the binary cache.
+// prepare() the ones a scene can switch between up front, a variant first asked for in get() is
+// only compiled then. Main thread only.
+class ShaderVariants
+{
+public:
+	ShaderVariants(const char * vertex_path, const char * fragment_path);
+	ShaderVariants(const char * vertex_path, const char * control_path, const char * evaluation_path, const char * fragment_path);
+	~ShaderVariants();	// Releases every variant it made
+
+	void prepare(unsigned int features);	// Start compiling now so switching to it later is free
+	GLuint get(unsigned int features);		// Program for exactly these features
+
+	static std::string defines(unsigned int features);
+
+private:
+	std::string vertex_path;
+	std::string control_path;		// Tessellation stages, empty when there are none
+	std::string evaluation_path;
+	std::string fragment_path;
+	GLuint programs[SHADER_VARIANTS];
+};
+
+#endif
@@ -0,0 +1,160 @@
+#include "Simulation.h"
+#include "Water.h"
+#include "Profiler.h"
+
+#include <chrono>
+
+SimState Simulation::previous;
+SimState Simulation::current;
+std::mutex Simulation::lock;
+std::thread Simulation::worker;
+std::atomic<bool> Simulation::running(false);
+bool Simulation::threaded = false;
+bool Simulation::fixed = false;
+double Simulation::fixed_time = 0.0;
+double Simulation::clock_offset = 0.0;
+
+static const std::chrono::steady_clock::time_point sim_epoch = std::chrono::steady_clock::now();
+
+static double wall_time()
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - sim_epoch).count();
+}
+
+double Simulation::now()
+{
+	if (fixed) return fixed_time;
+	return wall_time() - clock_offset;
+}
+
+void Simulation::use_fixed_clock(bool fixed)
+{
+	if (fixed)
+	{
+		// Same starting state every time, the worker thread would step on wall clock time
+		stop();
+		fixed_time = 0.0;
+		Simulation::fixed = true;
+		current.time = 0.0;
+		current.wave_offset = 0.0;
+		start(false);
+	}
+	else if (Simulation::fixed)
+	{
+		clock_offset = wall_time() - fixed_time;
+		Simulation::fixed = false;
+	}
+}
+
+void Simulation::tick(double seconds)
+{
+	if (fixed) fixed_time += seconds;
+}
+
+void Simulation::start(bool threaded)
+{
+	stop();
+
+	// Keep animating from where we left off (restarts switch threading modes), with the
+	// previous state one step in the past so interpolation is valid
+	std::lock_guard<std::mutex> guard(lock);
+	current.time = now();
+	previous = current;
+	previous.time -= SIM_TIMESTEP;
+
+	Simulation::threaded = threaded && !fixed;
+	if (Simulation::threaded)
+	{
+		running = true;
+		worker = std::thread(run);
+	}
+}
+
+void Simulation::stop()
+{
+	running = false;
+	if (worker.joinable()) worker.join();
+	threaded = false;
+}
+
+bool Simulation::is_threaded()
+{
+	return threaded;
+}
+
+void Simulation::step(const SimState & in, SimState & out)
+{
+	PROFILE_ZONE("simulation step");
+	out = in;
+	out.time = in.time + SIM_TIMESTEP;
+	out.wave_offset = in.wave_offset + WAVE_SPEED * SIM_TIMESTEP;
+}
+
+bool Simulation::step_if_due(double time)
+{
+	SimState base;
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		if (current.time + SIM_TIMESTEP > time) return false;
+		base = current;
+	}
+
+	// After a long hitch (loading, window drag) skip ahead instead of running hundreds of steps
+	if (time - base.time > SIM_MAX_CATCH_UP) base.time = time - SIM_TIMESTEP;
+
+	// Step outside the lock so rendering never waits on the simulation
+	SimState next;
+	step(base, next);
+
+	std::lock_guard<std::mutex> guard(lock);
+	previous = base;
+	current = next;
+	return true;
+}
+
+void Simulation::advance()
+{
+	if (threaded) return;
+
+	double time = now();
+	while (step_if_due(time)) {}
+}
+
+void Simulation::run()
+{
+	Profiler::set_thread_name("simulation");
+	while (running)
+	{
+		double time = now();
+		if (step_if_due(time)) continue;
+
+		// Sleep until the next step is due
+		double due;
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			due = current.time + SIM_TIMESTEP;
+		}
+		std::this_thread::sleep_for(std::chrono::duration<double>(due - time));
+	}
+}
+
+SimState Simulation::render_state()
+{
+	double time = now();
+	SimState a, b;
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		a = previous;
+		b = current;
+	}
+
+	// Render one step behind the simulation, blending the two newest states
+	double alpha = (time - b.time) / SIM_TIMESTEP;
+	if (alpha < 0.0) alpha = 0.0;
+	if (alpha > 1.0) alpha = 1.0;
+
+	SimState state;
+	state.time = a.time + (b.time - a.time) * alpha;
+	state.wave_offset = a.wave_offset + (b.wave_offset - a.wave_offset) * alpha;
+	return state;
+}
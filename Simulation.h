@@ -0,0 +1,52 @@
+#pragma once
+#ifndef _SIMULATION_H_
+#define _SIMULATION_H_
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+
+#define SIM_TIMESTEP (1.0 / 120.0)	// Seconds per simulation step
+#define SIM_MAX_CATCH_UP 0.25		// Drop simulation time past this much lag instead of spiraling
+
+// Everything that animates over time. Kept as plain data so it can be stepped on another thread
+// and copied out for rendering.
+struct SimState
+{
+	double time;		// Simulation time of this state in seconds
+	double wave_offset;	// Water ripple offset (move_factor), unwrapped so it interpolates cleanly
+};
+
+// Fixed-timestep update loop. The last two states are kept so rendering can interpolate between
+// them at any frame rate. Steps either run from idle_callback or on a dedicated thread.
+class Simulation
+{
+public:
+	static void start(bool threaded);
+	static void stop();
+	static bool is_threaded();
+	static void advance();			// Run any steps that are due (single threaded mode only)
+	static SimState render_state();	// State interpolated to the current time
+
+	// Replays: starts over from time 0 on the main thread, and time only moves with tick()
+	static void use_fixed_clock(bool fixed);
+	static void tick(double seconds);
+
+private:
+	static SimState previous;
+	static SimState current;
+	static std::mutex lock;
+	static std::thread worker;
+	static std::atomic<bool> running;
+	static bool threaded;
+	static bool fixed;
+	static double fixed_time;
+	static double clock_offset;	// Wall clock time the fixed clock skipped, so time carries on after it
+
+	static double now();
+	static void step(const SimState & in, SimState & out);
+	static void run();
+	static bool step_if_due(double time);
+};
+
+#endif
@@ -0,0 +1,180 @@
+#include "Spline.h"
+
+#include <math.h>
+#include <algorithm>
+
+float ArcLengthTable::parameter_at(float distance) const
+{
+	if (lengths.empty()) return 0.0f;
+	if (distance <= 0.0f) return parameters.front();
+	if (distance >= lengths.back()) return parameters.back();
+
+	// First entry past the distance, then linear between it and the one before
+	size_t i = std::upper_bound(lengths.begin(), lengths.end(), distance) - lengths.begin();
+	float span = lengths[i] - lengths[i - 1];
+	float f = span > 0.0f ? (distance - lengths[i - 1]) / span : 0.0f;
+	return parameters[i - 1] + f * (parameters[i] - parameters[i - 1]);
+}
+
+Spline::Spline(SplineType type, bool closed) : type(type), closed(closed)
+{
+}
+
+glm::vec3 Spline::point(int i) const
+{
+	int n = (int)points.size();
+	if (closed) return points[((i % n) + n) % n];
+	return points[std::min(std::max(i, 0), n - 1)];
+}
+
+int Spline::segment_count() const
+{
+	int n = (int)points.size();
+	switch (type)
+	{
+	case SPLINE_BEZIER: return closed ? n / 3 : (n - 1) / 3;
+	case SPLINE_CATMULL_ROM: return closed ? (n > 2 ? n : 0) : std::max(n - 1, 0);
+	default: return closed ? (n > 3 ? n : 0) : std::max(n - 3, 0);
+	}
+}
+
+void Spline::segment(int i, glm::vec3 out[4]) const
+{
+	switch (type)
+	{
+	case SPLINE_BEZIER:
+		for (int k = 0; k < 4; k++) out[k] = point(3 * i + k);
+		break;
+	case SPLINE_CATMULL_ROM:
+	{
+		// Tangent at each point is half the difference of its neighbours
+		glm::vec3 p0 = point(i - 1), p1 = point(i), p2 = point(i + 1), p3 = point(i + 2);
+		out[0] = p1;
+		out[1] = p1 + (p2 - p0) / 6.0f;
+		out[2] = p2 - (p3 - p1) / 6.0f;
+		out[3] = p2;
+		break;
+	}
+	default:
+	{
+		glm::vec3 p0 = point(i), p1 = point(i + 1), p2 = point(i + 2), p3 = point(i + 3);
+		out[0] = (p0 + 4.0f * p1 + p2) / 6.0f;
+		out[1] = (4.0f * p1 + 2.0f * p2) / 6.0f;
+		out[2] = (2.0f * p1 + 4.0f * p2) / 6.0f;
+		out[3] = (p1 + 4.0f * p2 + p3) / 6.0f;
+		break;
+	}
+	}
+}
+
+glm::vec3 Spline::bezier(const glm::vec3 control[4], float t)
+{
+	float s = 1.0f - t;
+	return s * s * s * control[0] + 3.0f * s * s * t * control[1] + 3.0f * s * t * t * control[2] + t * t * t * control[3];
+}
+
+void Spline::locate(float t, int & i, float & local) const
+{
+	int segments = segment_count();
+	t = std::min(std::max(t, 0.0f), (float)segments);
+	i = std::min((int)floor(t), segments - 1);
+	local = t - i;
+}
+
+glm::vec3 Spline::evaluate(float t) const
+{
+	if (segment_count() == 0) return points.empty() ? glm::vec3(0.0f) : points[0];
+	int i;
+	float local;
+	locate(t, i, local);
+	glm::vec3 control[4];
+	segment(i, control);
+	return bezier(control, local);
+}
+
+glm::vec3 Spline::tangent(float t) const
+{
+	if (segment_count() == 0) return glm::vec3(0.0f);
+	int i;
+	float local;
+	locate(t, i, local);
+	glm::vec3 c[4];
+	segment(i, c);
+	float s = 1.0f - local;
+	return 3.0f * (s * s * (c[1] - c[0]) + 2.0f * s * local * (c[2] - c[1]) + local * local * (c[3] - c[2]));
+}
+
+// The curve stays inside its control hull, so when both inner points are within tolerance of the
+// chord so is every point of the curve. Otherwise split in half (de Casteljau) and try each half.
+void Spline::flatten_segment(const glm::vec3 control[4], float t0, float t1, float tolerance, int depth, std::vector<glm::vec3> & out, std::vector<float> * parameters)
+{
+	glm::vec3 chord = control[3] - control[0];
+	float chord_length2 = glm::dot(chord, chord);
+	float error = 0.0f;
+	for (int k = 1; k < 3; k++)
+	{
+		glm::vec3 offset = control[k] - control[0];
+		float f = chord_length2 > 0.0f ? std::min(std::max(glm::dot(offset, chord) / chord_length2, 0.0f), 1.0f) : 0.0f;
+		error = std::max(error, glm::length(offset - f * chord));
+	}
+
+	if (error <= tolerance || depth >= SPLINE_MAX_DEPTH)
+	{
+		out.push_back(control[3]);
+		if (parameters) parameters->push_back(t1);
+		return;
+	}
+
+	glm::vec3 ab = 0.5f * (control[0] + control[1]), bc = 0.5f * (control[1] + control[2]), cd = 0.5f * (control[2] + control[3]);
+	glm::vec3 abc = 0.5f * (ab + bc), bcd = 0.5f * (bc + cd);
+	glm::vec3 middle = 0.5f * (abc + bcd);
+	glm::vec3 left[4] = { control[0], ab, abc, middle };
+	glm::vec3 right[4] = { middle, bcd, cd, control[3] };
+	float tm = 0.5f * (t0 + t1);
+	flatten_segment(left, t0, tm, tolerance, depth + 1, out, parameters);
+	flatten_segment(right, tm, t1, tolerance, depth + 1, out, parameters);
+}
+
+void Spline::flatten(float tolerance, std::vector<glm::vec3> & out, std::vector<float> * parameters) const
+{
+	int segments = segment_count();
+	if (segments == 0) return;
+	tolerance = std::max(tolerance, 1e-6f);
+
+	glm::vec3 control[4];
+	segment(0, control);
+	out.push_back(control[0]);
+	if (parameters) parameters->push_back(0.0f);
+	for (int i = 0; i < segments; i++)
+	{
+		if (i > 0) segment(i, control);
+		flatten_segment(control, (float)i, (float)(i + 1), tolerance, 0, out, parameters);
+	}
+}
+
+void Spline::arc_length(float tolerance, ArcLengthTable & table) const
+{
+	std::vector<glm::vec3> flat;
+	table.parameters.clear();
+	table.lengths.clear();
+	flatten(tolerance, flat, &table.parameters);
+	table.lengths.resize(flat.size());
+	float distance = 0.0f;
+	for (size_t i = 0; i < flat.size(); i++)
+	{
+		if (i > 0) distance += glm::length(flat[i] - flat[i - 1]);
+		table.lengths[i] = distance;
+	}
+}
+
+void Spline::sample_uniform(const ArcLengthTable & table, int count, std::vector<glm::vec3> & out) const
+{
+	if (count <= 0) return;
+	if (count == 1)
+	{
+		out.push_back(evaluate(table.parameter_at(0.0f)));
+		return;
+	}
+	float length = table.length();
+	for (int k = 0; k < count; k++) out.push_back(evaluate(table.parameter_at(length * k / (count - 1))));
+}
@@ -0,0 +1,65 @@
+#pragma once
+#ifndef _SPLINE_H_
+#define _SPLINE_H_
+
+// Use of degrees is deprecated. Use radians instead.
+#ifndef GLM_FORCE_RADIANS
+#define GLM_FORCE_RADIANS
+#endif
+#include <glm/glm.hpp>
+
+#include <vector>
+
+#define SPLINE_MAX_DEPTH 16	// Subdivision limit when flattening, 2^16 pieces per segment at most
+
+enum SplineType
+{
+	SPLINE_BEZIER,		// Cubic pieces sharing end points: 3n + 1 points open, 3n closed
+	SPLINE_CATMULL_ROM,	// Passes through every point, n - 1 segments open (end tangents from the end pair), n closed
+	SPLINE_BSPLINE		// Uniform cubic, C2 but doesn't touch the points, n - 3 segments open, n closed
+};
+
+// Distance along a flattened spline against the spline's parameter, for sampling at constant speed
+struct ArcLengthTable
+{
+	std::vector<float> parameters;	// Global parameter, segment index + local t
+	std::vector<float> lengths;		// Distance from the start, same size, first is 0
+
+	float length() const { return lengths.empty() ? 0.0f : lengths.back(); }
+	float parameter_at(float distance) const;	// Clamped to the ends
+};
+
+// A chain of cubic segments of any count. Every segment type is converted to its Bezier control
+// points, so evaluation, flattening and arc length only deal with cubic Bezier pieces.
+// Global parameter t runs 0..segment_count(), segment i covers [i, i + 1].
+class Spline
+{
+public:
+	Spline(SplineType type = SPLINE_CATMULL_ROM, bool closed = false);
+
+	SplineType type;
+	bool closed;
+	std::vector<glm::vec3> points;
+
+	int segment_count() const;
+	void segment(int i, glm::vec3 out[4]) const;	// Bezier control points of segment i
+
+	glm::vec3 evaluate(float t) const;
+	glm::vec3 tangent(float t) const;	// dP/dt, not normalised
+
+	// Appends points until no flattened piece is further than tolerance from the curve, so straight
+	// runs get few points and tight bends many. parameters (optional) gets the global t of each point.
+	void flatten(float tolerance, std::vector<glm::vec3> & out, std::vector<float> * parameters = NULL) const;
+	void arc_length(float tolerance, ArcLengthTable & table) const;
+	// count points at equal distances along the curve, both ends included
+	void sample_uniform(const ArcLengthTable & table, int count, std::vector<glm::vec3> & out) const;
+
+	static glm::vec3 bezier(const glm::vec3 control[4], float t);
+
+private:
+	glm::vec3 point(int i) const;	// Wraps when closed, clamps when open
+	void locate(float t, int & i, float & local) const;
+	static void flatten_segment(const glm::vec3 control[4], float t0, float t1, float tolerance, int depth, std::vector<glm::vec3> & out, std::vector<float> * parameters);
+};
+
+#endif
@@ -1,6 +1,10 @@
 #include "Terrain.h"
 #include "Window.h"
 
+#include "AssetLoader.h"
+#include "TextureUploader.h"
+#include "ResourceCache.h"
+#include "VFS.h"
 #include "soil.h"	// Load in heightmap data using these features
 
 #define TEXTURE_PATH "../assets/textures/sand2.ppm"
@@ -12,10 +16,10 @@ Terrain::Terrain() {
 	xz_size = 1000.0f;
 	height_scale = 10.0f;
 	ground_translate = -9.0f;
-	heightmap_path = "../assets/SanDiegoTerrain.jpg";
+	heightmap_path = HEIGHTMAP_PATH;
+	texture_path = TEXTURE_PATH;
 	
-	loadHeightmap();
-	loadTexture();
+	load();
 }
 
 // Constructor that controls square ground size, ground level, and heightmap path. Loads sand texture
@@ -25,9 +29,9 @@ Terrain::Terrain(float xz_size, float height_scale, float ground_translate, cons
 	this->height_scale = height_scale;
 	this->ground_translate = ground_translate;
 	heightmap_path = hmPath;
+	texture_path = TEXTURE_PATH;
 
-	loadHeightmap();
-	loadTexture();
+	load();
 }
 
 // Constructor that controls square ground size, ground level
@@ -39,8 +43,20 @@ Terrain::Terrain(float xz_size, float height_scale, float ground_translate, cons
 	heightmap_path = hmPath;
 	this->texture_path = texturePath;
 
-	loadHeightmap();
-	loadTexture(texturePath);
+	load();
+}
+
+// Build the terrain mesh and decode its texture on loader threads, then upload both on the main thread
+void Terrain::load() {
+	ready = false;
+	VAO = VBO = NBO = TBO = EBO = 0;	// Safe to delete even if loading never finishes
+	AssetLoader::load([this]() { loadHeightmap(); }, [this]() {
+		if (vertices.empty()) return;
+		init_buffers();
+		ready = true;
+		std::cout << "Heightmap loaded" << std::endl;
+	});
+	loadTexture(texture_path);
 }
 
 Terrain::~Terrain() {
@@ -49,9 +65,9 @@ Terrain::~Terrain() {
 	glDeleteVertexArrays(1, &VAO);
 	glDeleteBuffers(1, &VBO);
 	glDeleteBuffers(1, &NBO);
-	glDeleteBuffers(1, &TBO);
-	glDeleteBuffers(1, &EBO);
-	glDeleteTextures(1, &textureID);
+	ResourceCache::release(RESOURCE_BUFFER, TBO);
+	ResourceCache::release(RESOURCE_BUFFER, EBO);
+	ResourceCache::release(RESOURCE_TEXTURE, textureID);
 }
 
 void Terrain::init_buffers() {
@@ -59,8 +75,13 @@ void Terrain::init_buffers() {
 	glGenVertexArrays(1, &VAO);
 	glGenBuffers(1, &VBO);
 	glGenBuffers(1, &NBO);
-	glGenBuffers(1, &TBO);
-	glGenBuffers(1, &EBO);
+
+	// Tex coords and indices only depend on the heightmap size, terrains with the same size share them
+	char grid[64];
+	snprintf(grid, sizeof(grid), "%dx%d", (int)hMapDimensions.x, (int)hMapDimensions.y);
+	bool tbo_created, ebo_created;
+	TBO = ResourceCache::acquire(RESOURCE_BUFFER, std::string("terrain-texcoords:") + grid, []() { GLuint id; glGenBuffers(1, &id); return id; }, &tbo_created);
+	EBO = ResourceCache::acquire(RESOURCE_BUFFER, std::string("terrain-indices:") + grid, []() { GLuint id; glGenBuffers(1, &id); return id; }, &ebo_created);
 
 	// Bind vertex array buffer
 	glBindVertexArray(VAO);
@@ -81,13 +102,19 @@ void Terrain::init_buffers() {
 
 	// Bind texture coordinate buffer object
 	glBindBuffer(GL_ARRAY_BUFFER, TBO);
-	glBufferData(GL_ARRAY_BUFFER, tex_coords.size() * sizeof(glm::vec2), tex_coords.data(), GL_STATIC_DRAW);
+	if (tbo_created) {
+		glBufferData(GL_ARRAY_BUFFER, tex_coords.size() * sizeof(glm::vec2), tex_coords.data(), GL_STATIC_DRAW);
+		ResourceCache::add_size(RESOURCE_BUFFER, TBO, tex_coords.size() * sizeof(glm::vec2));
+	}
 	glEnableVertexAttribArray(2);
 	glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(GLfloat), (GLvoid*)0);
 
 	// Bind index buffer object
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLuint) * indices.size(), indices.data(), GL_STATIC_DRAW);
+	if (ebo_created) {
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLuint) * indices.size(), indices.data(), GL_STATIC_DRAW);
+		ResourceCache::add_size(RESOURCE_BUFFER, EBO, sizeof(GLuint) * indices.size());
+	}
 
 	// Unbind the currently bound buffer so that we don't accidentally make unwanted changes to it.
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
@@ -152,15 +179,16 @@ will be printed and this function will return 0
 **/
 unsigned char* Terrain::loadPPM(const char* filename, int& width, int& height)
 {
+	PROFILE_ZONE("Terrain::loadPPM");
 	const int BUFSIZE = 128;
-	FILE* fp;
+	VFSFile fp;
 	unsigned int read;
 	unsigned char* rawData;
 	char buf[3][BUFSIZE];
 	char* retval_fgets;
 	size_t retval_sscanf;
 
-	if ((fp = fopen(filename, "rb")) == NULL)
+	if (!VFS::open(filename, fp))
 	{
 		std::cerr << "error reading ppm file, could not locate " << filename << std::endl;
 		width = 0;
@@ -169,12 +197,12 @@ unsigned char* Terrain::loadPPM(const char* filename, int& width, int& height)
 	}
 
 	// Read magic number:
-	retval_fgets = fgets(buf[0], BUFSIZE, fp);
+	retval_fgets = fp.gets(buf[0], BUFSIZE);
 
 	// Read width and height:
 	do
 	{
-		retval_fgets = fgets(buf[0], BUFSIZE, fp);
+		retval_fgets = fp.gets(buf[0], BUFSIZE);
 	} while (buf[0][0] == '#');
 	retval_sscanf = sscanf(buf[0], "%s %s", buf[1], buf[2]);
 	width = atoi(buf[1]);
@@ -183,13 +211,13 @@ unsigned char* Terrain::loadPPM(const char* filename, int& width, int& height)
 	// Read maxval:
 	do
 	{
-		retval_fgets = fgets(buf[0], BUFSIZE, fp);
+		retval_fgets = fp.gets(buf[0], BUFSIZE);
 	} while (buf[0][0] == '#');
 
 	// Read image data:
 	rawData = new unsigned char[width * height * 3];
-	read = fread(rawData, width * height * 3, 1, fp);
-	fclose(fp);
+	read = fp.read(rawData, width * height * 3, 1);
+	fp.close();
 	if (read != 1)
 	{
 		std::cerr << "error parsing ppm file, incomplete data" << std::endl;
@@ -203,11 +231,15 @@ unsigned char* Terrain::loadPPM(const char* filename, int& width, int& height)
 }
 
 void Terrain::loadHeightmap() {
+	PROFILE_ZONE("Terrain::loadHeightmap");
 	int map_width, map_height, channels;	
 	
 	// Get Terrain data and dimensions
-	unsigned char * hmData = SOIL_load_image(heightmap_path, &map_width, &map_height, &channels, SOIL_LOAD_L);
-	if (map_width < 0) { std::cout << "Heightmap not loading correctly!" << std::endl; return; }
+	VFSFile file;
+	unsigned char * hmData = NULL;
+	if (VFS::open(heightmap_path, file))
+		hmData = SOIL_load_image_from_memory((const unsigned char *)file.data(), (int)file.size(), &map_width, &map_height, &channels, SOIL_LOAD_L);
+	if (hmData == NULL || map_width < 0) { std::cout << "Heightmap not loading correctly!" << std::endl; return; }
 
 	// Resize buffers
 	int num_vertices = map_width * map_height;
@@ -248,67 +280,65 @@ void Terrain::loadHeightmap() {
 	// Free up heightmap data
 	SOIL_free_image_data(hmData);
 
-	// Create and load buffers
+	// Create buffers, the GL upload happens later on the main thread
 	genIndexBuff();
 	genNormals();
-	init_buffers();
-
-	std::cout << "Heightmap loaded" << std::endl;
 }
 
 void Terrain::loadTexture() {
-	int twidth, theight, channels;
-	unsigned char* tdata;  // texture pixel data
-
-	// Create ID for texture
-	glGenTextures(1, &textureID);
-
-	// Set this texture to be the one we are working with
-	glBindTexture(GL_TEXTURE_2D, textureID);
-
-	// Some lighting/filtering settings
-	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);	// Don't let bytes be padded
-	glTexEnvf(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);	// set GL_MODULATE to mix texture with polygon color for shading
-
-	tdata = loadPPM(TEXTURE_PATH, twidth, theight);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, twidth, theight, 0, GL_RGB, GL_UNSIGNED_BYTE, tdata);
-
-	// Set bi-linear filtering for both minification and magnification
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-
-	glBindTexture(GL_TEXTURE_2D, 0);
+	loadTexture(TEXTURE_PATH);
 }
 
 void Terrain::loadTexture(const char * texturePath) {
-	int twidth, theight, channels;
-	unsigned char* tdata;  // texture pixel data
-
-	// Create ID for texture
-	glGenTextures(1, &textureID);
+	// Create ID for texture now, the pixels get filled in once they are decoded. Terrains using the same texture share it.
+	bool created;
+	textureID = ResourceCache::acquire(RESOURCE_TEXTURE, std::string("texture2d:repeat:") + texturePath, []() { GLuint id; glGenTextures(1, &id); return id; }, &created);
+	if (!created) return;
+	GLuint texture = textureID;
+	ResourceCache::begin_loading(RESOURCE_TEXTURE, texture, 1);
+
+	std::shared_ptr<DecodedImage> image(new DecodedImage());
+	std::shared_ptr<BakedTexture> baked(new BakedTexture());
+	AssetLoader::load([this, image, baked, texturePath]() {
+		// Prefer the compressed mip chain from --bake, decode the ppm if there isn't one
+		if (!TextureBaker::load(texturePath, *baked))
+			image->data = loadPPM(texturePath, image->width, image->height);
+	}, [image, baked, texture]() {
+		std::function<void()> done = [texture]() { ResourceCache::end_loading(RESOURCE_TEXTURE, texture); };
+		if (image->data == NULL && baked->empty()) {
+			done();
+			return;
+		}
 
-	// Set this texture to be the one we are working with
-	glBindTexture(GL_TEXTURE_2D, textureID);
+		// Set this texture to be the one we are working with
+		glBindTexture(GL_TEXTURE_2D, texture);
 
-	// Some lighting/filtering settings
-	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);	// Don't let bytes be padded
-	glTexEnvf(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);	// set GL_MODULATE to mix texture with polygon color for shading
+		// Some lighting/filtering settings
+		glTexEnvf(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);	// set GL_MODULATE to mix texture with polygon color for shading
 
-	tdata = loadPPM(texturePath, twidth, theight);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, twidth, theight, 0, GL_RGB, GL_UNSIGNED_BYTE, tdata);
+		// Set bi-linear filtering for both minification and magnification
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
 
-	// Set bi-linear filtering for both minification and magnification
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+		glBindTexture(GL_TEXTURE_2D, 0);
 
-	glBindTexture(GL_TEXTURE_2D, 0);
+		// Pixels go through a staging PBO instead of straight from client memory
+		if (!baked->empty()) {
+			ResourceCache::add_size(RESOURCE_TEXTURE, texture, baked->data_size());
+			TextureUploader::upload_compressed(texture, GL_TEXTURE_2D, GL_TEXTURE_2D, baked, done);
+		}
+		else {
+			ResourceCache::add_size(RESOURCE_TEXTURE, texture, image->width * image->height * 3);
+			TextureUploader::upload(texture, GL_TEXTURE_2D, GL_TEXTURE_2D, image, done);
+		}
+	});
 }
 
 void Terrain::draw(GLuint shaderProgram) {
+	if (!ready) return;	// Still loading
+
 	// Calculate the combination of the model and view (camera inverse) matrices
 	glm::mat4 modelview = Window::V * toWorld;
 
@@ -330,14 +360,12 @@ void Terrain::draw(GLuint shaderProgram) {
 	// Send lighting info
 	glUniform3fv(glGetUniformLocation(shaderProgram, "camPos"), 1, &Window::cam_pos[0]);
 	glUniform3f(glGetUniformLocation(shaderProgram, "objectColor"), 0.761f, 0.698f, 0.502f);
-	glUniform3f(glGetUniformLocation(shaderProgram, "lightColor"), 1.0, 1.0, 1.0);
-	glUniform3f(glGetUniformLocation(shaderProgram, "lightDir"), -0.3f, 0.2f, -1.0f);
+	glUniform3fv(glGetUniformLocation(shaderProgram, "lightColor"), 1, &Lights::sun_color.x);
+	glUniform3fv(glGetUniformLocation(shaderProgram, "lightDir"), 1, &Lights::sun_direction.x);
 	glUniform1f(glGetUniformLocation(shaderProgram, "ambientModifier"), 0.5f);
 	glUniform1f(glGetUniformLocation(shaderProgram, "diffuseModifier"), 0.90f);
 	glUniform1f(glGetUniformLocation(shaderProgram, "specularModifier"), 0.09f);
 	glUniform1f(glGetUniformLocation(shaderProgram, "shininess"), 0.1f * 128.0f);
-	glUniform1i(glGetUniformLocation(shaderProgram, "toon"), Window::toon);
-	glUniform1i(glGetUniformLocation(shaderProgram, "illuminate_terr"), Window::illuminate_terr);
 
 	// Draw Terrain
 	glBindVertexArray(VAO);
@@ -36,6 +36,7 @@ private:
 	GLuint VBO, VAO, NBO, TBO, EBO;
 	GLuint uProjection, uModelview, uView, uModel;
 	GLuint textureID;
+	bool ready;		// Mesh buffers have been uploaded
 
 	// Rename buffer objects for ease of reading
 	typedef std::vector<glm::vec3> PosBuff;
@@ -57,6 +58,7 @@ public:
 	Terrain(float, float, float, const char *, const char *);
 	~Terrain();
 
+	void load();
 	void init_buffers();
 	void genIndexBuff();
 	void genNormals();
@@ -65,6 +67,8 @@ public:
 	void loadTexture();
 	void loadTexture(const char *);
 	void draw(GLuint);
+	// Middle of the height range, for sorting against other geometry
+	glm::vec3 center() const { return glm::vec3(toWorld * glm::vec4(0.0f, ground_translate + 0.5f * height_scale, 0.0f, 1.0f)); }
 };
 
 #endif
\ No newline at end of file
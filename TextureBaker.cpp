@@ -0,0 +1,637 @@
+#include "TextureBaker.h"
+#include "ThreadPool.h"
+#include "Profiler.h"
+#include "soil.h"
+
+#include <atomic>
+#include <float.h>
+#include <limits.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <iostream>
+
+// On disk: header, one BakedLevel per mip, then the block data for every level back to back
+struct BakedHeader
+{
+	char magic[4];	// "CTEX"
+	unsigned int version;
+	unsigned int format;
+	unsigned int level_count;
+	unsigned long long source_size;		// Used to tell when the source image has changed
+	unsigned long long source_mtime;
+};
+
+struct BakedLevel
+{
+	unsigned int width;
+	unsigned int height;
+	unsigned int offset;
+	unsigned int size;
+};
+
+// Everything --bake produces. Colour textures use BC1, the water's distortion and normal maps hold
+// vectors rather than colours so they get BC7 to keep their precision.
+static const struct { const char * path; int format; } bake_list[] = {
+	{ "../assets/skybox_images/TropicalSunnyDayLeft2048.ppm", BAKED_BC1 },
+	{ "../assets/skybox_images/TropicalSunnyDayRight2048.ppm", BAKED_BC1 },
+	{ "../assets/skybox_images/TropicalSunnyDayUp2048.ppm", BAKED_BC1 },
+	{ "../assets/skybox_images/TropicalSunnyDayDown2048.ppm", BAKED_BC1 },
+	{ "../assets/skybox_images/TropicalSunnyDayFront2048.ppm", BAKED_BC1 },
+	{ "../assets/skybox_images/TropicalSunnyDayBack2048.ppm", BAKED_BC1 },
+	{ "../assets/textures/sand2.ppm", BAKED_BC1 },
+	{ "../assets/textures/grass.ppm", BAKED_BC1 },
+	{ "../assets/textures/rocky.ppm", BAKED_BC1 },
+	{ "../assets/textures/waterDUDV.png", BAKED_BC7 },
+	{ "../assets/textures/normal.png", BAKED_BC7 },
+};
+
+bool TextureBaker::enabled = true;
+bool TextureBaker::supported[4] = { false, false, false, false };
+
+GLenum BakedTexture::gl_format() const
+{
+	switch (format)
+	{
+	case BAKED_BC1: return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+	case BAKED_BC3: return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+	case BAKED_BC7: return GL_COMPRESSED_RGBA_BPTC_UNORM_ARB;
+	}
+	return 0;
+}
+
+void TextureBaker::init()
+{
+	// Ask the driver which compressed formats it can sample from
+	GLint count = 0;
+	glGetIntegerv(GL_NUM_COMPRESSED_TEXTURE_FORMATS, &count);
+	std::vector<GLint> formats(count > 0 ? count : 1);
+	if (count > 0) glGetIntegerv(GL_COMPRESSED_TEXTURE_FORMATS, &formats[0]);
+	for (int i = 0; i < count; i++)
+	{
+		if (formats[i] == GL_COMPRESSED_RGB_S3TC_DXT1_EXT) supported[BAKED_BC1] = true;
+		if (formats[i] == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT) supported[BAKED_BC3] = true;
+		if (formats[i] == GL_COMPRESSED_RGBA_BPTC_UNORM_ARB) supported[BAKED_BC7] = true;
+	}
+#ifndef __APPLE__
+	// Core profiles don't have to list every format, trust the extensions as well
+	if (GLEW_EXT_texture_compression_s3tc) supported[BAKED_BC1] = supported[BAKED_BC3] = true;
+	if (GLEW_ARB_texture_compression_bptc) supported[BAKED_BC7] = true;
+#endif
+
+	std::cout << "Baked textures " << (enabled ? "enabled" : "disabled") << ", GPU supports"
+		<< (supported[BAKED_BC1] ? " BC1" : "") << (supported[BAKED_BC3] ? " BC3" : "") << (supported[BAKED_BC7] ? " BC7" : "") << std::endl;
+}
+
+void TextureBaker::baked_path(const char * source, char * out, int size)
+{
+	// Swap the extension: ../assets/textures/sand2.ppm -> ../assets/textures/sand2.ctex
+	const char * dot = strrchr(source, '.');
+	const char * slash = strrchr(source, '/');
+	int length = (dot && (!slash || dot > slash)) ? (int)(dot - source) : (int)strlen(source);
+	snprintf(out, size, "%.*s%s", length, source, BAKED_EXTENSION);
+}
+
+bool TextureBaker::bake_all(int threads)
+{
+	PROFILE_ZONE("TextureBaker::bake_all");
+	long long start = Profiler::now();
+	std::atomic<int> failed(0);
+	int count = sizeof(bake_list) / sizeof(bake_list[0]);
+	{
+		// Each file is independent, bake them in parallel
+		ThreadPool pool(threads, "baker");
+		for (int i = 0; i < count; i++)
+		{
+			pool.enqueue([i, &failed]() {
+				if (!bake(bake_list[i].path, bake_list[i].format)) failed++;
+			});
+		}
+		pool.wait_idle();
+	}
+
+	std::cout << "Baked " << count - failed << "/" << count << " textures in " << (Profiler::now() - start) / 1000.0 << " ms" << std::endl;
+	return failed == 0;
+}
+
+bool TextureBaker::bake(const char * source, int format)
+{
+	PROFILE_ZONE("TextureBaker::bake");
+	int width, height;
+	unsigned char * pixels = load_source(source, width, height);
+	if (pixels == NULL) return false;
+
+	unsigned long long source_size, source_mtime;
+	if (!VFS::stat(source, source_size, source_mtime))
+	{
+		std::cerr << "could not stat " << source << std::endl;
+		delete[] pixels;
+		return false;
+	}
+
+	std::vector<unsigned char> level(pixels, pixels + width * height * 4);
+	delete[] pixels;
+
+	// Compress every level of the mip chain down to 1x1
+	std::vector<BakedLevel> levels;
+	std::vector<unsigned char> data;
+	int w = width, h = height;
+	while (true)
+	{
+		std::vector<unsigned char> blocks;
+		encode_level(level, w, h, format, blocks);
+
+		BakedLevel entry;
+		entry.width = w;
+		entry.height = h;
+		entry.offset = (unsigned int)data.size();
+		entry.size = (unsigned int)blocks.size();
+		levels.push_back(entry);
+		data.insert(data.end(), blocks.begin(), blocks.end());
+
+		if (w == 1 && h == 1) break;
+		std::vector<unsigned char> smaller;
+		downsample(level, w, h, smaller);
+		level.swap(smaller);
+		w = w > 1 ? w / 2 : 1;
+		h = h > 1 ? h / 2 : 1;
+	}
+
+	BakedHeader header;
+	memcpy(header.magic, "CTEX", 4);
+	header.version = BAKED_VERSION;
+	header.format = format;
+	header.level_count = (unsigned int)levels.size();
+	header.source_size = source_size;
+	header.source_mtime = source_mtime;
+
+	char path[512];
+	baked_path(source, path, sizeof(path));
+	FILE * fp = fopen(path, "wb");
+	if (fp == NULL)
+	{
+		std::cerr << "could not open " << path << " for writing" << std::endl;
+		return false;
+	}
+	fwrite(&header, sizeof(header), 1, fp);
+	fwrite(&levels[0], sizeof(BakedLevel), levels.size(), fp);
+	fwrite(&data[0], 1, data.size(), fp);
+	fclose(fp);
+
+	const char * names[] = { "", "BC1", "BC3", "BC7" };
+	printf("Baked %s -> %s (%dx%d %s, %d levels, %.1f MB -> %.1f MB)\n", source, path, width, height, names[format],
+		(int)levels.size(), width * height * 3 / (1024.0 * 1024.0), data.size() / (1024.0 * 1024.0));
+	return true;
+}
+
+bool TextureBaker::load(const char * source, BakedTexture & baked)
+{
+	if (!enabled) return false;
+
+	char path[512];
+	baked_path(source, path, sizeof(path));
+	if (!VFS::open(path, baked.file)) return false;	// Not baked, use the source
+
+	// The whole container is mapped, the uploader reads the blocks straight out of it
+	PROFILE_ZONE("TextureBaker::load");
+	size_t size = baked.file.size();
+	if (size < sizeof(BakedHeader))
+	{
+		std::cerr << "baked texture " << path << " is truncated" << std::endl;
+		baked.file.close();
+		return false;
+	}
+
+	BakedHeader header;
+	memcpy(&header, baked.file.data(), sizeof(header));
+	if (memcmp(header.magic, "CTEX", 4) != 0 || header.version != BAKED_VERSION || header.format < BAKED_BC1 || header.format > BAKED_BC7)
+	{
+		std::cerr << path << " is not a baked texture, rebake with --bake" << std::endl;
+		baked.file.close();
+		return false;
+	}
+	if (!supported[header.format])
+	{
+		baked.file.close();	// GPU can't sample it, use the source
+		return false;
+	}
+
+	// A baked file older than its source is stale. If the source isn't shipped at all the baked file is all we have.
+	unsigned long long source_size, source_mtime;
+	if (VFS::stat(source, source_size, source_mtime) && (source_size != header.source_size || source_mtime != header.source_mtime))
+	{
+		std::cout << path << " is stale, loading " << source << " instead" << std::endl;
+		baked.file.close();
+		return false;
+	}
+
+	unsigned int table_end = sizeof(BakedHeader) + header.level_count * sizeof(BakedLevel);
+	if (header.level_count == 0 || table_end > (unsigned int)size)
+	{
+		std::cerr << "baked texture " << path << " is truncated" << std::endl;
+		baked.file.close();
+		return false;
+	}
+	baked.format = header.format;
+	baked.data_offset = table_end;
+	baked.levels.resize(header.level_count);
+	for (unsigned int i = 0; i < header.level_count; i++)
+	{
+		BakedLevel entry;
+		memcpy(&entry, baked.file.data() + sizeof(BakedHeader) + i * sizeof(BakedLevel), sizeof(entry));
+		if (table_end + entry.offset + entry.size > (unsigned int)size)
+		{
+			std::cerr << "baked texture " << path << " is truncated" << std::endl;
+			baked.levels.clear();
+			baked.file.close();
+			return false;
+		}
+		baked.levels[i].width = entry.width;
+		baked.levels[i].height = entry.height;
+		baked.levels[i].offset = entry.offset;
+		baked.levels[i].size = entry.size;
+	}
+	return true;
+}
+
+unsigned char * TextureBaker::load_source(const char * source, int & width, int & height)
+{
+	// Always hands back RGBA so every encoder sees the same layout
+	VFSFile file;
+	if (!VFS::open(source, file))
+	{
+		std::cerr << "could not open " << source << " for baking" << std::endl;
+		return NULL;
+	}
+	const char * dot = strrchr(source, '.');
+	if (dot == NULL || strcmp(dot, ".ppm") != 0)
+	{
+		int channels;
+		unsigned char * soil = SOIL_load_image_from_memory((const unsigned char *)file.data(), (int)file.size(), &width, &height, &channels, SOIL_LOAD_RGBA);
+		if (soil == NULL)
+		{
+			std::cerr << "could not load " << source << " for baking" << std::endl;
+			return NULL;
+		}
+		unsigned char * pixels = new unsigned char[width * height * 4];
+		memcpy(pixels, soil, width * height * 4);
+		SOIL_free_image_data(soil);
+		return pixels;
+	}
+
+	// Binary ppm (P6), same layout the loaders read
+	char buf[128];
+	int maxval = 0;
+	if (file.gets(buf, sizeof(buf)) == NULL || strncmp(buf, "P6", 2) != 0)
+	{
+		std::cerr << source << " is not a binary ppm file" << std::endl;
+		return NULL;
+	}
+	do { if (file.gets(buf, sizeof(buf)) == NULL) break; } while (buf[0] == '#');
+	sscanf(buf, "%d %d", &width, &height);
+	do { if (file.gets(buf, sizeof(buf)) == NULL) break; } while (buf[0] == '#');
+	sscanf(buf, "%d", &maxval);
+	if (width <= 0 || height <= 0 || maxval != 255)
+	{
+		std::cerr << "error parsing ppm file " << source << ", unsupported header" << std::endl;
+		return NULL;
+	}
+
+	std::vector<unsigned char> rgb(width * height * 3);
+	size_t read = file.read(&rgb[0], rgb.size(), 1);
+	if (read != 1)
+	{
+		std::cerr << "error parsing ppm file, incomplete data" << std::endl;
+		return NULL;
+	}
+
+	unsigned char * pixels = new unsigned char[width * height * 4];
+	for (int i = 0; i < width * height; i++)
+	{
+		pixels[i * 4 + 0] = rgb[i * 3 + 0];
+		pixels[i * 4 + 1] = rgb[i * 3 + 1];
+		pixels[i * 4 + 2] = rgb[i * 3 + 2];
+		pixels[i * 4 + 3] = 255;
+	}
+	return pixels;
+}
+
+void TextureBaker::downsample(const std::vector<unsigned char> & src, int width, int height, std::vector<unsigned char> & dst)
+{
+	// 2x2 box filter, odd edges repeat their last row/column
+	int w = width > 1 ? width / 2 : 1;
+	int h = height > 1 ? height / 2 : 1;
+	dst.resize(w * h * 4);
+	for (int y = 0; y < h; y++)
+	{
+		int y0 = y * 2 < height ? y * 2 : height - 1;
+		int y1 = y * 2 + 1 < height ? y * 2 + 1 : height - 1;
+		for (int x = 0; x < w; x++)
+		{
+			int x0 = x * 2 < width ? x * 2 : width - 1;
+			int x1 = x * 2 + 1 < width ? x * 2 + 1 : width - 1;
+			for (int c = 0; c < 4; c++)
+			{
+				int sum = src[(y0 * width + x0) * 4 + c] + src[(y0 * width + x1) * 4 + c] + src[(y1 * width + x0) * 4 + c] + src[(y1 * width + x1) * 4 + c];
+				dst[(y * w + x) * 4 + c] = (unsigned char)((sum + 2) / 4);
+			}
+		}
+	}
+}
+
+void TextureBaker::encode_level(const std::vector<unsigned char> & rgba, int width, int height, int format, std::vector<unsigned char> & out)
+{
+	int block_bytes = format == BAKED_BC1 ? 8 : 16;
+	int blocks_x = (width + 3) / 4;
+	int blocks_y = (height + 3) / 4;
+	out.resize(blocks_x * blocks_y * block_bytes);
+
+	unsigned char block[16 * 4];
+	for (int by = 0; by < blocks_y; by++)
+	{
+		for (int bx = 0; bx < blocks_x; bx++)
+		{
+			// Gather the 4x4 block, clamping at the edges of small or odd sized levels
+			for (int y = 0; y < 4; y++)
+			{
+				int sy = by * 4 + y < height ? by * 4 + y : height - 1;
+				for (int x = 0; x < 4; x++)
+				{
+					int sx = bx * 4 + x < width ? bx * 4 + x : width - 1;
+					memcpy(&block[(y * 4 + x) * 4], &rgba[(sy * width + sx) * 4], 4);
+				}
+			}
+
+			unsigned char * dst = &out[(by * blocks_x + bx) * block_bytes];
+			if (format == BAKED_BC1) encode_bc1(block, dst);
+			else if (format == BAKED_BC3) encode_bc3(block, dst);
+			else encode_bc7(block, dst);
+		}
+	}
+}
+
+// Endpoints for a block: the extremes of its pixels projected onto their principal axis
+static void principal_endpoints(const unsigned char * block, int channels, float lo[4], float hi[4])
+{
+	float mean[4] = { 0, 0, 0, 0 };
+	for (int i = 0; i < 16; i++)
+		for (int c = 0; c < channels; c++)
+			mean[c] += block[i * 4 + c] / 16.0f;
+
+	float cov[4][4] = { { 0 } };
+	for (int i = 0; i < 16; i++)
+		for (int a = 0; a < channels; a++)
+			for (int b = 0; b < channels; b++)
+				cov[a][b] += (block[i * 4 + a] - mean[a]) * (block[i * 4 + b] - mean[b]);
+
+	// Power iteration, starting from the channel with the most variance
+	int start = 0;
+	for (int c = 1; c < channels; c++)
+		if (cov[c][c] > cov[start][start]) start = c;
+	float axis[4] = { 0, 0, 0, 0 };
+	for (int c = 0; c < channels; c++) axis[c] = cov[start][c];
+	for (int iter = 0; iter < 8; iter++)
+	{
+		float next[4] = { 0, 0, 0, 0 };
+		float largest = 0.0f;
+		for (int a = 0; a < channels; a++)
+		{
+			for (int b = 0; b < channels; b++) next[a] += cov[a][b] * axis[b];
+			if (fabsf(next[a]) > largest) largest = fabsf(next[a]);
+		}
+		if (largest == 0.0f) break;
+		for (int c = 0; c < channels; c++) axis[c] = next[c] / largest;
+	}
+
+	float length = 0.0f;
+	for (int c = 0; c < channels; c++) length += axis[c] * axis[c];
+	length = sqrtf(length);
+
+	float t_min = 0.0f, t_max = 0.0f;	// Flat block: both endpoints are the mean
+	if (length > 0.0f)
+	{
+		for (int c = 0; c < channels; c++) axis[c] /= length;
+		t_min = FLT_MAX;
+		t_max = -FLT_MAX;
+		for (int i = 0; i < 16; i++)
+		{
+			float t = 0.0f;
+			for (int c = 0; c < channels; c++) t += (block[i * 4 + c] - mean[c]) * axis[c];
+			if (t < t_min) t_min = t;
+			if (t > t_max) t_max = t;
+		}
+	}
+
+	for (int c = 0; c < 4; c++)
+	{
+		float a = c < channels ? mean[c] + axis[c] * t_min : 255.0f;
+		float b = c < channels ? mean[c] + axis[c] * t_max : 255.0f;
+		lo[c] = a < 0.0f ? 0.0f : (a > 255.0f ? 255.0f : a);
+		hi[c] = b < 0.0f ? 0.0f : (b > 255.0f ? 255.0f : b);
+	}
+}
+
+static unsigned short pack565(const float c[4])
+{
+	int r = (int)(c[0] * 31.0f / 255.0f + 0.5f);
+	int g = (int)(c[1] * 63.0f / 255.0f + 0.5f);
+	int b = (int)(c[2] * 31.0f / 255.0f + 0.5f);
+	return (unsigned short)((r << 11) | (g << 5) | b);
+}
+
+static void unpack565(unsigned short v, int c[3])
+{
+	int r = (v >> 11) & 31, g = (v >> 5) & 63, b = v & 31;
+	c[0] = (r << 3) | (r >> 2);
+	c[1] = (g << 2) | (g >> 4);
+	c[2] = (b << 3) | (b >> 2);
+}
+
+void TextureBaker::encode_bc1(const unsigned char * block, unsigned char * out)
+{
+	float lo[4], hi[4];
+	principal_endpoints(block, 3, lo, hi);
+	unsigned short c0 = pack565(hi);
+	unsigned short c1 = pack565(lo);
+	if (c0 < c1)
+	{
+		unsigned short t = c0; c0 = c1; c1 = t;
+	}
+
+	// c0 > c1 selects the four colour mode, if they're equal every index stays 0 (c0)
+	unsigned int indices = 0;
+	if (c0 != c1)
+	{
+		int palette[4][3];
+		unpack565(c0, palette[0]);
+		unpack565(c1, palette[1]);
+		for (int c = 0; c < 3; c++)
+		{
+			palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+			palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+		}
+		for (int i = 0; i < 16; i++)
+		{
+			int best = 0, best_error = INT_MAX;
+			for (int p = 0; p < 4; p++)
+			{
+				int error = 0;
+				for (int c = 0; c < 3; c++)
+				{
+					int d = block[i * 4 + c] - palette[p][c];
+					error += d * d;
+				}
+				if (error < best_error)
+				{
+					best_error = error;
+					best = p;
+				}
+			}
+			indices |= (unsigned int)best << (i * 2);
+		}
+	}
+
+	out[0] = c0 & 0xFF;
+	out[1] = c0 >> 8;
+	out[2] = c1 & 0xFF;
+	out[3] = c1 >> 8;
+	for (int i = 0; i < 4; i++) out[4 + i] = (indices >> (i * 8)) & 0xFF;
+}
+
+void TextureBaker::encode_bc3(const unsigned char * block, unsigned char * out)
+{
+	// Alpha block: two endpoints and 3 bit indices into the 8 value ramp between them
+	int a_min = 255, a_max = 0;
+	for (int i = 0; i < 16; i++)
+	{
+		if (block[i * 4 + 3] < a_min) a_min = block[i * 4 + 3];
+		if (block[i * 4 + 3] > a_max) a_max = block[i * 4 + 3];
+	}
+
+	unsigned long long indices = 0;
+	if (a_max > a_min)
+	{
+		int palette[8];
+		palette[0] = a_max;
+		palette[1] = a_min;
+		for (int k = 2; k < 8; k++) palette[k] = ((8 - k) * a_max + (k - 1) * a_min) / 7;
+		for (int i = 0; i < 16; i++)
+		{
+			int best = 0, best_error = INT_MAX;
+			for (int p = 0; p < 8; p++)
+			{
+				int error = abs(block[i * 4 + 3] - palette[p]);
+				if (error < best_error)
+				{
+					best_error = error;
+					best = p;
+				}
+			}
+			indices |= (unsigned long long)best << (i * 3);
+		}
+	}
+
+	out[0] = (unsigned char)a_max;
+	out[1] = (unsigned char)a_min;
+	for (int i = 0; i < 6; i++) out[2 + i] = (indices >> (i * 8)) & 0xFF;
+	encode_bc1(block, out + 8);
+}
+
+// Writes fields LSB first, the way BC7 blocks are laid out
+static void put_bits(unsigned char * out, int & pos, unsigned int value, int count)
+{
+	for (int i = 0; i < count; i++, pos++)
+		if (value & (1u << i)) out[pos >> 3] |= (unsigned char)(1 << (pos & 7));
+}
+
+// Mode 6 endpoints are 7 bits per channel plus one p-bit shared by all four channels of an endpoint
+static void quantize_bc7_endpoint(const float c[4], int q[4], int & p)
+{
+	float best_error = FLT_MAX;
+	for (int pbit = 0; pbit < 2; pbit++)
+	{
+		int candidate[4];
+		float error = 0.0f;
+		for (int ch = 0; ch < 4; ch++)
+		{
+			int v = (int)floorf((c[ch] - pbit) / 2.0f + 0.5f);
+			v = v < 0 ? 0 : (v > 127 ? 127 : v);
+			candidate[ch] = v;
+			float d = (float)((v << 1) | pbit) - c[ch];
+			error += d * d;
+		}
+		if (error < best_error)
+		{
+			best_error = error;
+			p = pbit;
+			memcpy(q, candidate, sizeof(candidate));
+		}
+	}
+}
+
+void TextureBaker::encode_bc7(const unsigned char * block, unsigned char * out)
+{
+	// Only mode 6: a single subset, RGBA endpoints and 4 bit indices. Fast to encode and
+	// already far ahead of BC1 on smooth data like the water's normal and distortion maps.
+	static const int weights[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+	float lo[4], hi[4];
+	principal_endpoints(block, 4, lo, hi);
+	int q0[4], q1[4], p0 = 0, p1 = 0;
+	quantize_bc7_endpoint(lo, q0, p0);
+	quantize_bc7_endpoint(hi, q1, p1);
+
+	int e0[4], e1[4];
+	for (int ch = 0; ch < 4; ch++)
+	{
+		e0[ch] = (q0[ch] << 1) | p0;
+		e1[ch] = (q1[ch] << 1) | p1;
+	}
+
+	int indices[16];
+	for (int i = 0; i < 16; i++)
+	{
+		int best = 0, best_error = INT_MAX;
+		for (int w = 0; w < 16; w++)
+		{
+			int error = 0;
+			for (int ch = 0; ch < 4; ch++)
+			{
+				int value = ((64 - weights[w]) * e0[ch] + weights[w] * e1[ch] + 32) >> 6;
+				int d = block[i * 4 + ch] - value;
+				error += d * d;
+			}
+			if (error < best_error)
+			{
+				best_error = error;
+				best = w;
+			}
+		}
+		indices[i] = best;
+	}
+
+	// The first index only stores 3 bits, its top bit must be 0. Swap the endpoints if it isn't.
+	if (indices[0] & 8)
+	{
+		for (int ch = 0; ch < 4; ch++)
+		{
+			int t = q0[ch]; q0[ch] = q1[ch]; q1[ch] = t;
+		}
+		int t = p0; p0 = p1; p1 = t;
+		for (int i = 0; i < 16; i++) indices[i] = 15 - indices[i];
+	}
+
+	memset(out, 0, 16);
+	int pos = 0;
+	put_bits(out, pos, 1 << 6, 7);	// Mode 6: six 0 bits then a 1
+	for (int ch = 0; ch < 4; ch++)
+	{
+		put_bits(out, pos, q0[ch], 7);
+		put_bits(out, pos, q1[ch], 7);
+	}
+	put_bits(out, pos, p0, 1);
+	put_bits(out, pos, p1, 1);
+	put_bits(out, pos, indices[0], 3);
+	for (int i = 1; i < 16; i++) put_bits(out, pos, indices[i], 4);
+}
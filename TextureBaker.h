@@ -0,0 +1,83 @@
+#pragma once
+#ifndef _TEXTUREBAKER_H_
+#define _TEXTUREBAKER_H_
+
+#define GLFW_INCLUDE_GLEXT
+#ifdef __APPLE__
+#define GLFW_INCLUDE_GLCOREARB
+#else
+#include <GL/glew.h>
+#endif
+#include <GLFW/glfw3.h>
+
+#include <vector>
+
+#include "VFS.h"
+
+#define BAKED_EXTENSION ".ctex"	// Baked files sit next to their source with this extension
+#define BAKED_VERSION 1
+
+// Block compression formats a texture can be baked to
+#define BAKED_BC1 1	// RGB, 4 bits per pixel
+#define BAKED_BC3 2	// RGBA, 8 bits per pixel
+#define BAKED_BC7 3	// RGBA, 8 bits per pixel, much better quality than BC1 (mode 6 only)
+
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+#ifndef GL_COMPRESSED_RGBA_BPTC_UNORM_ARB
+#define GL_COMPRESSED_RGBA_BPTC_UNORM_ARB 0x8E8C
+#endif
+
+// A baked texture: the whole container file mapped through the VFS, with the mip chain pointing into it
+struct BakedTexture
+{
+	struct Level
+	{
+		int width;
+		int height;
+		unsigned int offset;	// Bytes from the start of the data block
+		unsigned int size;
+	};
+
+	int format;
+	std::vector<Level> levels;
+	VFSFile file;
+	unsigned int data_offset;	// Where the block data starts inside file
+
+	BakedTexture() : format(0), data_offset(0) {}
+	bool empty() const { return levels.empty(); }
+	GLenum gl_format() const;
+	const unsigned char * data() const { return (const unsigned char *)file.data() + data_offset; }
+	unsigned int data_size() const { return (unsigned int)file.size() - data_offset; }
+};
+
+// Offline texture pipeline. --bake turns the source images into mip chains compressed to BC1/BC3/BC7
+// and writes them out as .ctex containers. At runtime the loaders try the baked file first and
+// fall back to the source image if it is missing, stale or the GPU can't sample its format.
+class TextureBaker
+{
+public:
+	static bool enabled;	// Cleared by --raw-textures to compare against the uncompressed path
+
+	static void init();	// Query which compressed formats the GPU supports, needs the GL context
+	static bool bake_all(int threads);
+	static bool bake(const char * source, int format);
+	static bool load(const char * source, BakedTexture & baked);	// Safe to call from loader threads
+
+private:
+	static bool supported[4];
+
+	static void baked_path(const char * source, char * out, int size);
+	static unsigned char * load_source(const char * source, int & width, int & height);
+	static void downsample(const std::vector<unsigned char> & src, int width, int height, std::vector<unsigned char> & dst);
+	static void encode_level(const std::vector<unsigned char> & rgba, int width, int height, int format, std::vector<unsigned char> & out);
+	static void encode_bc1(const unsigned char * block, unsigned char * out);
+	static void encode_bc3(const unsigned char * block, unsigned char * out);
+	static void encode_bc7(const unsigned char * block, unsigned char * out);
+};
+
+#endif
@@ -0,0 +1,239 @@
+#include "TextureUploader.h"
+#include "Profiler.h"
+
+#include <string.h>
+#include <iostream>
+
+TextureUploader::Staging TextureUploader::staging[UPLOAD_STAGING_BUFFERS];
+std::deque<TextureUploader::Request> TextureUploader::waiting;
+bool TextureUploader::initialized = false;
+bool TextureUploader::persistent = false;
+size_t TextureUploader::texture_bytes = 0;
+
+size_t TextureUploader::Request::bytes() const
+{
+	if (baked) return baked->data_size();
+	return (size_t)image->width * image->height * 3;
+}
+
+void TextureUploader::init()
+{
+#ifdef __APPLE__
+	persistent = false;	// No GL 4.4 on OSX, fall back to mapping per upload
+#else
+	persistent = GLEW_ARB_buffer_storage ? true : false;
+#endif
+
+	for (int i = 0; i < UPLOAD_STAGING_BUFFERS; i++)
+	{
+		glGenBuffers(1, &staging[i].buffer);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, staging[i].buffer);
+		staging[i].mapped = NULL;
+		staging[i].fence = 0;
+		if (persistent)
+		{
+			GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+			glBufferStorage(GL_PIXEL_UNPACK_BUFFER, UPLOAD_STAGING_SIZE, NULL, flags);
+			staging[i].mapped = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, UPLOAD_STAGING_SIZE, flags);
+		}
+		else
+		{
+			glBufferData(GL_PIXEL_UNPACK_BUFFER, UPLOAD_STAGING_SIZE, NULL, GL_STREAM_DRAW);
+		}
+	}
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	initialized = true;
+
+	std::cout << "Texture uploads staged through " << UPLOAD_STAGING_BUFFERS << " PBOs" << (persistent ? " (persistently mapped)" : "") << std::endl;
+}
+
+void TextureUploader::clean_up()
+{
+	if (!initialized) return;
+	waiting.clear();
+	for (int i = 0; i < UPLOAD_STAGING_BUFFERS; i++)
+	{
+		if (staging[i].fence) glDeleteSync(staging[i].fence);
+		if (staging[i].mapped)
+		{
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, staging[i].buffer);
+			glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+		}
+		glDeleteBuffers(1, &staging[i].buffer);
+	}
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	initialized = false;
+}
+
+void TextureUploader::upload(GLuint texture, GLenum bind_target, GLenum image_target, std::shared_ptr<DecodedImage> image, std::function<void()> done)
+{
+	Request request;
+	request.texture = texture;
+	request.bind_target = bind_target;
+	request.image_target = image_target;
+	request.image = image;
+	request.done = done;
+	submit(request);
+}
+
+void TextureUploader::upload_compressed(GLuint texture, GLenum bind_target, GLenum image_target, std::shared_ptr<BakedTexture> baked, std::function<void()> done)
+{
+	Request request;
+	request.texture = texture;
+	request.bind_target = bind_target;
+	request.image_target = image_target;
+	request.baked = baked;
+	request.done = done;
+	submit(request);
+}
+
+void TextureUploader::submit(const Request & request)
+{
+	if (!initialized || request.bytes() > UPLOAD_STAGING_SIZE)
+	{
+		// Too big for a staging buffer (or no pool yet), go straight from client memory
+		issue_direct(request);
+		return;
+	}
+
+	// Keep submission order, so only jump the queue when nothing is waiting
+	int slot = waiting.empty() ? acquire() : -1;
+	if (slot < 0) waiting.push_back(request);
+	else issue(request, slot);
+}
+
+void TextureUploader::update()
+{
+	if (!initialized) return;
+	while (!waiting.empty())
+	{
+		int slot = acquire();
+		if (slot < 0) return;	// Every PBO is still being read, try again next frame
+		issue(waiting.front(), slot);
+		waiting.pop_front();
+	}
+}
+
+int TextureUploader::queued()
+{
+	return (int)waiting.size();
+}
+
+void TextureUploader::report_memory(const char * when)
+{
+	std::cout << "Texture memory " << when << ": " << texture_bytes / (1024.0 * 1024.0) << " MB uploaded";
+#ifndef __APPLE__
+	// Only NVIDIA and AMD report free video memory, and only through their own extensions
+	GLint free_kb[4] = { 0, 0, 0, 0 };
+	if (GLEW_NVX_gpu_memory_info)
+	{
+		glGetIntegerv(GL_GPU_MEMORY_INFO_CURRENT_AVAILABLE_VIDMEM_NVX, free_kb);
+		std::cout << ", " << free_kb[0] / 1024.0 << " MB video memory free";
+	}
+	else if (GLEW_ATI_meminfo)
+	{
+		glGetIntegerv(GL_TEXTURE_FREE_MEMORY_ATI, free_kb);
+		std::cout << ", " << free_kb[0] / 1024.0 << " MB texture memory free";
+	}
+#endif
+	std::cout << std::endl;
+}
+
+int TextureUploader::acquire()
+{
+	for (int i = 0; i < UPLOAD_STAGING_BUFFERS; i++)
+	{
+		if (staging[i].fence == 0) return i;
+
+		// Zero timeout: only poll the fence, never wait on it
+		GLenum status = glClientWaitSync(staging[i].fence, 0, 0);
+		if (status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED)
+		{
+			glDeleteSync(staging[i].fence);
+			staging[i].fence = 0;
+			return i;
+		}
+	}
+	return -1;
+}
+
+void TextureUploader::issue(const Request & request, int slot)
+{
+	PROFILE_ZONE("TextureUploader::issue");
+	size_t bytes = request.bytes();
+	const void * src = request.baked ? (const void *)request.baked->data() : (const void *)request.image->data;
+
+	// Copy the pixels into the staging buffer
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, staging[slot].buffer);
+	if (staging[slot].mapped)
+	{
+		memcpy(staging[slot].mapped, src, bytes);
+	}
+	else
+	{
+		void * dst = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, bytes, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+		memcpy(dst, src, bytes);
+		glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+	}
+
+	glBindTexture(request.bind_target, request.texture);
+	if (request.baked)
+	{
+		// Every level reads straight out of the PBO, the pointer argument is an offset into it
+		const BakedTexture & baked = *request.baked;
+		for (unsigned int level = 0; level < baked.levels.size(); level++)
+		{
+			const BakedTexture::Level & l = baked.levels[level];
+			glCompressedTexImage2D(request.image_target, level, baked.gl_format(), l.width, l.height, 0, l.size, (GLvoid*)(size_t)l.offset);
+		}
+		set_mip_filtering(request);
+	}
+	else
+	{
+		// With the PBO bound the last argument is an offset into it, so this allocates and fills in one copy
+		DecodedImage & image = *request.image;
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);	// Don't let bytes be padded
+		glTexImage2D(request.image_target, 0, GL_RGB, image.width, image.height, 0, GL_RGB, GL_UNSIGNED_BYTE, (GLvoid*)0);
+	}
+	glBindTexture(request.bind_target, 0);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	texture_bytes += bytes;
+
+	// The buffer can be reused once the GPU has consumed it
+	staging[slot].fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+	if (request.done) request.done();
+}
+
+void TextureUploader::issue_direct(const Request & request)
+{
+	glBindTexture(request.bind_target, request.texture);
+	if (request.baked)
+	{
+		const BakedTexture & baked = *request.baked;
+		for (unsigned int level = 0; level < baked.levels.size(); level++)
+		{
+			const BakedTexture::Level & l = baked.levels[level];
+			glCompressedTexImage2D(request.image_target, level, baked.gl_format(), l.width, l.height, 0, l.size, baked.data() + l.offset);
+		}
+		set_mip_filtering(request);
+	}
+	else
+	{
+		DecodedImage & image = *request.image;
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);	// Don't let bytes be padded
+		glTexImage2D(request.image_target, 0, GL_RGB, image.width, image.height, 0, GL_RGB, GL_UNSIGNED_BYTE, image.data);
+	}
+	glBindTexture(request.bind_target, 0);
+	texture_bytes += request.bytes();
+
+	if (request.done) request.done();
+}
+
+void TextureUploader::set_mip_filtering(const Request & request)
+{
+	// Baked textures bring their own mip chain, sample it trilinearly instead of the caller's GL_LINEAR
+	GLint levels = (GLint)request.baked->levels.size();
+	glTexParameteri(request.bind_target, GL_TEXTURE_MAX_LEVEL, levels - 1);
+	if (levels > 1) glTexParameteri(request.bind_target, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+}
@@ -0,0 +1,76 @@
+#pragma once
+#ifndef _TEXTUREUPLOADER_H_
+#define _TEXTUREUPLOADER_H_
+
+#define GLFW_INCLUDE_GLEXT
+#ifdef __APPLE__
+#define GLFW_INCLUDE_GLCOREARB
+#else
+#include <GL/glew.h>
+#endif
+#include <GLFW/glfw3.h>
+
+#include <deque>
+#include <functional>
+#include <memory>
+
+#include "AssetLoader.h"
+#include "TextureBaker.h"
+
+#define UPLOAD_STAGING_BUFFERS 4				// Number of pixel buffer objects in the pool
+#define UPLOAD_STAGING_SIZE (16 * 1024 * 1024)	// Bytes per PBO, fits one 2048x2048 RGB face
+
+// Streams texture data to the GPU through a pool of pixel buffer objects. Pixels are copied into a
+// free PBO and glTexImage2D reads from it, so the driver copies asynchronously instead of
+// blocking on client memory. A fence per PBO tells us when the copy is done and it can be reused.
+// With GL_ARB_buffer_storage the PBOs are mapped once and stay mapped.
+class TextureUploader
+{
+public:
+	static void init();
+	static void clean_up();
+
+	// Allocates level 0 of target (GL_TEXTURE_2D or a cube map face) and fills it from image.
+	// done runs once the upload has been issued to GL.
+	static void upload(GLuint texture, GLenum bind_target, GLenum image_target, std::shared_ptr<DecodedImage> image, std::function<void()> done);
+	// Same for a baked texture, uploads its whole compressed mip chain
+	static void upload_compressed(GLuint texture, GLenum bind_target, GLenum image_target, std::shared_ptr<BakedTexture> baked, std::function<void()> done);
+	static void update();	// Recycle finished PBOs and issue uploads that were waiting on one
+	static int queued();
+	static void report_memory(const char * when);	// Print texture bytes uploaded and free video memory if the driver says
+
+private:
+	struct Staging
+	{
+		GLuint buffer;
+		void * mapped;	// Persistent mapping, NULL when buffer storage is not available
+		GLsync fence;	// Signalled once the GPU has finished reading the buffer
+	};
+
+	struct Request
+	{
+		GLuint texture;
+		GLenum bind_target;
+		GLenum image_target;
+		std::shared_ptr<DecodedImage> image;	// Exactly one of image and baked is set
+		std::shared_ptr<BakedTexture> baked;
+		std::function<void()> done;
+
+		size_t bytes() const;
+	};
+
+	static Staging staging[UPLOAD_STAGING_BUFFERS];
+	static std::deque<Request> waiting;
+	static bool initialized;
+	static bool persistent;
+	static size_t texture_bytes;
+
+	static void submit(const Request & request);
+
+	static int acquire();
+	static void issue(const Request & request, int slot);
+	static void issue_direct(const Request & request);
+	static void set_mip_filtering(const Request & request);
+};
+
+#endif
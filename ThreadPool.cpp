@@ -0,0 +1,79 @@
+#include "ThreadPool.h"
+#include "Profiler.h"
+
+ThreadPool::ThreadPool(int threads, const char * name)
+{
+	this->name = name;
+	active = 0;
+	stopping = false;
+	if (threads < 1) threads = 1;
+	for (int i = 0; i < threads; i++)
+	{
+		workers.push_back(std::thread(&ThreadPool::run, this));
+	}
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		stopping = true;
+		jobs.clear();
+	}
+	job_ready.notify_all();
+	for (unsigned int i = 0; i < workers.size(); i++)
+	{
+		workers[i].join();
+	}
+}
+
+void ThreadPool::enqueue(std::function<void()> job)
+{
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		jobs.push_back(job);
+	}
+	job_ready.notify_one();
+}
+
+void ThreadPool::wait_idle()
+{
+	std::unique_lock<std::mutex> guard(lock);
+	idle.wait(guard, [this]() { return jobs.empty() && active == 0; });
+}
+
+int ThreadPool::size()
+{
+	return (int)workers.size();
+}
+
+int ThreadPool::default_threads()
+{
+	int cores = (int)std::thread::hardware_concurrency();
+	return cores > 1 ? cores - 1 : 1;
+}
+
+void ThreadPool::run()
+{
+	Profiler::set_thread_name(name);
+	while (true)
+	{
+		std::function<void()> job;
+		{
+			std::unique_lock<std::mutex> guard(lock);
+			job_ready.wait(guard, [this]() { return stopping || !jobs.empty(); });
+			if (stopping) return;
+			job = jobs.front();
+			jobs.pop_front();
+			active++;
+		}
+
+		job();
+
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			active--;
+			if (jobs.empty() && active == 0) idle.notify_all();
+		}
+	}
+}
@@ -0,0 +1,38 @@
+#pragma once
+#ifndef _THREADPOOL_H_
+#define _THREADPOOL_H_
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads pulling jobs off a shared queue
+class ThreadPool
+{
+public:
+	ThreadPool(int threads, const char * name);
+	~ThreadPool();	// Finishes running jobs, drops queued ones
+
+	void enqueue(std::function<void()> job);
+	void wait_idle();	// Block until the queue is empty and every worker is idle
+	int size();
+
+	static int default_threads();	// One per core, leaving one for the render thread
+
+private:
+	std::vector<std::thread> workers;
+	std::deque<std::function<void()>> jobs;
+	std::mutex lock;
+	std::condition_variable job_ready;
+	std::condition_variable idle;
+	const char * name;
+	int active;
+	bool stopping;
+
+	void run();
+};
+
+#endif
@@ -43,17 +43,18 @@ void Transform::draw(glm::mat4 C)
 	}
 }
 
-void Transform::update()
+void Transform::update(float dt)
 {
 	if (animated)
 	{
 		A = glm::translate(glm::mat4(1.0f), glm::vec3(-26.75f, 0.0f, 45.0f)) * glm::rotate(glm::mat4(1.0f), glm::cos(glm::radians(angle)) * (glm::pi<float>() / 4.0f), glm::vec3(1.0f, 0.0f, 0.0f)) * glm::translate(glm::mat4(1.0f), glm::vec3(26.75f, 0.0f, -45.0f));
-		angle += 0.5f;
-		if (angle >= 360 || angle < 0) angle = 0;
+		angle += SWING_SPEED * dt;
+		angle = fmod(angle, 360.0f);
+		if (angle < 0) angle = 0;
 	}
 
 	for (Node* c : children)
 	{
-		c->update();
+		c->update(dt);
 	}
 }
\ No newline at end of file
@@ -16,6 +16,8 @@
 
 #include "Node.h"
 
+#define SWING_SPEED 30.0f	// Degrees of swing phase per second
+
 class Transform : public Node
 {
 private:
@@ -31,7 +33,7 @@ public:
 	void addChild(Node* child);
 	void removeChild(Node* child);
 	void draw(glm::mat4 C);
-	void update();
+	void update(float dt);
 };
 
 #endif
\ No newline at end of file
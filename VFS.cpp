@@ -0,0 +1,198 @@
+#include "VFS.h"
+#include "Lz4.h"
+#include "Profiler.h"
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <stdio.h>
+#include <string.h>
+#include <iostream>
+
+MappedFile VFS::pack;
+const PackEntry * VFS::pack_entries = NULL;
+const char * VFS::pack_names = NULL;
+unsigned int VFS::entry_count = 0;
+std::atomic<int> VFS::packed_opens(0);
+std::atomic<int> VFS::loose_opens(0);
+std::atomic<long long> VFS::unpacked_bytes(0);
+
+VFSFile::VFSFile() : view(NULL), length(0), position(0)
+{
+}
+
+void VFSFile::close()
+{
+	loose.close();
+	std::vector<char>().swap(unpacked);
+	view = NULL;
+	length = 0;
+	position = 0;
+}
+
+char * VFSFile::gets(char * buffer, int size)
+{
+	if (position >= length || size <= 0) return NULL;
+	int count = 0;
+	while (count < size - 1 && position < length)
+	{
+		char c = view[position++];
+		buffer[count++] = c;
+		if (c == '\n') break;
+	}
+	buffer[count] = '\0';
+	return buffer;
+}
+
+size_t VFSFile::read(void * buffer, size_t size, size_t count)
+{
+	if (size == 0) return 0;
+	size_t available = (length - position) / size;
+	if (count > available) count = available;
+	memcpy(buffer, view + position, size * count);
+	position += size * count;
+	return count;
+}
+
+bool VFS::mount(const char * pack_path)
+{
+	PROFILE_ZONE("VFS::mount");
+	unmount();
+	if (!pack.open(pack_path)) return false;
+
+	// Check everything up front so open() can trust the table
+	PackHeader header;
+	if (pack.size() < sizeof(header))
+	{
+		std::cerr << pack_path << " is truncated, reading loose files" << std::endl;
+		pack.close();
+		return false;
+	}
+	memcpy(&header, pack.data(), sizeof(header));
+	unsigned long long names_end = sizeof(header) + (unsigned long long)header.entry_count * sizeof(PackEntry) + header.names_size;
+	if (memcmp(header.magic, "APAK", 4) != 0 || header.version != PACK_VERSION || names_end > pack.size())
+	{
+		std::cerr << pack_path << " is not a version " << PACK_VERSION << " asset pack, reading loose files" << std::endl;
+		pack.close();
+		return false;
+	}
+	const PackEntry * entries = (const PackEntry *)(pack.data() + sizeof(header));
+	const char * names = (const char *)(entries + header.entry_count);
+	for (unsigned int i = 0; i < header.entry_count; i++)
+	{
+		if (entries[i].name_offset >= header.names_size || entries[i].offset + entries[i].packed_size > pack.size() ||
+			memchr(names + entries[i].name_offset, '\0', header.names_size - entries[i].name_offset) == NULL)
+		{
+			std::cerr << pack_path << " has a bad table of contents, reading loose files" << std::endl;
+			pack.close();
+			return false;
+		}
+	}
+
+	pack_entries = entries;
+	pack_names = names;
+	entry_count = header.entry_count;
+	std::cout << "Mounted " << pack_path << ": " << entry_count << " files, " << pack.size() / (1024.0 * 1024.0) << " MB" << std::endl;
+	return true;
+}
+
+void VFS::unmount()
+{
+	pack.close();
+	pack_entries = NULL;
+	pack_names = NULL;
+	entry_count = 0;
+}
+
+std::string VFS::normalize(const char * path)
+{
+	std::string key;
+	const char * p = path;
+	for (;;)
+	{
+		if (strncmp(p, "../", 3) == 0 || strncmp(p, "..\\", 3) == 0) p += 3;
+		else if (strncmp(p, "./", 2) == 0 || strncmp(p, ".\\", 2) == 0) p += 2;
+		else break;
+	}
+	for (; *p; p++)
+	{
+		char c = *p == '\\' ? '/' : *p;
+		key += (c >= 'A' && c <= 'Z') ? (char)(c - 'A' + 'a') : c;	// Windows paths don't care about case, and water.vert is Water.vert
+	}
+	return key;
+}
+
+const PackEntry * VFS::find(const char * path)
+{
+	if (pack_entries == NULL) return NULL;
+
+	// Entries are sorted by name
+	std::string key = normalize(path);
+	unsigned int low = 0, high = entry_count;
+	while (low < high)
+	{
+		unsigned int middle = (low + high) / 2;
+		int compare = strcmp(pack_names + pack_entries[middle].name_offset, key.c_str());
+		if (compare == 0) return &pack_entries[middle];
+		if (compare < 0) low = middle + 1;
+		else high = middle;
+	}
+	return NULL;
+}
+
+bool VFS::open(const char * path, VFSFile & file)
+{
+	file.close();
+	const PackEntry * entry = find(path);
+	if (entry == NULL)
+	{
+		if (!file.loose.open(path)) return false;
+		loose_opens++;
+		file.view = file.loose.data();
+		file.length = file.loose.size();
+		return true;
+	}
+
+	packed_opens++;
+	const char * data = pack.data() + entry->offset;
+	file.length = (size_t)entry->size;
+	if (!(entry->flags & PACK_LZ4))
+	{
+		file.view = data;
+		return true;
+	}
+
+	PROFILE_ZONE("VFS::unpack");
+	file.unpacked.resize(file.length);
+	if (file.length > 0 && !Lz4::decompress(data, (int)entry->packed_size, &file.unpacked[0], (int)file.length))
+	{
+		std::cerr << "corrupt pack entry " << path << std::endl;
+		file.close();
+		return false;
+	}
+	unpacked_bytes += (long long)file.length;
+	file.view = file.length > 0 ? &file.unpacked[0] : NULL;
+	return true;
+}
+
+bool VFS::stat(const char * path, unsigned long long & size, unsigned long long & mtime)
+{
+	const PackEntry * entry = find(path);
+	if (entry)
+	{
+		size = entry->size;
+		mtime = entry->source_mtime;
+		return true;
+	}
+
+	struct stat st;
+	if (::stat(path, &st) != 0) return false;
+	size = (unsigned long long)st.st_size;
+	mtime = (unsigned long long)st.st_mtime;
+	return true;
+}
+
+void VFS::report()
+{
+	printf("VFS: %d opens from %s, %d loose, %.1f MB unpacked\n", packed_opens.load(), mounted() ? "the pack" : "no pack",
+		loose_opens.load(), unpacked_bytes.load() / (1024.0 * 1024.0));
+}
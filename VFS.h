@@ -0,0 +1,73 @@
+#pragma once
+#ifndef _VFS_H_
+#define _VFS_H_
+
+#include <stddef.h>
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include "MappedFile.h"
+#include "AssetPack.h"
+
+// One file's bytes, wherever they came from. Stored pack entries point straight into the pack's
+// mapping, LZ4 entries are unpacked into a buffer it owns and loose files get their own mapping.
+// Also reads like a FILE so the old fgets/fread loaders only needed their calls renamed.
+class VFSFile
+{
+public:
+	VFSFile();
+
+	const char * data() const { return view; }
+	size_t size() const { return length; }
+	void close();
+
+	char * gets(char * buffer, int size);	// fgets over the bytes, NULL at the end
+	size_t read(void * buffer, size_t size, size_t count);	// fread over the bytes
+
+private:
+	friend class VFS;
+
+	const char * view;
+	size_t length;
+	size_t position;	// Cursor for gets/read
+	MappedFile loose;
+	std::vector<char> unpacked;
+
+	VFSFile(const VFSFile &);	// Not copyable, view may point into loose or unpacked
+	VFSFile & operator=(const VFSFile &);
+};
+
+// Every asset read goes through here. With a pack mounted, paths are looked up in its table of
+// contents first and fall back to loose files, so anything written at runtime (mesh caches) or
+// left out of the pack still works. Without one it's a thin wrapper over MappedFile.
+// Lookups only read the mapping, so loader threads can open files in parallel.
+class VFS
+{
+public:
+	static bool mount(const char * pack_path);
+	static void unmount();
+	static bool mounted() { return pack_entries != NULL; }
+
+	static bool open(const char * path, VFSFile & file);
+	// Size and modification time of the file open() would read. Pack entries report what the
+	// loose file had when it was packed, so the baked/cache staleness checks still line up.
+	static bool stat(const char * path, unsigned long long & size, unsigned long long & mtime);
+
+	// Table of contents key: lowercase, forward slashes, without the leading ./ and ../
+	static std::string normalize(const char * path);
+	static void report();
+
+private:
+	static MappedFile pack;
+	static const PackEntry * pack_entries;
+	static const char * pack_names;
+	static unsigned int entry_count;
+	static std::atomic<int> packed_opens;
+	static std::atomic<int> loose_opens;
+	static std::atomic<long long> unpacked_bytes;
+
+	static const PackEntry * find(const char * path);
+};
+
+#endif
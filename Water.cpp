@@ -1,9 +1,12 @@
 #include "Water.h"
 #include "Window.h"
+#include "AssetLoader.h"
+#include "TextureUploader.h"
+#include "ResourceCache.h"
+#include "VFS.h"
 
 #define DUDV_PATH "../assets/textures/waterDUDV.png"
 #define NORMAL_PATH "../assets/textures/normal.png"
-#define WAVE_SPEED 0.001f
 
 #define FORWARD true
 #define BACKWARD false
@@ -42,9 +45,9 @@ Water::~Water() {
 	glDeleteTextures(1, &refract_DTO);
 
 	// Delete other loaded textures
-	glDeleteTextures(1, &dudvTextureID);
-	glDeleteTextures(1, &normalTextureID);
-	glDeleteTextures(1, &skyboxTextureID);
+	ResourceCache::release(RESOURCE_TEXTURE, dudvTextureID);
+	ResourceCache::release(RESOURCE_TEXTURE, normalTextureID);
+	ResourceCache::release(RESOURCE_TEXTURE, skyboxTextureID);
 
 	// Empty buffers
 	vertices.clear();
@@ -55,6 +58,9 @@ Water::~Water() {
 
 float Water::getWaterLevel() { return water_level; }
 
+// The ripple offset is advanced by the simulation, the dudv map tiles so only the fraction matters
+void Water::setMoveFactor(double offset) { move_factor = (float)fmod(offset, 1.0); }
+
 /*-------------------------BUFFER CREATION CODE------------------*/
 void Water::loadWaterGrid() {
 	int width = 5;
@@ -197,66 +203,113 @@ void Water::loadMaps() {
 }
 
 void Water::loadTexture(const char * filename, GLuint * textureID) {
-	int twidth, theight, channels;
-	unsigned char* tdata;  // texture pixel data
+	// Create ID for texture now, the pixels get filled in once they are decoded
+	bool created;
+	GLuint texture = ResourceCache::acquire(RESOURCE_TEXTURE, std::string("texture2d:repeat:") + filename, []() { GLuint id; glGenTextures(1, &id); return id; }, &created);
+	*textureID = texture;
+	if (!created) return;
+	ResourceCache::begin_loading(RESOURCE_TEXTURE, texture, 1);
+
+	std::shared_ptr<DecodedImage> image(new DecodedImage());
+	std::shared_ptr<BakedTexture> baked(new BakedTexture());
+	AssetLoader::load([image, baked, filename]() {
+		// Prefer the compressed mip chain from --bake, decode the png if there isn't one
+		if (TextureBaker::load(filename, *baked)) return;
+		int channels;
+		VFSFile file;
+		if (VFS::open(filename, file))
+			image->data = SOIL_load_image_from_memory((const unsigned char *)file.data(), (int)file.size(), &image->width, &image->height, &channels, SOIL_LOAD_RGB);
+		image->from_soil = true;
+	}, [image, baked, texture, filename]() {
+		if (baked->empty() && (image->data == NULL || image->width < 0 || image->height < 0)) {
+			ResourceCache::end_loading(RESOURCE_TEXTURE, texture);
+			std::cout << filename << " not loaded correctly!" << std::endl;
+			return;
+		}
 
-	// Create ID for texture
-	glGenTextures(1, textureID);
+		// Set this texture to be the one we are working with
+		glBindTexture(GL_TEXTURE_2D, texture);
 
-	// Set this texture to be the one we are working with
-	glBindTexture(GL_TEXTURE_2D, *textureID);
+		// Some lighting/filtering settings
+		glTexEnvf(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);	// set GL_MODULATE to mix texture with polygon color for shading
 
-	// Some lighting/filtering settings
-	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);	// Don't let bytes be padded
-	glTexEnvf(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);	// set GL_MODULATE to mix texture with polygon color for shading
+		// Set bi-linear filtering for both minification and magnification
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
 
-	tdata = SOIL_load_image(filename, &twidth, &theight, &channels, SOIL_LOAD_RGB);
-	if (twidth < 0 || theight < 0) {
-		std::cout << filename << " not loaded correctly!" << std::endl;
-		return;
-	}
+		glBindTexture(GL_TEXTURE_2D, 0);
 
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, twidth, theight, 0, GL_RGB, GL_UNSIGNED_BYTE, tdata);
-
-	// Set bi-linear filtering for both minification and magnification
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-
-	SOIL_free_image_data(tdata);
-	glBindTexture(GL_TEXTURE_2D, 0);
+		// Pixels go through a staging PBO, the map is usable once the upload has been issued
+		std::function<void()> done = [texture]() { ResourceCache::end_loading(RESOURCE_TEXTURE, texture); };
+		if (!baked->empty()) {
+			ResourceCache::add_size(RESOURCE_TEXTURE, texture, baked->data_size());
+			TextureUploader::upload_compressed(texture, GL_TEXTURE_2D, GL_TEXTURE_2D, baked, done);
+		}
+		else {
+			ResourceCache::add_size(RESOURCE_TEXTURE, texture, image->width * image->height * 3);
+			TextureUploader::upload(texture, GL_TEXTURE_2D, GL_TEXTURE_2D, image, done);
+		}
+	});
 }
 
 void Water::loadSkyboxTexture() {
-	int twidth, theight;   // texture width/height [pixels]
-	unsigned char* tdata;  // texture pixel data
+	// Same key as the skybox's cube map, so normally this just shares the one Cube already loads
+	std::string key = "cubemap:clamp";
+	for (unsigned int i = 0; i < faces.size(); i++) key += std::string(";") + faces[i];
 
-	// Create ID for texture
-	glGenTextures(1, &skyboxTextureID);
+	bool created;
+	skyboxTextureID = ResourceCache::acquire(RESOURCE_TEXTURE, key, []() { GLuint id; glGenTextures(1, &id); return id; }, &created);
+	if (!created) return;
 
 	// Set this texture to be the one we are working with
 	glBindTexture(GL_TEXTURE_CUBE_MAP, skyboxTextureID);
 
-	// Load image files
-	for (unsigned int i = 0; i < faces.size(); i++)
-	{
-		tdata = loadPPM(faces[i], twidth, theight);
-		if (tdata == NULL) return;
-
-		// Generate the texture
-		glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, 3, twidth, theight, 0, GL_RGB, GL_UNSIGNED_BYTE, tdata);
-	}
-
 	// Set bi-linear filtering for both minification and magnification
 	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
 	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
 	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+	glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+
+	// Load image files, one job per face
+	GLuint texture = skyboxTextureID;
+	ResourceCache::begin_loading(RESOURCE_TEXTURE, texture, (int)faces.size());
+	for (unsigned int i = 0; i < faces.size(); i++)
+	{
+		const char * face = faces[i];
+		std::shared_ptr<DecodedImage> image(new DecodedImage());
+		std::shared_ptr<BakedTexture> baked(new BakedTexture());
+		AssetLoader::load([this, image, baked, face]() {
+			if (!TextureBaker::load(face, *baked))
+				image->data = loadPPM(face, image->width, image->height);
+		}, [image, baked, i, texture]() {
+			if (image->data == NULL && baked->empty()) {
+				ResourceCache::end_loading(RESOURCE_TEXTURE, texture);
+				return;
+			}
+
+			// Generate the texture
+			std::function<void()> done = [texture]() { ResourceCache::end_loading(RESOURCE_TEXTURE, texture); };
+			if (!baked->empty()) {
+				ResourceCache::add_size(RESOURCE_TEXTURE, texture, baked->data_size());
+				TextureUploader::upload_compressed(texture, GL_TEXTURE_CUBE_MAP, GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, baked, done);
+			}
+			else {
+				ResourceCache::add_size(RESOURCE_TEXTURE, texture, image->width * image->height * 3);
+				TextureUploader::upload(texture, GL_TEXTURE_CUBE_MAP, GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, image, done);
+			}
+		});
+	}
 }
 
 void Water::draw(GLuint shaderProgram) {
+	// Distortion maps and cube map still loading
+	if (!ResourceCache::is_loaded(RESOURCE_TEXTURE, dudvTextureID) || !ResourceCache::is_loaded(RESOURCE_TEXTURE, normalTextureID) ||
+		!ResourceCache::is_loaded(RESOURCE_TEXTURE, skyboxTextureID)) return;
+
 	// Calculate the combination of the model and view (camera inverse) matrices
 	glm::mat4 modelview = Window::V * toWorld;
 
@@ -279,17 +332,17 @@ void Water::draw(GLuint shaderProgram) {
 
 	// Add dudv_map to fragment shader
 	glUniform1i(glGetUniformLocation(shaderProgram, "dudv_map"), 2);
-	move_factor += WAVE_SPEED;	// Calculate wave speed and keep it from going above 1
-	move_factor = fmod(move_factor, FLT_MAX - 1);
-	//move_factor = glm::cos(move_factor);
-	//move_factor = fmod(move_factor, 0.5f);
-
 	glUniform1f(glGetUniformLocation(shaderProgram, "move_factor"), move_factor);
+	float reflect_scale[2], refract_scale[2];
+	DynamicResolution::uv_scale(RES_REFLECTION, reflect_scale);
+	DynamicResolution::uv_scale(RES_REFRACTION, refract_scale);
+	glUniform2fv(glGetUniformLocation(shaderProgram, "reflect_scale"), 1, reflect_scale);
+	glUniform2fv(glGetUniformLocation(shaderProgram, "refract_scale"), 1, refract_scale);
 
 	// Add normal map to fragment shader
 	glUniform1i(glGetUniformLocation(shaderProgram, "normal_map"), 3);
-	glUniform3f(glGetUniformLocation(shaderProgram, "light_dir"), -0.3f, 0.2f, -1.0f);
-	glUniform3f(glGetUniformLocation(shaderProgram, "light_color"), 1.0, 1.0, 1.0);
+	glUniform3fv(glGetUniformLocation(shaderProgram, "light_dir"), 1, &Lights::sun_direction.x);
+	glUniform3fv(glGetUniformLocation(shaderProgram, "light_color"), 1, &Lights::sun_color.x);
 
 	// Add depth texture
 	glUniform1i(glGetUniformLocation(shaderProgram, "depth_map"), 5);
@@ -334,6 +387,8 @@ void Water::draw(GLuint shaderProgram) {
 }
 
 void Water::init_FBOs() {
+	FBO_width = Window::width;
+	FBO_height = Window::height;
 	init_reflection_buff();
 	init_refraction_buff();
 	unbind_FBO();
@@ -426,15 +481,16 @@ will be printed and this function will return 0
 **/
 unsigned char* Water::loadPPM(const char* filename, int& width, int& height)
 {
+	PROFILE_ZONE("Water::loadPPM");
 	const int BUFSIZE = 128;
-	FILE* fp;
+	VFSFile fp;
 	unsigned int read;
 	unsigned char* rawData;
 	char buf[3][BUFSIZE];
 	char* retval_fgets;
 	size_t retval_sscanf;
 
-	if ((fp = fopen(filename, "rb")) == NULL)
+	if (!VFS::open(filename, fp))
 	{
 		std::cerr << "error reading ppm file, could not locate " << filename << std::endl;
 		width = 0;
@@ -443,12 +499,12 @@ unsigned char* Water::loadPPM(const char* filename, int& width, int& height)
 	}
 
 	// Read magic number:
-	retval_fgets = fgets(buf[0], BUFSIZE, fp);
+	retval_fgets = fp.gets(buf[0], BUFSIZE);
 
 	// Read width and height:
 	do
 	{
-		retval_fgets = fgets(buf[0], BUFSIZE, fp);
+		retval_fgets = fp.gets(buf[0], BUFSIZE);
 	} while (buf[0][0] == '#');
 	retval_sscanf = sscanf(buf[0], "%s %s", buf[1], buf[2]);
 	width = atoi(buf[1]);
@@ -457,13 +513,13 @@ unsigned char* Water::loadPPM(const char* filename, int& width, int& height)
 	// Read maxval:
 	do
 	{
-		retval_fgets = fgets(buf[0], BUFSIZE, fp);
+		retval_fgets = fp.gets(buf[0], BUFSIZE);
 	} while (buf[0][0] == '#');
 
 	// Read image data:
 	rawData = new unsigned char[width * height * 3];
-	read = fread(rawData, width * height * 3, 1, fp);
-	fclose(fp);
+	read = fp.read(rawData, width * height * 3, 1);
+	fp.close();
 	if (read != 1)
 	{
 		std::cerr << "error parsing ppm file, incomplete data" << std::endl;
@@ -477,6 +533,11 @@ unsigned char* Water::loadPPM(const char* filename, int& width, int& height)
 }
 
 void Water::resize_FBOs() {
+	// Passes render into a corner of these when they are scaled down, so only the window size matters
+	if (Window::width == FBO_width && Window::height == FBO_height) return;
+	FBO_width = Window::width;
+	FBO_height = Window::height;
+
 	// Resize Reflection FBO
 	glBindFramebuffer(GL_FRAMEBUFFER, reflect_FBO);
 	glBindTexture(GL_TEXTURE_2D, reflect_texture);
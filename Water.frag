@@ -16,6 +16,8 @@ uniform samplerCube skybox;
 uniform vec3 light_color;
 uniform vec3 light_dir;
 uniform float move_factor;			// For creating water ripples
+uniform vec2 reflect_scale;			// Corner of reflect_texture the reflection pass rendered, see DynamicResolution.h
+uniform vec2 refract_scale;			// Same for refract_texture and depth_map
 
 // You can output many things. The first vec4 type output determines the color of the fragment
 out vec4 color;
@@ -36,7 +38,7 @@ void main() {
 	// Get water depth info
 	float nearPlane = 0.1f;
 	float farPlane = 1000.0f;
-	float depth = texture(depth_map, refractTexCoords).r;
+	float depth = texture(depth_map, refractTexCoords * refract_scale).r;
 	float floorDist = 2.0 * nearPlane * farPlane / (farPlane + nearPlane - (2.0 * depth - 1.0) * (farPlane - nearPlane));
 
 	depth = gl_FragCoord.z;
@@ -54,8 +56,8 @@ void main() {
 	refractTexCoords += total_distort;
 	refractTexCoords = clamp(refractTexCoords, 0.001, 0.999);
 	
-	vec4 reflectColor = texture(reflect_texture, reflectTexCoords);
-	vec4 refractColor = texture(refract_texture, refractTexCoords);
+	vec4 reflectColor = texture(reflect_texture, vec2(reflectTexCoords.x, 1.0 + reflectTexCoords.y) * reflect_scale);	// Wrapped back into 0-1 first
+	vec4 refractColor = texture(refract_texture, refractTexCoords * refract_scale);
 
 	// Add normal map for specular lighting
 	vec4 normalMapColor = texture(normal_map, distortTexCoords);
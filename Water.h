@@ -19,6 +19,8 @@
 #include <vector>
 #include "soil.h"
 
+#define WAVE_SPEED 0.06	// Ripple offset per second of simulation time
+
 class Water {
 private:
 	glm::mat4 toWorld;
@@ -29,6 +31,7 @@ private:
 	GLuint VBO, VAO, NBO, TBO, EBO;
 	GLuint reflect_FBO, reflect_texture, reflect_DBO;	// For reflection frame buffer
 	GLuint refract_FBO, refract_texture, refract_DTO;	// For refraction frame buffer
+	int FBO_width, FBO_height;	// Window size the FBOs were last made for
 	GLuint uProjection, uModelview, uView, uModel;
 	GLuint dudvTextureID, normalTextureID, skyboxTextureID;
 
@@ -70,6 +73,7 @@ public:
 	~Water();
 
 	float getWaterLevel();
+	void setMoveFactor(double offset);
 
 	void loadWaterGrid();	// Triangular grid loading along with its vertices, normals
 	void genIndexBuff();	// Create indices for grid
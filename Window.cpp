@@ -1,5 +1,7 @@
 #include "Window.h"
 
+#include <algorithm>
+
 const char* window_title = "GLFW Starter Project";
 Cube * skybox;
 OBJObject* anchor;
@@ -10,24 +12,27 @@ OBJObject* hut;
 OBJObject* chair2;
 OBJObject* rock;
 OBJObject* rock2;
-GLint shaderProgram;
-GLint terrainShader;
+ShaderVariants * objectShaders;
+ShaderVariants * terrainShaders;
+ShaderVariants * patchShaders;
 GLint waterShader;
 Terrain * default_ground;
 Terrain * lake_ground;
 Terrain * coast_ground;
 Water * water;
-Patch* patch1;
-Patch* patch2;
-Patch* patch3;
-Patch* patch4;
+PatchNetwork * patches;
 double cursorPosX = 0.0;
 double cursorPosY = 0.0;
 bool Window::toon = true;
 bool Window::illuminate_terr = true;
 bool Window::simple_patches = false;
+bool Window::gpu_patches = true;
+bool Window::animate_patches = false;
+bool Window::sort_opaque = true;
+bool Window::depth_prepass = false;
+bool Window::lod_enabled = true;
+float Window::lod_bias = 1.0f;
 
-unsigned int ground_type = 0;	// Default ground to render based off of SD heightmap
 
 // On some systems you need to change this to the absolute path
 #define VERTEX_SHADER_PATH "../shader.vert"
@@ -36,6 +41,9 @@ unsigned int ground_type = 0;	// Default ground to render based off of SD height
 #define TERR_SHADER_FRAG_PATH "../terrainShader.frag"
 #define WATER_SHADER_VERT_PATH "../water.vert"
 #define WATER_SHADER_FRAG_PATH "../water.frag"
+#define PATCH_SHADER_VERT_PATH "../patch.vert"
+#define PATCH_SHADER_TESC_PATH "../patch.tesc"
+#define PATCH_SHADER_TESE_PATH "../patch.tese"
 
 #define SD_TERRAIN 0
 #define LAKE_TERRAIN 1
@@ -56,16 +64,47 @@ glm::vec3(-9.0f, -1.0f, -3.0f), glm::vec3(-6.0f, -1.0f, -3.0f), glm::vec3(-3.0f,
 glm::vec3(-9.0f, -1.0f, -6.0f), glm::vec3(-6.0f, -1.0f, -6.0f), glm::vec3(-3.0f, -0.5f, -6.0f), glm::vec3(0.0f, 0.0f, -6.0f),
 glm::vec3(-9.0f, 0.0f, -9.0f), glm::vec3(-6.0f, 0.0f, -9.0f), glm::vec3(-3.0f, 0.0f, -9.0f), glm::vec3(0.0f, 0.0f, -9.0f) };
 
-glm::vec3 patchPts4[16] = { glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(3.0f, 0.0f, 0.5f), glm::vec3(6.0f, 0.0f, 0.0f), glm::vec3(9.0f, 0.0f, 0.0f),
+glm::vec3 patchPts4[16] = { glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(3.0f, 0.0f, 0.0f), glm::vec3(6.0f, 0.0f, 0.0f), glm::vec3(9.0f, 0.0f, 0.0f),
 glm::vec3(0.0f, 0.0f, -3.0f), glm::vec3(3.0f, 0.5f, -3.0f), glm::vec3(6.0f, 1.0f, -3.0f), glm::vec3(9.0f, 1.0f, -3.0f),
 glm::vec3(0.0f, 0.0f, -6.0f), glm::vec3(3.0f, 0.5f, -6.0f), glm::vec3(6.0f, 1.0f, -6.0f), glm::vec3(9.0f, 1.0f, -6.0f),
 glm::vec3(0.0f, 0.0f, -9.0f), glm::vec3(3.0f, 0.0f, -9.0f), glm::vec3(6.0f, 0.0f, -9.0f), glm::vec3(9.0f, 0.0f, -9.0f) };
 
+// Props on the beach ground with their material: colour and ambient, diffuse, specular, shininess
+struct Prop
+{
+	OBJObject ** object;
+	glm::vec3 color;
+	glm::vec4 material;
+};
+static const Prop props[] = {
+	{ &anchor, glm::vec3(0.5f, 0.5f, 0.5f), glm::vec4(0.3f, 1.0f, 0.5f, 32.0f) },
+	{ &beachball, glm::vec3(0.2f, 0.2f, 0.9f), glm::vec4(0.3f, 1.0f, 0.7f, 32.0f) },
+	{ &chair, glm::vec3(1.0f, 1.0f, 0.9f), glm::vec4(0.3f, 1.0f, 0.77f, 76.8f) },
+	{ &crab, glm::vec3(0.7f, 0.4f, 0.3f), glm::vec4(0.3f, 1.0f, 0.65f, 76.8f) },
+	{ &hut, glm::vec3(0.6f, 0.18f, 0.0f), glm::vec4(0.3f, 1.0f, 0.2f, 32.0f) },
+	{ &chair2, glm::vec3(0.5f, 0.5f, 0.5f), glm::vec4(0.3f, 1.0f, 0.7f, 10.0f) },
+	{ &rock, glm::vec3(0.4f, 0.4f, 0.4f), glm::vec4(0.3f, 1.0f, 0.2f, 16.0f) },
+	{ &rock2, glm::vec3(0.9f, 0.7f, 0.5f), glm::vec4(0.3f, 1.0f, 0.2f, 16.0f) },
+};
+#define PROP_COUNT ((int)(sizeof(props) / sizeof(props[0])))
+
+enum OpaqueKind { DRAW_PROP, DRAW_PATCHES, DRAW_TERRAIN };
+struct OpaqueDraw
+{
+	float depth;	// Of the centre along the view direction
+	OpaqueKind kind;
+	int index;		// Into props
+	bool operator<(const OpaqueDraw & other) const { return depth < other.depth; }
+};
+static std::vector<OpaqueDraw> opaque_order;	// Rebuilt by every render_scene, reused by both passes
+
 // Default camera parameters
 glm::vec3 Window::cam_pos(182.0f, 0.0f, -5.0f);		// e  | Position of camera
 glm::vec3 Window::cam_look_at(-1.0f, 0.0f, -300.0f);	// d  | This is where the camera looks at
 glm::vec3 Window::cam_up(0.0f, 1.0f, 0.0f);			// up | What orientation "up" is
 
+unsigned int Window::ground_type = 0;	// Default ground to render based off of SD heightmap
+
 int Window::width;
 int Window::height;
 
@@ -78,6 +117,39 @@ float Window::plane_vec_dir;
 
 void Window::initialize_objects()
 {
+	PROFILE_ZONE("initialize_objects");
+	Profiler::set_thread_name("main");
+
+	// Decode files on worker threads, everything below just queues its loads
+	AssetLoader::start(ThreadPool::default_threads());
+	TextureUploader::init();
+	TextureBaker::init();
+	TextureUploader::report_memory("before loading");
+
+	// Load the shader programs first, on a cache miss they compile in the background while everything else loads.
+	// Make sure you have the correct filepath up top
+	ShaderCache::init();
+	// Every variant the 1, 6 and T keys can switch to is compiled now, so toggling never waits on the driver
+	objectShaders = new ShaderVariants(VERTEX_SHADER_PATH, FRAGMENT_SHADER_PATH);
+	objectShaders->prepare(0);
+	objectShaders->prepare(FEATURE_TOON);
+	objectShaders->prepare(FEATURE_SKYBOX);
+	objectShaders->prepare(FEATURE_DEPTH_ONLY);
+	terrainShaders = new ShaderVariants(TERR_SHADER_VERT_PATH, TERR_SHADER_FRAG_PATH);
+	terrainShaders->prepare(0);
+	terrainShaders->prepare(FEATURE_TOON);
+	terrainShaders->prepare(FEATURE_UNLIT);
+	terrainShaders->prepare(FEATURE_DEPTH_ONLY);
+	Patch::init();
+	patchShaders = new ShaderVariants(PATCH_SHADER_VERT_PATH, PATCH_SHADER_TESC_PATH, PATCH_SHADER_TESE_PATH, FRAGMENT_SHADER_PATH);
+	if (Patch::tessellation)
+	{
+		patchShaders->prepare(0);
+		patchShaders->prepare(FEATURE_TOON);
+		patchShaders->prepare(FEATURE_DEPTH_ONLY);
+	}
+	waterShader = ResourceCache::program(WATER_SHADER_VERT_PATH, WATER_SHADER_FRAG_PATH);
+
 	skybox = new Cube();
 	default_ground = new Terrain();
 	lake_ground = new Terrain(1000.0f, 35.0f, -14.0f, "../assets/lake.png", "../assets/textures/grass.ppm");
@@ -86,11 +158,6 @@ void Window::initialize_objects()
 	water->init_FBOs();
 	water_level = water->getWaterLevel() + 0.01f;	// Add a small offset for clipping plane to remove glitchy edges
 
-	// Load the shader program. Make sure you have the correct filepath up top
-	shaderProgram = LoadShaders(VERTEX_SHADER_PATH, FRAGMENT_SHADER_PATH);
-	terrainShader = LoadShaders(TERR_SHADER_VERT_PATH, TERR_SHADER_FRAG_PATH);
-	waterShader = LoadShaders(WATER_SHADER_VERT_PATH, WATER_SHADER_FRAG_PATH);
-
 	anchor = new OBJObject("../assets/object_files/Anchor.obj");
 	beachball = new OBJObject("../assets/object_files/beachball.obj");
 	chair = new OBJObject("../assets/object_files/beachchair_C.obj");
@@ -99,10 +166,12 @@ void Window::initialize_objects()
 	chair2 = new OBJObject("../assets/object_files/obj.obj");
 	rock = new OBJObject("../assets/object_files/Stone_F_3.obj");
 	rock2 = new OBJObject("../assets/object_files/Stone_Forest_1.obj");
-	patch1 = new Patch(glm::vec3(180.0f, -4.8f, -5.0f), patchPts1);
-	patch2 = new Patch(glm::vec3(180.0f, -4.8f, -5.0f), patchPts2);
-	patch3 = new Patch(glm::vec3(180.0f, -4.8f, -5.0f), patchPts3);
-	patch4 = new Patch(glm::vec3(180.0f, -4.8f, -5.0f), patchPts4);
+	patches = new PatchNetwork(glm::vec3(180.0f, -4.8f, -5.0f));
+	patches->add_patch(patchPts1);
+	patches->add_patch(patchPts2);
+	patches->add_patch(patchPts3);
+	patches->add_patch(patchPts4);
+	patches->build();
 	// -/+x: Left/Right    -/+y: Down/Up    -/+z: Forward/Back
 	anchor->rotate(0.0f, 1.0f, 0.0f, 0.0f);
 	anchor->resize(2.0f);
@@ -125,11 +194,21 @@ void Window::initialize_objects()
 	rock->move(150.0f, 0.0f, 50.0f);
 	rock2->resize(2.0f);
 	rock2->move(150.0f, 0.0f, -75.0f);
+
+	GPUTimer::init();
+	OverdrawCounter::init();
+	OcclusionQueries::init();
+	Lights::init();
+	DynamicResolution::init();
+	Simulation::start(false);
 }
 
 // Treat this as a destructor function. Delete dynamically allocated memory here.
 void Window::clean_up()
 {
+	Simulation::stop();
+	AssetLoader::shutdown();	// Wait for loader threads before deleting what they write into
+	TextureUploader::clean_up();
 	delete(skybox);
 	delete(anchor);
 	delete(beachball);
@@ -143,13 +222,17 @@ void Window::clean_up()
 	delete(lake_ground);
 	delete(coast_ground);
 	delete(water);
-	delete(patch1);
-	delete(patch2);
-	delete(patch3);
-	delete(patch4);
-	glDeleteProgram(shaderProgram);
-	glDeleteProgram(terrainShader);
-	glDeleteProgram(waterShader);
+	delete(patches);
+	delete(objectShaders);
+	delete(terrainShaders);
+	delete(patchShaders);
+	ResourceCache::release(RESOURCE_PROGRAM, waterShader);
+	GPUTimer::clean_up();
+	OverdrawCounter::clean_up();
+	OcclusionQueries::clean_up();
+	Lights::clean_up();
+	DynamicResolution::clean_up();
+	Flythrough::stop_recording();
 }
 
 GLFWwindow* Window::create_window(int width, int height)
@@ -220,16 +303,52 @@ void Window::resize_callback(GLFWwindow* window, int width, int height)
 
 void Window::idle_callback()
 {
+	PROFILE_ZONE("idle");
+	// Animation runs on a fixed timestep, independent of how fast we render
+	Simulation::advance();
 }
 
 void Window::display_callback(GLFWwindow* window)
 {
+	PROFILE_ZONE("frame");
+	FramePacer::begin_frame();
+	GPUTimer::begin_frame();
+
+	// Upload whatever the loader threads have finished decoding
+	AssetLoader::drain(ASSET_UPLOAD_BUDGET_MS);
+	TextureUploader::update();
+
+	// Nothing can draw until the programs have linked, keep loading and show an empty frame meanwhile
+	ShaderCache::update();
+	if (ShaderCache::pending() > 0)
+	{
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		GPUTimer::end_frame();
+		if (!FramePacer::pacing) FramePacer::poll_events();
+		FramePacer::before_swap();
+		glfwSwapBuffers(window);
+		FramePacer::after_swap();
+		return;
+	}
+
+	// Recordings log the camera here, playback places it and moves the simulation clock
+	Flythrough::update(window);
+	// Pass sizes for this frame from the last GPU timings
+	DynamicResolution::update();
+
+	// Blend the two newest simulation states to this frame's time
+	SimState state = Simulation::render_state();
+	water->setMoveFactor(state.wave_offset);
+	update_patches(state.time);
+	Lights::update(state.time);
+
 	glEnable(GL_CLIP_DISTANCE0);	// Use clipping plane only for reflection/refraction texture creation
 
 	/* Render twice for reflection and refraction*/
 	// Reflection texture
 	water->resize_FBOs();
 	water->bind_reflect_FBO();
+	DynamicResolution::begin_pass(RES_REFLECTION);
 	plane_vec_dir = 1.0;
 	water_level *= -1.0;
 	// position the camera to simulate the reflection texture
@@ -237,75 +356,232 @@ void Window::display_callback(GLFWwindow* window)
 	float look_at_distance = 2 * (cam_look_at.y - water->getWaterLevel());
 	cam_pos.y -= distance;
 	cam_look_at.y -= look_at_distance;
-	render_scene();
+	lod_bias = LOD_REFLECTION_BIAS;	// Props only show up rippled in the water, coarser meshes are fine
+	{
+		PROFILE_ZONE("reflection pass");
+		GPUTimer::begin("reflection");
+		OcclusionQueries::set_pass(OCCLUSION_REFLECTION);
+		render_scene();
+		GPUTimer::end();
+	}
 	cam_pos.y += distance;	// Move back to original position
 	cam_look_at.y += look_at_distance;
 
 	// Refraction texture
 	water->bind_refract_FBO();
+	DynamicResolution::begin_pass(RES_REFRACTION);
 	plane_vec_dir = -1.0;
 	water_level *= -1.0;
-	render_scene();
+	{
+		PROFILE_ZONE("refraction pass");
+		GPUTimer::begin("refraction");
+		OcclusionQueries::set_pass(OCCLUSION_REFRACTION);
+		render_scene();
+		GPUTimer::end();
+	}
 	water->unbind_FBO();
+	lod_bias = 1.0f;
 
 	glDisable(GL_CLIP_DISTANCE0);
 
-	// Actual scene
-	render_scene();
+	// Actual scene, offscreen when it's scaled down
+	DynamicResolution::begin_pass(RES_MAIN);
+	{
+		PROFILE_ZONE("main pass");
+		GPUTimer::begin("main");
+		OcclusionQueries::set_pass(OCCLUSION_MAIN);
+		render_scene(true);
+		GPUTimer::end();
+	}
 
 	// Render water
-	glUseProgram(waterShader);
-	water->draw(waterShader);
+	{
+		PROFILE_ZONE("water");
+		GPUTimer::begin("water");
+		glUseProgram(waterShader);
+		water->draw(waterShader);
+		GPUTimer::end();
+	}
+	DynamicResolution::end_main();
+
+	GPUTimer::end_frame();
 
 	// Gets events, including input such as keyboard and mouse or window resizing
-	glfwPollEvents();
+	// Paced frames already polled at the start, right before the camera was latched
+	if (!FramePacer::pacing)
+	{
+		PROFILE_ZONE("poll events");
+		FramePacer::poll_events();
+	}
 	// Swap buffers
-	glfwSwapBuffers(window);
+	{
+		PROFILE_ZONE("swap buffers");
+		FramePacer::before_swap();
+		glfwSwapBuffers(window);
+		FramePacer::after_swap();
+	}
+
+	static bool first_frame = true;
+	if (first_frame)
+	{
+		first_frame = false;
+		std::cout << "First frame after " << Profiler::now() / 1000.0 << " ms (" << AssetLoader::pending() << " assets still loading)" << std::endl;
+	}
+
+	static bool memory_reported = false;
+	if (!memory_reported && AssetLoader::pending() == 0 && TextureUploader::queued() == 0)
+	{
+		memory_reported = true;
+		TextureUploader::report_memory("after loading");
+		ResourceCache::report();
+		VFS::report();
+	}
 }
 
-void Window::render_scene() {
+// Ripples the inner control points when animate_patches is on, and puts them back when it's off.
+// Edge control points stay where they are so the welded edges still match. Only patches whose
+// points actually changed get re-evaluated, and every patch picks its level for this frame's camera.
+void Window::update_patches(double time) {
+	glm::vec3 * base[4] = { patchPts1, patchPts2, patchPts3, patchPts4 };
+	for (int p = 0; p < 4; p++)
+	{
+		glm::vec3 moved[16];
+		for (int i = 0; i < 16; i++)
+		{
+			moved[i] = base[p][i];
+			bool inner = i / 4 > 0 && i / 4 < 3 && i % 4 > 0 && i % 4 < 3;
+			if (animate_patches && inner) moved[i].y += 0.75f * (float)sin(2.0 * time + p * 1.7 + i);
+		}
+		patches->set_control_points(p, moved);
+	}
+	patches->update(cam_pos, P[1][1] * DynamicResolution::height(RES_MAIN) * 0.5f, simple_patches);
+}
+
+void Window::render_scene(bool count_overdraw) {
+	PROFILE_ZONE("render_scene");
 	// Clear the color and depth buffers
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	V = glm::lookAt(cam_pos, cam_look_at, cam_up);
+	Lights::build(V, P);	// Point lights binned for this pass's camera
 
-	// Use the shader of programID
-	glUseProgram(shaderProgram);
+	// Everything opaque, nearest first by the view depth of its centre, so whatever is behind fails
+	// the depth test before its fragment shader runs
+	Terrain * ground = ground_type == 1 ? lake_ground : ground_type == 2 ? coast_ground : default_ground;
+	glm::vec3 view_dir = glm::normalize(cam_look_at - cam_pos);
+	opaque_order.clear();
+	if (ground_type == SD_TERRAIN) {
+		for (int i = 0; i < PROP_COUNT; i++)
+		{
+			OpaqueDraw draw = { glm::dot((*props[i].object)->center() - cam_pos, view_dir), DRAW_PROP, i };
+			opaque_order.push_back(draw);
+		}
+		OpaqueDraw draw = { glm::dot(patches->center() - cam_pos, view_dir), DRAW_PATCHES, 0 };
+		opaque_order.push_back(draw);
+	}
+	OpaqueDraw terrain = { glm::dot(ground->center() - cam_pos, view_dir), DRAW_TERRAIN, 0 };
+	opaque_order.push_back(terrain);
+	if (sort_opaque) std::stable_sort(opaque_order.begin(), opaque_order.end());
+
+	GLuint skyboxShader = objectShaders->get(FEATURE_SKYBOX);
+	if (!sort_opaque) {
+		// Old order for comparison: sky first, then everything in declaration order
+		GPUTimer::begin("skybox");
+		glUseProgram(skyboxShader);
+		skybox->draw(skyboxShader);
+		GPUTimer::end();
+	}
 
-	// Render
-	V = glm::lookAt(cam_pos, cam_look_at, cam_up);
-	skybox->draw(shaderProgram);
+	// Overdraw is only the opaque draws. Without pipeline statistics it's a samples passed query,
+	// which can't be open while the occlusion tests below run theirs
+	if (count_overdraw) OverdrawCounter::begin();
+
+	// Depth only first, then the shaded pass only runs fragments that are actually visible
+	if (depth_prepass) {
+		GPUTimer::begin("depth prepass");
+		glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+		draw_opaque(true);
+		glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+		glDepthMask(GL_FALSE);
+		GPUTimer::end();
+	}
+
+	GPUTimer::begin("opaque");
+	draw_opaque(false);
+	GPUTimer::end();
+	glDepthMask(GL_TRUE);
+	if (count_overdraw) OverdrawCounter::end();
+
+	// Props' bounding boxes against this pass's finished depth, the same pass next frame draws by them
 	if (ground_type == SD_TERRAIN) {
-		anchor->draw(shaderProgram, glm::vec3(0.5f, 0.5f, 0.5f), glm::vec3(1.0f, 1.0f, 1.0f), glm::vec3(-0.3f, 0.2f, -1.0f), cam_pos, glm::vec4(0.3f, 1.0f, 0.5f, 32.0f), toon);
-		beachball->draw(shaderProgram, glm::vec3(0.2f, 0.2f, 0.9f), glm::vec3(1.0f, 1.0f, 1.0f), glm::vec3(-0.3f, 0.2f, -1.0f), cam_pos, glm::vec4(0.3f, 1.0f, 0.7f, 32.0f), toon);
-		chair->draw(shaderProgram, glm::vec3(1.0f, 1.0f, 0.9f), glm::vec3(1.0f, 1.0f, 1.0f), glm::vec3(-0.3f, 0.2f, -1.0f), cam_pos, glm::vec4(0.3f, 1.0f, 0.77f, 76.8f), toon);
-		crab->draw(shaderProgram, glm::vec3(0.7f, 0.4f, 0.3f), glm::vec3(1.0f, 1.0f, 1.0f), glm::vec3(-0.3f, 0.2f, -1.0f), cam_pos, glm::vec4(0.3f, 1.0f, 0.65f, 76.8f), toon);
-		hut->draw(shaderProgram, glm::vec3(0.6f, 0.18f, 0.0f), glm::vec3(1.0f, 1.0f, 1.0f), glm::vec3(-0.3f, 0.2f, -1.0f), cam_pos, glm::vec4(0.3f, 1.0f, 0.2f, 32.0f), toon);
-		chair2->draw(shaderProgram, glm::vec3(0.5f, 0.5f, 0.5f), glm::vec3(1.0f, 1.0f, 1.0f), glm::vec3(-0.3f, 0.2f, -1.0f), cam_pos, glm::vec4(0.3f, 1.0f, 0.7f, 10.0f), toon);
-		rock->draw(shaderProgram, glm::vec3(0.4f, 0.4f, 0.4f), glm::vec3(1.0f, 1.0f, 1.0f), glm::vec3(-0.3f, 0.2f, -1.0f), cam_pos, glm::vec4(0.3f, 1.0f, 0.2f, 16.0f), toon);
-		rock2->draw(shaderProgram, glm::vec3(0.9f, 0.7f, 0.5f), glm::vec3(1.0f, 1.0f, 1.0f), glm::vec3(-0.3f, 0.2f, -1.0f), cam_pos, glm::vec4(0.3f, 1.0f, 0.2f, 16.0f), toon);
-		patch1->draw(shaderProgram, glm::vec3(0.0f, 0.6f, 0.6f), glm::vec3(1.0f, 1.0f, 1.0f), glm::vec3(-0.3f, 0.2f, -1.0f), cam_pos, glm::vec4(0.3f, 1.0f, 0.1f, 16.0f), toon, simple_patches);
-		patch2->draw(shaderProgram, glm::vec3(0.0f, 0.6f, 0.6f), glm::vec3(1.0f, 1.0f, 1.0f), glm::vec3(-0.3f, 0.2f, -1.0f), cam_pos, glm::vec4(0.3f, 1.0f, 0.1f, 16.0f), toon, simple_patches);
-		patch3->draw(shaderProgram, glm::vec3(0.0f, 0.6f, 0.6f), glm::vec3(1.0f, 1.0f, 1.0f), glm::vec3(-0.3f, 0.2f, -1.0f), cam_pos, glm::vec4(0.3f, 1.0f, 0.1f, 16.0f), toon, simple_patches);
-		patch4->draw(shaderProgram, glm::vec3(0.0f, 0.6f, 0.6f), glm::vec3(1.0f, 1.0f, 1.0f), glm::vec3(-0.3f, 0.2f, -1.0f), cam_pos, glm::vec4(0.3f, 1.0f, 0.1f, 16.0f), toon, simple_patches);
+		GPUTimer::begin("occlusion tests");
+		OcclusionQueries::begin_tests(objectShaders->get(FEATURE_DEPTH_ONLY));
+		for (int i = 0; i < PROP_COUNT; i++)
+		{
+			OBJObject * object = *props[i].object;
+			OcclusionQueries::test(i, object->center(), object->isReady() ? object->world_radius() : 0.0f);
+		}
+		OcclusionQueries::end_tests();
+		GPUTimer::end();
 	}
 
-	glUseProgram(terrainShader);
-
-	// Draw different types of terrain
-	switch (ground_type) {
-	case 0:
-		default_ground->draw(terrainShader);
-		break;
-	case 1:
-		lake_ground->draw(terrainShader);
-		break;
-	case 2:
-		coast_ground->draw(terrainShader);
-		break;
+	if (sort_opaque) {
+		// On the far plane (see shader.vert), so with GL_LEQUAL it only fills the pixels nothing else covered
+		GPUTimer::begin("skybox");
+		glDepthMask(GL_FALSE);
+		glUseProgram(skyboxShader);
+		skybox->draw(skyboxShader);
+		glDepthMask(GL_TRUE);
+		GPUTimer::end();
+	}
+	glDisable(GL_CULL_FACE);	// The skybox turns it on, water and the next pass expect it off
+}
+
+void Window::draw_opaque(bool depth_only) {
+	// Pick the shader variants for the current toggles
+	GLuint shaderProgram = objectShaders->get(depth_only ? FEATURE_DEPTH_ONLY : toon ? FEATURE_TOON : 0);
+	GLuint terrainShader = terrainShaders->get(depth_only ? FEATURE_DEPTH_ONLY : !illuminate_terr ? FEATURE_UNLIT : toon ? FEATURE_TOON : 0);
+	// Tessellated on the GPU when it can, the CPU mesh uses the object shader
+	bool tessellate = gpu_patches && Patch::tessellation && !simple_patches;
+	GLuint patchShader = tessellate ? patchShaders->get(depth_only ? FEATURE_DEPTH_ONLY : toon ? FEATURE_TOON : 0) : shaderProgram;
+	Terrain * ground = ground_type == 1 ? lake_ground : ground_type == 2 ? coast_ground : default_ground;
+	glm::vec3 light_color = Lights::sun_color, light_dir = Lights::sun_direction;
+
+	GLuint bound = 0;
+	for (size_t i = 0; i < opaque_order.size(); i++) {
+		const OpaqueDraw & draw = opaque_order[i];
+		GLuint program = draw.kind == DRAW_PROP ? shaderProgram : draw.kind == DRAW_PATCHES ? patchShader : terrainShader;
+		if (program != bound) {
+			glUseProgram(program);
+			if (!depth_only) Lights::apply(program);
+			bound = program;
+		}
+		switch (draw.kind) {
+		case DRAW_PROP:
+		{
+			glEnable(GL_CULL_FACE);	// Props are closed meshes
+			bool conditional = OcclusionQueries::begin_draw(draw.index);
+			(*props[draw.index].object)->draw(program, props[draw.index].color, light_color, light_dir, cam_pos, props[draw.index].material);
+			OcclusionQueries::end_draw(conditional);
+			break;
+		}
+		case DRAW_PATCHES:
+			patches->draw(program, glm::vec3(0.0f, 0.6f, 0.6f), light_color, light_dir, cam_pos, glm::vec4(0.3f, 1.0f, 0.1f, 16.0f), tessellate);
+			break;
+		case DRAW_TERRAIN:
+			glDisable(GL_CULL_FACE);
+			ground->draw(program);
+			break;
+		}
 	}
 }
 
 void Window::key_callback(GLFWwindow* window, int key, int scancode, int action, int mods)
 {
+	Flythrough::log_key(key, scancode, action, mods);
+	// During playback only escape and the playback keys get through
+	bool playback_key = key == GLFW_KEY_ESCAPE || key == GLFW_KEY_F5 || key == GLFW_KEY_F6 || key == GLFW_KEY_F7;
+	if (!Flythrough::accepts_input() && !playback_key) return;
+
 	// Check for a key press
 	if (action == GLFW_PRESS || action == GLFW_REPEAT)
 	{
@@ -315,6 +591,24 @@ void Window::key_callback(GLFWwindow* window, int key, int scancode, int action,
 			// Close the window. This causes the program to also terminate.
 			glfwSetWindowShouldClose(window, GL_TRUE);
 		}
+		else if (key == GLFW_KEY_F5 && action == GLFW_PRESS)
+		{
+			//Start/stop recording the camera and input
+			if (Flythrough::recording()) Flythrough::stop_recording();
+			else Flythrough::record(FLYTHROUGH_RECORDING);
+		}
+		else if (key == GLFW_KEY_F6 && action == GLFW_PRESS)
+		{
+			//Play the last recording back, shift replays the input instead of the camera
+			if (Flythrough::playing()) Flythrough::stop();
+			else Flythrough::play(FLYTHROUGH_RECORDING, mods == GLFW_MOD_SHIFT);
+		}
+		else if (key == GLFW_KEY_F7 && action == GLFW_PRESS)
+		{
+			//Fly the fixed tour over every ground
+			if (Flythrough::playing()) Flythrough::stop();
+			else Flythrough::play_tour();
+		}
 		else if (key == GLFW_KEY_A)
 		{
 			//Move camera left
@@ -383,17 +677,85 @@ void Window::key_callback(GLFWwindow* window, int key, int scancode, int action,
 		}
 		else if (key == GLFW_KEY_1)
 		{
-			//Toggle toon shading
+			//Toggle toon shading, render_scene picks the matching shader variants
 			toon = !toon;
 		}
+		else if (key == GLFW_KEY_3)
+		{
+			//Toggle between GPU and CPU tessellated surface patches
+			gpu_patches = !gpu_patches;
+			std::cout << "Patches tessellated on the " << (gpu_patches && Patch::tessellation ? "GPU" : "CPU") << std::endl;
+		}
 		else if (key == GLFW_KEY_2)
 		{
 			//Toggle simple surface patches
 			simple_patches = !simple_patches;
-			patch1->reinitialize(simple_patches);
-			patch2->reinitialize(simple_patches);
-			patch3->reinitialize(simple_patches);
-			patch4->reinitialize(simple_patches);
+		}
+		else if (key == GLFW_KEY_4)
+		{
+			//Toggle rippling the surface patches
+			animate_patches = !animate_patches;
+		}
+		else if (key == GLFW_KEY_5 && action == GLFW_PRESS)
+		{
+			//Toggle sorting opaque draws front to back with the skybox last, off is the old skybox first order
+			sort_opaque = !sort_opaque;
+			std::cout << "Opaque draws " << (sort_opaque ? "front to back, skybox last" : "in scene order, skybox first") << std::endl;
+		}
+		else if (key == GLFW_KEY_6 && action == GLFW_PRESS)
+		{
+			//Toggle the depth prepass
+			depth_prepass = !depth_prepass;
+			std::cout << "Depth prepass " << (depth_prepass ? "on" : "off") << std::endl;
+		}
+		else if (key == GLFW_KEY_7 && action == GLFW_PRESS)
+		{
+			//Toggle skipping props whose bounding box was hidden last frame
+			OcclusionQueries::enabled = !OcclusionQueries::enabled;
+			std::cout << "Occlusion culling " << (OcclusionQueries::enabled ? "on" : "off") << std::endl;
+		}
+		else if (key == GLFW_KEY_Q && action == GLFW_PRESS)
+		{
+			//Print how many prop draws each pass skipped
+			OcclusionQueries::report();
+		}
+		else if (key == GLFW_KEY_8 && action == GLFW_PRESS)
+		{
+			//Toggle evening, a dim sun and a few hundred torches
+			Lights::set_evening(!Lights::evening);
+			std::cout << (Lights::evening ? "Evening, " : "Day, ") << Lights::points.size() << " point lights" << std::endl;
+		}
+		else if (key == GLFW_KEY_E && action == GLFW_PRESS)
+		{
+			//Print how many point lights land in each cluster
+			Lights::report();
+		}
+		else if (key == GLFW_KEY_9 && action == GLFW_PRESS)
+		{
+			//Toggle dynamic resolution, off renders every pass at the window size
+			DynamicResolution::set_enabled(!DynamicResolution::enabled);
+			DynamicResolution::report();
+		}
+		else if (key == GLFW_KEY_0 && action == GLFW_PRESS)
+		{
+			//Toggle low latency pacing, sleeping so input is polled as late as the frame allows
+			FramePacer::pacing = !FramePacer::pacing;
+			FramePacer::report();
+		}
+		else if (key == GLFW_KEY_K && action == GLFW_PRESS)
+		{
+			//Print input to GPU done and input to photon latency
+			FramePacer::report();
+		}
+		else if (key == GLFW_KEY_U && action == GLFW_PRESS)
+		{
+			//Print each pass's render size and GPU time
+			DynamicResolution::report();
+		}
+		else if (key == GLFW_KEY_O && action == GLFW_PRESS)
+		{
+			//Print how many times each pixel of the main pass gets shaded
+			OverdrawCounter::report(sort_opaque ? (depth_prepass ? "sorted, prepass" : "sorted") : (depth_prepass ? "scene order, prepass" : "scene order"));
 		}
 		else if (key == GLFW_KEY_T) {
 			if (mods == GLFW_MOD_SHIFT)
@@ -405,6 +767,42 @@ void Window::key_callback(GLFWwindow* window, int key, int scancode, int action,
 				illuminate_terr = !illuminate_terr;
 			}
 		}
+		else if (key == GLFW_KEY_F2 && action == GLFW_PRESS)
+		{
+			//Toggle running the simulation on its own thread
+			Simulation::start(!Simulation::is_threaded());
+			std::cout << "Simulation " << (Simulation::is_threaded() ? "threaded" : "on main thread") << std::endl;
+		}
+		else if (key == GLFW_KEY_P && action == GLFW_PRESS)
+		{
+			//Dump the CPU profiler zones as a Chrome/Perfetto trace
+			Profiler::write_trace("profile_trace.json");
+		}
+		else if (key == GLFW_KEY_G && action == GLFW_PRESS)
+		{
+			if (mods == GLFW_MOD_SHIFT)
+			{
+				//Start logging GPU pass timings to a CSV file
+				GPUTimer::open_csv("gpu_timings.csv");
+			}
+			else
+			{
+				//Toggle printing the GPU pass timing table
+				GPUTimer::enabled = !GPUTimer::enabled;
+			}
+		}
+		else if (key == GLFW_KEY_M && action == GLFW_PRESS)
+		{
+			//Print resident textures/buffers/meshes/programs and cache hit rates
+			TextureUploader::report_memory("now");
+			ResourceCache::report();
+		}
+		else if (key == GLFW_KEY_L && action == GLFW_PRESS)
+		{
+			//Toggle mesh levels of detail, off always draws full detail
+			lod_enabled = !lod_enabled;
+			std::cout << "Mesh LODs " << (lod_enabled ? "on" : "off") << std::endl;
+		}
 	}
 }
 
@@ -413,9 +811,18 @@ void Window::mouse_callback(GLFWwindow* window, int button, int action, int mods
 }
 
 void Window::cursor_callback(GLFWwindow* window, double xpos, double ypos)
+{
+	bool left = glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_LEFT) == GLFW_PRESS;
+	bool right = glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_RIGHT) == GLFW_PRESS;
+	Flythrough::log_cursor(xpos, ypos, left, right);
+	if (Flythrough::accepts_input()) move_cursor(xpos, ypos, left, right);
+}
+
+// The buttons are passed in so replayed cursor events move the camera the same way
+void Window::move_cursor(double xpos, double ypos, bool left, bool right)
 {
 	//Moving the mouse with left click rotates the camera in place
-	if (glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_LEFT) == GLFW_PRESS)
+	if (left)
 	{
 		glm::vec3 prev = trackBallMapping(glm::vec3(cursorPosX, cursorPosY, 0.0f));
 		glm::vec3 next = trackBallMapping(glm::vec3(xpos, ypos, 0.0f));
@@ -431,7 +838,7 @@ void Window::cursor_callback(GLFWwindow* window, double xpos, double ypos)
 		}
 	}
 	//Moving the mouse with right click moves the camera up and down with respect to the world
-	else if (glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_RIGHT) == GLFW_PRESS)
+	else if (right)
 	{
 		//float xDist = (xpos - cursorPosX) * 0.2f;
 		float xDist = 0;
@@ -450,6 +857,9 @@ void Window::cursor_callback(GLFWwindow* window, double xpos, double ypos)
 
 void Window::scroll_callback(GLFWwindow* window, double xoffset, double yoffset)
 {
+	Flythrough::log_scroll(xoffset, yoffset);
+	if (!Flythrough::accepts_input()) return;
+
 	//Scrolling zooms in and out
 	glm::vec3 cam_dir = glm::normalize(cam_look_at - cam_pos);
 	cam_dir = glm::vec3(cam_dir.x * yoffset, cam_dir.y * yoffset, cam_dir.z * yoffset);
@@ -20,6 +20,21 @@
 #include "Terrain.h"
 #include "Water.h"
 #include "Patch.h"
+#include "PatchNetwork.h"
+#include "GPUTimer.h"
+#include "Profiler.h"
+#include "Simulation.h"
+#include "AssetLoader.h"
+#include "TextureUploader.h"
+#include "ResourceCache.h"
+#include "ShaderCache.h"
+#include "ShaderVariants.h"
+#include "Flythrough.h"
+#include "OverdrawCounter.h"
+#include "OcclusionQueries.h"
+#include "Lights.h"
+#include "DynamicResolution.h"
+#include "FramePacer.h"
 
 class Window
 {
@@ -31,11 +46,18 @@ public:
 	static bool toon;
 	static bool illuminate_terr;
 	static bool simple_patches;
+	static bool gpu_patches;
+	static bool animate_patches;
+	static bool sort_opaque;	// Front to back with the skybox last, otherwise skybox first in scene order
+	static bool depth_prepass;
+	static bool lod_enabled;
+	static float lod_bias;	// Multiplies the pixel error OBJObject accepts when picking a LOD
 	static glm::mat4 P; // P for projection
 	static glm::mat4 V; // V for view
 	static glm::vec3 cam_pos;
 	static glm::vec3 cam_look_at;
 	static glm::vec3 cam_up;
+	static unsigned int ground_type;
 	static void initialize_objects();
 	static void clean_up();
 	static GLFWwindow* create_window(int width, int height);
@@ -46,10 +68,13 @@ public:
 	static void mouse_callback(GLFWwindow* window, int button, int action, int mods);
 	static void cursor_callback(GLFWwindow* window, double xpos, double ypos);
 	static void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
+	static void move_cursor(double xpos, double ypos, bool left, bool right);
 	static glm::vec3 trackBallMapping(glm::vec3 point);
 
 private:
-	static void render_scene(); // Object rendering minus water goes here
+	static void render_scene(bool count_overdraw = false); // Object rendering minus water goes here
+	static void draw_opaque(bool depth_only);
+	static void update_patches(double time);
 };
 
 #endif
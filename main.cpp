@@ -64,8 +64,80 @@ void print_versions()
 #endif
 }
 
-int main(void)
+int main(int argc, char** argv)
 {
+	bool tour = false;
+	const char * replay = NULL;
+	bool replay_input = false;
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--bake") == 0)
+		{
+			// Offline step, no window needed. Writes a .ctex next to every texture and exits.
+			exit(TextureBaker::bake_all(ThreadPool::default_threads() + 1) ? EXIT_SUCCESS : EXIT_FAILURE);
+		}
+		else if (strcmp(argv[i], "--bench-obj") == 0)
+		{
+			// Compare the OBJ parsers on every shipped model and exit
+			std::vector<const char *> models;
+			models.push_back("../assets/object_files/Anchor.obj");
+			models.push_back("../assets/object_files/beachball.obj");
+			models.push_back("../assets/object_files/beachchair_C.obj");
+			models.push_back("../assets/object_files/Citiezn_snips.obj");
+			models.push_back("../assets/object_files/Hut_obj.obj");
+			models.push_back("../assets/object_files/obj.obj");
+			models.push_back("../assets/object_files/Stone_F_3.obj");
+			models.push_back("../assets/object_files/Stone_Forest_1.obj");
+			ObjParser::benchmark(models);
+			exit(EXIT_SUCCESS);
+		}
+		else if (strcmp(argv[i], "--pack") == 0)
+		{
+			// Offline step after --bake: gather every asset into one archive and exit
+			exit(AssetPack::build(PACK_PATH) ? EXIT_SUCCESS : EXIT_FAILURE);
+		}
+		else if (strcmp(argv[i], "--raw-textures") == 0)
+		{
+			// Ignore baked files, for comparing against the uncompressed textures
+			TextureBaker::enabled = false;
+		}
+		else if (strcmp(argv[i], "--target-fps") == 0 && i + 1 < argc)
+		{
+			// Frame rate the dynamic resolution governor holds, 60 by default
+			DynamicResolution::target_fps = std::max(1.0, atof(argv[++i]));
+		}
+		else if (strcmp(argv[i], "--min-scale") == 0 && i + 1 < argc)
+		{
+			// Smallest fraction of the window size any pass may render at, 0.5 by default
+			float scale = std::min(std::max((float)atof(argv[++i]), 0.1f), 1.0f);
+			for (int p = 0; p < RES_PASSES; p++) DynamicResolution::min_scale[p] = scale;
+		}
+		else if (strcmp(argv[i], "--low-latency") == 0)
+		{
+			// Start with frame pacing on, same as the 0 key
+			FramePacer::pacing = true;
+		}
+		else if (strcmp(argv[i], "--max-queued") == 0 && i + 1 < argc)
+		{
+			// Frames the GPU may fall behind by, 0 leaves it to the driver, 2 by default
+			FramePacer::max_queued = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--tour") == 0)
+		{
+			// Scripted performance run: fly the fixed tour once loading is done, then exit
+			tour = true;
+		}
+		else if ((strcmp(argv[i], "--replay") == 0 || strcmp(argv[i], "--replay-input") == 0) && i + 1 < argc)
+		{
+			// Same, along a recording made with F5
+			replay_input = strcmp(argv[i], "--replay-input") == 0;
+			replay = argv[++i];
+		}
+	}
+
+	// One mapping for every asset, loose files are read when there's no pack
+	if (!VFS::mount(PACK_PATH)) std::cout << "No asset pack at " << PACK_PATH << ", reading loose files" << std::endl;
+
 	// Create the GLFW window
 	window = Window::create_window(640, 480);
 	// Print OpenGL and GLSL versions
@@ -76,6 +148,13 @@ int main(void)
 	setup_opengl_settings();
 	// Initialize objects/pointers for rendering
 	Window::initialize_objects();
+	FramePacer::init(window);
+	if (tour || replay)
+	{
+		Flythrough::exit_when_done = true;
+		if (tour) Flythrough::play_tour();
+		else if (!Flythrough::play(replay, replay_input)) Flythrough::exit_when_done = false;
+	}
 	
 	// Loop while GLFW window should stay open
 	while (!glfwWindowShouldClose(window))
@@ -86,7 +165,9 @@ int main(void)
 		Window::idle_callback();
 	}
 
+	FramePacer::clean_up();
 	Window::clean_up();
+	VFS::unmount();
 	// Destroy the window
 	glfwDestroyWindow(window);
 	// Terminate GLFW
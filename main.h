@@ -10,6 +10,11 @@
 #include <GLFW/glfw3.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <algorithm>
 #include "window.h"
+#include "ObjParser.h"
+#include "AssetPack.h"
+#include "VFS.h"
 
 #endif
\ No newline at end of file
@@ -0,0 +1,14 @@
+#version 400 core
+// Bezier patch control points, the tessellation stages evaluate the surface
+
+layout (location = 0) in vec3 position;
+
+uniform mat4 model;
+
+out vec3 WorldPos;
+
+void main()
+{
+	// Bezier patches are affine invariant, so the control points can go to world space first
+	WorldPos = vec3(model * vec4(position, 1.0));
+}
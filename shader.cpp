@@ -2,7 +2,6 @@
 #include <string>
 #include <vector>
 #include <iostream>
-#include <fstream>
 #include <algorithm>
 using namespace std;
 
@@ -15,21 +14,17 @@ using namespace std;
 #include <GLFW/glfw3.h>
 
 #include "shader.h"
+#include "Profiler.h"
+#include "VFS.h"
 
 GLuint LoadShaders(const char * vertex_file_path,const char * fragment_file_path){
-
-	// Create the shaders
-	GLuint VertexShaderID = glCreateShader(GL_VERTEX_SHADER);
-	GLuint FragmentShaderID = glCreateShader(GL_FRAGMENT_SHADER);
+	PROFILE_ZONE("LoadShaders");
 
 	// Read the Vertex Shader code from the file
 	std::string VertexShaderCode;
-	std::ifstream VertexShaderStream(vertex_file_path, std::ios::in);
-	if(VertexShaderStream.is_open()){
-		std::string Line = "";
-		while(getline(VertexShaderStream, Line))
-			VertexShaderCode += "\n" + Line;
-		VertexShaderStream.close();
+	VFSFile VertexShaderFile;
+	if(VFS::open(vertex_file_path, VertexShaderFile)){
+		VertexShaderCode.assign(VertexShaderFile.data(), VertexShaderFile.size());
 	}else{
 		printf("Impossible to open %s. Check to make sure the file exists and you passed in the right filepath!\n", vertex_file_path);
 		printf("The current working directory is:");
@@ -46,65 +41,72 @@ GLuint LoadShaders(const char * vertex_file_path,const char * fragment_file_path
 
 	// Read the Fragment Shader code from the file
 	std::string FragmentShaderCode;
-	std::ifstream FragmentShaderStream(fragment_file_path, std::ios::in);
-	if(FragmentShaderStream.is_open()){
-		std::string Line = "";
-		while(getline(FragmentShaderStream, Line))
-			FragmentShaderCode += "\n" + Line;
-		FragmentShaderStream.close();
+	VFSFile FragmentShaderFile;
+	if(VFS::open(fragment_file_path, FragmentShaderFile)){
+		FragmentShaderCode.assign(FragmentShaderFile.data(), FragmentShaderFile.size());
 	}
 
-	GLint Result = GL_FALSE;
-	int InfoLogLength;
-
-
-	// Compile Vertex Shader
 	printf("Compiling shader : %s\n", vertex_file_path);
-	char const * VertexSourcePointer = VertexShaderCode.c_str();
-	glShaderSource(VertexShaderID, 1, &VertexSourcePointer , NULL);
-	glCompileShader(VertexShaderID);
-
-	// Check Vertex Shader
-	glGetShaderiv(VertexShaderID, GL_COMPILE_STATUS, &Result);
-	glGetShaderiv(VertexShaderID, GL_INFO_LOG_LENGTH, &InfoLogLength);
-	if ( InfoLogLength > 0 ){
-		std::vector<char> VertexShaderErrorMessage(InfoLogLength+1);
-		glGetShaderInfoLog(VertexShaderID, InfoLogLength, NULL, &VertexShaderErrorMessage[0]);
-		printf("%s\n", &VertexShaderErrorMessage[0]);
-	}
-	else {
-		printf("Successfully compiled vertex shader!\n");
-	}
-
-
-
-	// Compile Fragment Shader
 	printf("Compiling shader : %s\n", fragment_file_path);
-	char const * FragmentSourcePointer = FragmentShaderCode.c_str();
-	glShaderSource(FragmentShaderID, 1, &FragmentSourcePointer , NULL);
-	glCompileShader(FragmentShaderID);
+	GLuint ProgramID = StartProgram(VertexShaderCode.c_str(), FragmentShaderCode.c_str(), false);
+	FinishProgram(ProgramID);
+	return ProgramID;
+}
 
-	// Check Fragment Shader
-	glGetShaderiv(FragmentShaderID, GL_COMPILE_STATUS, &Result);
-	glGetShaderiv(FragmentShaderID, GL_INFO_LOG_LENGTH, &InfoLogLength);
-	if ( InfoLogLength > 0 ){
-		std::vector<char> FragmentShaderErrorMessage(InfoLogLength+1);
-		glGetShaderInfoLog(FragmentShaderID, InfoLogLength, NULL, &FragmentShaderErrorMessage[0]);
-		printf("%s\n", &FragmentShaderErrorMessage[0]);
+GLuint StartProgram(const char * vertex_code, const char * fragment_code, bool retrievable, const char * control_code, const char * evaluation_code){
+	// Stages in pipeline order, FinishProgram reports them in the order they were attached
+	const GLenum Types[4] = { GL_VERTEX_SHADER, GL_TESS_CONTROL_SHADER, GL_TESS_EVALUATION_SHADER, GL_FRAGMENT_SHADER };
+	const char * Codes[4] = { vertex_code, control_code, evaluation_code, fragment_code };
+
+	// Link the program. Nothing here asks for a result, so with parallel compile the driver keeps going in the background.
+	GLuint ProgramID = glCreateProgram();
+	if (retrievable) glProgramParameteri(ProgramID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+	for (int i = 0; i < 4; i++){
+		if (Codes[i] == NULL) continue;
+		GLuint ShaderID = glCreateShader(Types[i]);
+		glShaderSource(ShaderID, 1, &Codes[i], NULL);
+		glCompileShader(ShaderID);
+		glAttachShader(ProgramID, ShaderID);
 	}
-	else {
-		printf("Successfully compiled fragment shader!\n");
+	glLinkProgram(ProgramID);
+	return ProgramID;
+}
+
+static const char * StageName(GLint Type){
+	switch (Type){
+	case GL_VERTEX_SHADER: return "vertex";
+	case GL_TESS_CONTROL_SHADER: return "tessellation control";
+	case GL_TESS_EVALUATION_SHADER: return "tessellation evaluation";
+	default: return "fragment";
 	}
+}
 
+bool FinishProgram(GLuint ProgramID){
+	PROFILE_ZONE("FinishProgram");
+	GLint Result = GL_FALSE;
+	int InfoLogLength;
 
-	// Link the program
-	printf("Linking program\n");
-	GLuint ProgramID = glCreateProgram();
-	glAttachShader(ProgramID, VertexShaderID);
-	glAttachShader(ProgramID, FragmentShaderID);
-	glLinkProgram(ProgramID);
+	// Check the shaders, vertex first like they were attached
+	GLuint Shaders[4];
+	GLsizei ShaderCount = 0;
+	glGetAttachedShaders(ProgramID, 4, &ShaderCount, Shaders);
+	for (GLsizei i = 0; i < ShaderCount; i++){
+		GLint Type;
+		glGetShaderiv(Shaders[i], GL_SHADER_TYPE, &Type);
+		glGetShaderiv(Shaders[i], GL_COMPILE_STATUS, &Result);
+		glGetShaderiv(Shaders[i], GL_INFO_LOG_LENGTH, &InfoLogLength);
+		if ( InfoLogLength > 0 ){
+			std::vector<char> ShaderErrorMessage(InfoLogLength+1);
+			glGetShaderInfoLog(Shaders[i], InfoLogLength, NULL, &ShaderErrorMessage[0]);
+			printf("%s\n", &ShaderErrorMessage[0]);
+		}
+		else {
+			printf("Successfully compiled %s shader!\n", StageName(Type));
+		}
+	}
 
 	// Check the program
+	printf("Linking program\n");
 	glGetProgramiv(ProgramID, GL_LINK_STATUS, &Result);
 	glGetProgramiv(ProgramID, GL_INFO_LOG_LENGTH, &InfoLogLength);
 	if ( InfoLogLength > 0 ){
@@ -112,12 +114,11 @@ GLuint LoadShaders(const char * vertex_file_path,const char * fragment_file_path
 		glGetProgramInfoLog(ProgramID, InfoLogLength, NULL, &ProgramErrorMessage[0]);
 		printf("%s\n", &ProgramErrorMessage[0]);
 	}
-	
-	glDetachShader(ProgramID, VertexShaderID);
-	glDetachShader(ProgramID, FragmentShaderID);
-	
-	glDeleteShader(VertexShaderID);
-	glDeleteShader(FragmentShaderID);
 
-	return ProgramID;
+	for (GLsizei i = 0; i < ShaderCount; i++){
+		glDetachShader(ProgramID, Shaders[i]);
+		glDeleteShader(Shaders[i]);
+	}
+
+	return Result == GL_TRUE;
 }
\ No newline at end of file
@@ -18,109 +18,108 @@ uniform float ambientModifier;
 uniform float diffuseModifier;
 uniform float specularModifier;
 uniform float shininess;
-uniform int mode;
-uniform bool toon;
 uniform samplerCube skybox;
 
-void main()
+// Clustered point lights, filled by Lights::build every pass. CLUSTER_X/Y/Z are the same as Lights.h.
+const int CLUSTER_X = 16;
+const int CLUSTER_Y = 9;
+const int CLUSTER_Z = 24;
+uniform samplerBuffer pointLights;		// Two texels per light: position and radius, colour
+uniform usamplerBuffer clusterGrid;		// Offset into clusterLights and light count per cluster
+uniform usamplerBuffer clusterLights;	// Light indices
+uniform vec2 clusterTile;				// Pixels per screen tile
+uniform vec4 clusterDepth;				// Near plane, far plane, slice scale, slice bias
+
+// Features are #defines put in after #version, see ShaderVariants.h:
+// SKYBOX, NORMALS and FLAT replace the lighting, TOON bands it. DEPTH_ONLY shades nothing.
+
+#ifdef TOON
+// Round to the nearest of 0, 0.2, ... 1.0 (the old < 0.1, < 0.3, ... if chain)
+float toon_band(float x)
 {
-    if (mode == 0)
-	{
-		//Phong Shading Code
-	    vec3 ambient = ambientModifier * objectColor;
-	    vec3 norm = normalize(Normal);
-
-	    float diff = max(dot(norm, lightDir), 0.0);
-		if (toon)
-		{
-			if (diff < 0.1)
-			{
-			    diff = 0;
-			}
-			else if (diff < 0.3)
-			{
-			    diff = 0.2;
-			}
-			else if (diff < 0.5)
-			{
-			    diff = 0.4;
-			}
-			else if (diff < 0.7)
-			{
-			    diff = 0.6;
-			}
-			else if (diff < 0.9)
-			{
-				diff = 0.8;
-			}
-			else
-			{
-				diff = 1.0;
-			}
-		}
-
-	    vec3 diffuse = diffuseModifier * diff * lightColor;
-
-	    vec3 viewDir = normalize(camPos - FragPos);
-	    vec3 reflectDir = reflect(-lightDir, norm);
-
-	    float spec = pow(max(dot(viewDir, reflectDir), 0.0), shininess);
-		if (toon)
-		{
-			if (spec < 0.1)
-			{
-				spec = 0;
-			}
-			else if (spec < 0.3)
-			{
-				spec = 0.2;
-			}
-			else if (spec < 0.5)
-			{
-				spec = 0.4;
-			}
-			else if (spec < 0.7)
-			{
-				spec = 0.6;
-			}
-			else if (spec < 0.9)
-			{
-				spec = 0.8;
-			}
-			else
-			{
-				spec = 1.0;
-			}
-		}
-
-	    vec3 specular = specularModifier * spec * lightColor;
-		vec3 result = vec3(0.0, 0.0, 0.0);
-
-		result = (ambient + diffuse + specular) * objectColor;
-
-		if (max(dot(norm, viewDir), 0) < 0.05 && toon)
-		{
-			color = vec4(0.0, 0.0, 0.0, 1.0);
-		}
-		else
-		{
-			color = vec4(result, 1.0);
-		}
-	}
-	else if (mode == 1)
-	{
-		//Normal Shading Code
-	    vec3 norm = normalize(Normal) * 0.5 + 0.5;
-		color = vec4(norm, 1.0);
-	}
-	else if (mode == 2)
+	return min(floor((x + 0.1) * 5.0) * 0.2, 1.0);
+}
+#endif
+
+int cluster_index()
+{
+	// View depth back out of the depth buffer value
+	float ndc = gl_FragCoord.z * 2.0 - 1.0;
+	float depth = 2.0 * clusterDepth.x * clusterDepth.y / (clusterDepth.y + clusterDepth.x - ndc * (clusterDepth.y - clusterDepth.x));
+	int slice = clamp(int(floor(log(depth) * clusterDepth.z - clusterDepth.w)) + 1, 0, CLUSTER_Z - 1);
+	ivec2 tile = min(ivec2(gl_FragCoord.xy / clusterTile), ivec2(CLUSTER_X - 1, CLUSTER_Y - 1));
+	return tile.x + CLUSTER_X * (tile.y + CLUSTER_Y * slice);
+}
+
+// Diffuse and specular from the lights in this fragment's cluster, the same terms as the sun
+vec3 point_lights(vec3 pos, vec3 norm, vec3 viewDir)
+{
+	vec3 result = vec3(0.0);
+	uvec2 range = texelFetch(clusterGrid, cluster_index()).xy;
+	for (uint i = 0u; i < range.y; i++)
 	{
-		//Skybox Shading Code
-		color = texture(skybox, TexCoords);
+		int light = int(texelFetch(clusterLights, int(range.x + i)).x);
+		vec4 sphere = texelFetch(pointLights, light * 2);
+		vec3 toLight = sphere.xyz - pos;
+		float dist2 = dot(toLight, toLight);
+		float falloff = clamp(1.0 - dist2 / (sphere.w * sphere.w), 0.0, 1.0);
+		vec3 L = toLight * inversesqrt(max(dist2, 0.0001));
+
+		float diff = max(dot(norm, L), 0.0);
+		float spec = pow(max(dot(viewDir, reflect(-L, norm)), 0.0), shininess);
+#ifdef TOON
+		diff = toon_band(diff);
+		spec = toon_band(spec);
+#endif
+		result += falloff * falloff * (diffuseModifier * diff + specularModifier * spec) * texelFetch(pointLights, light * 2 + 1).rgb;
 	}
-	else if (mode == 3)
+	return result;
+}
+
+void main()
+{
+#if defined(DEPTH_ONLY)
+	// Depth prepass, the colour mask is off
+#elif defined(SKYBOX)
+	//Skybox Shading Code
+	color = texture(skybox, TexCoords);
+#elif defined(NORMALS)
+	//Normal Shading Code
+	vec3 norm = normalize(Normal) * 0.5 + 0.5;
+	color = vec4(norm, 1.0);
+#elif defined(FLAT)
+	//Black Shading Code (for the curves)
+	color = vec4(0.0, 0.0, 0.0, 1.0);
+#else
+	//Phong Shading Code
+	vec3 ambient = ambientModifier * objectColor;
+	vec3 norm = normalize(Normal);
+
+	float diff = max(dot(norm, lightDir), 0.0);
+#ifdef TOON
+	diff = toon_band(diff);
+#endif
+
+	vec3 diffuse = diffuseModifier * diff * lightColor;
+
+	vec3 viewDir = normalize(camPos - FragPos);
+	vec3 reflectDir = reflect(-lightDir, norm);
+
+	float spec = pow(max(dot(viewDir, reflectDir), 0.0), shininess);
+#ifdef TOON
+	spec = toon_band(spec);
+#endif
+
+	vec3 specular = specularModifier * spec * lightColor;
+	vec3 result = (ambient + diffuse + specular + point_lights(FragPos, norm, viewDir)) * objectColor;
+	color = vec4(result, 1.0);
+
+#ifdef TOON
+	// Silhouette edges
+	if (max(dot(norm, viewDir), 0) < 0.05)
 	{
-		//Black Shading Code (for the curves)
 		color = vec4(0.0, 0.0, 0.0, 1.0);
 	}
+#endif
+#endif
 }
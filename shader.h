@@ -3,4 +3,10 @@
 
 GLuint LoadShaders(const char * vertex_file_path,const char * fragment_file_path);
 
+// LoadShaders in two halves. StartProgram issues the compiles and the link without waiting on any
+// of them, so with KHR_parallel_shader_compile they run in the background. FinishProgram prints the
+// logs, frees the shaders and says whether the link worked. The tessellation stages are optional.
+GLuint StartProgram(const char * vertex_code, const char * fragment_code, bool retrievable, const char * control_code = NULL, const char * evaluation_code = NULL);
+bool FinishProgram(GLuint ProgramID);
+
 #endif
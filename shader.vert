@@ -13,7 +13,6 @@ layout (location = 1) in vec3 normal;
 uniform mat4 projection;
 uniform mat4 model;
 uniform mat4 view;
-uniform int mode;
 uniform mat4 modelview;
 uniform vec3 camPos;
 uniform vec4 plane;
@@ -26,20 +25,18 @@ out vec3 Normal;
 out vec3 Eye;
 out vec3 TexCoords;
 
+// The depth prepass and the shaded pass have to land on exactly the same depths
+invariant gl_Position;
+
 void main()
 {
-    vec4 pos = modelview * vec4(position.x, position.y, position.z, 1.0);
-
-	if (mode == 2)
-	{
-		//Skybox Shading Code
-		gl_Position = projection * view * vec4(position.x, position.y, position.z, 1.0);
-	}
-	else
-	{
-		//Non-Skybox Shading Code
-		gl_Position = projection * modelview * vec4(position.x, position.y, position.z, 1.0);
-	}
+#ifdef SKYBOX
+	//Skybox Shading Code, z = w puts it on the far plane so it only fills what nothing else covered
+	gl_Position = (projection * view * vec4(position.x, position.y, position.z, 1.0)).xyww;
+#else
+	//Non-Skybox Shading Code
+	gl_Position = projection * modelview * vec4(position.x, position.y, position.z, 1.0);
+#endif
     FragPos = vec3(model * vec4(position.x, position.y, position.z, 1.0));
     Normal = mat3(transpose(inverse(model))) * normal;
 	TexCoords = position;
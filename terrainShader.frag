@@ -16,97 +16,103 @@ uniform float ambientModifier;
 uniform float diffuseModifier;
 uniform float specularModifier;
 uniform float shininess;
-uniform bool toon;
-uniform bool illuminate_terr;
+
+// Clustered point lights, the same layout as shader.frag
+const int CLUSTER_X = 16;
+const int CLUSTER_Y = 9;
+const int CLUSTER_Z = 24;
+uniform samplerBuffer pointLights;		// Two texels per light: position and radius, colour
+uniform usamplerBuffer clusterGrid;		// Offset into clusterLights and light count per cluster
+uniform usamplerBuffer clusterLights;	// Light indices
+uniform vec2 clusterTile;				// Pixels per screen tile
+uniform vec4 clusterDepth;				// Near plane, far plane, slice scale, slice bias
 
 // You can output many things. The first vec4 type output determines the color of the fragment
 out vec4 color;
 
-void main() {
-	// Turn per-pixel illumination on/off
-	if (!illuminate_terr) {
-		color = texture(terrain, texPos); 
-		return;
+// Features are #defines put in after #version, see ShaderVariants.h:
+// UNLIT is the plain texture, TOON bands the lighting. DEPTH_ONLY shades nothing.
+
+#ifdef TOON
+// Same bands as shader.frag
+float toon_band(float x)
+{
+	return min(floor((x + 0.1) * 5.0) * 0.2, 1.0);
+}
+#endif
+
+int cluster_index()
+{
+	// View depth back out of the depth buffer value
+	float ndc = gl_FragCoord.z * 2.0 - 1.0;
+	float depth = 2.0 * clusterDepth.x * clusterDepth.y / (clusterDepth.y + clusterDepth.x - ndc * (clusterDepth.y - clusterDepth.x));
+	int slice = clamp(int(floor(log(depth) * clusterDepth.z - clusterDepth.w)) + 1, 0, CLUSTER_Z - 1);
+	ivec2 tile = min(ivec2(gl_FragCoord.xy / clusterTile), ivec2(CLUSTER_X - 1, CLUSTER_Y - 1));
+	return tile.x + CLUSTER_X * (tile.y + CLUSTER_Y * slice);
+}
+
+// Same as shader.frag
+vec3 point_lights(vec3 pos, vec3 norm, vec3 viewDir)
+{
+	vec3 result = vec3(0.0);
+	uvec2 range = texelFetch(clusterGrid, cluster_index()).xy;
+	for (uint i = 0u; i < range.y; i++)
+	{
+		int light = int(texelFetch(clusterLights, int(range.x + i)).x);
+		vec4 sphere = texelFetch(pointLights, light * 2);
+		vec3 toLight = sphere.xyz - pos;
+		float dist2 = dot(toLight, toLight);
+		float falloff = clamp(1.0 - dist2 / (sphere.w * sphere.w), 0.0, 1.0);
+		vec3 L = toLight * inversesqrt(max(dist2, 0.0001));
+
+		float diff = max(dot(norm, L), 0.0);
+		float spec = pow(max(dot(viewDir, reflect(-L, norm)), 0.0), shininess);
+#ifdef TOON
+		diff = toon_band(diff);
+		spec = toon_band(spec);
+#endif
+		result += falloff * falloff * (diffuseModifier * diff + specularModifier * spec) * texelFetch(pointLights, light * 2 + 1).rgb;
 	}
+	return result;
+}
+
+void main() {
+#if defined(DEPTH_ONLY)
+	// Depth prepass, the colour mask is off
+#elif defined(UNLIT)
+	color = texture(terrain, texPos);
+#else
+	vec3 albedo = vec3(texture(terrain, texPos));
 
 	//Phong Shading Code
-	vec3 ambient = ambientModifier * vec3(texture(terrain, texPos));
+	vec3 ambient = ambientModifier * albedo;
 	vec3 norm = normalize(Normal);
 
 	float diff = max(dot(norm, lightDir), 0.0);
-	if (toon)
-	{
-		if (diff < 0.1)
-		{
-		    diff = 0;
-		}
-		else if (diff < 0.3)
-		{
-		    diff = 0.2;
-		}
-		else if (diff < 0.5)
-		{
-		    diff = 0.4;
-		}
-		else if (diff < 0.7)
-		{
-		    diff = 0.6;
-		}
-		else if (diff < 0.9)
-		{
-			diff = 0.8;
-		}
-		else
-		{
-			diff = 1.0;
-		}
-	}
-
-    vec3 diffuse = diffuseModifier * diff * lightColor * vec3(texture(terrain, texPos));
+#ifdef TOON
+	diff = toon_band(diff);
+#endif
 
-    vec3 viewDir = normalize(eyeVec);
-    vec3 reflectDir = reflect(-lightDir, norm);
+	vec3 diffuse = diffuseModifier * diff * lightColor * albedo;
 
-    float spec = pow(max(dot(viewDir, reflectDir), 0.0), shininess);
-	if (toon)
-	{
-		if (spec < 0.1)
-		{
-			spec = 0;
-		}
-		else if (spec < 0.3)
-		{
-			spec = 0.2;
-		}
-		else if (spec < 0.5)
-		{
-			spec = 0.4;
-		}
-		else if (spec < 0.7)
-		{
-			spec = 0.6;
-		}
-		else if (spec < 0.9)
-		{
-			spec = 0.8;
-		}
-		else
-		{
-			spec = 1.0;
-		}
-	}
+	vec3 viewDir = normalize(eyeVec);
+	vec3 reflectDir = reflect(-lightDir, norm);
 
-    vec3 specular = specularModifier * spec * lightColor * vec3(texture(terrain, texPos));
-	vec3 result = vec3(0.0, 0.0, 0.0);
+	float spec = pow(max(dot(viewDir, reflectDir), 0.0), shininess);
+#ifdef TOON
+	spec = toon_band(spec);
+#endif
 
-	result = (ambient + diffuse + specular);
+	vec3 specular = specularModifier * spec * lightColor * albedo;
+	vec3 result = ambient + diffuse + specular + point_lights(FragPos, norm, viewDir) * albedo;
+	color = vec4(result, 1.0);
 
-	if (max(dot(norm, viewDir), 0) < 0.05 && toon)
+#ifdef TOON
+	// Silhouette edges
+	if (max(dot(norm, viewDir), 0) < 0.05)
 	{
 		color = vec4(0.0, 0.0, 0.0, 1.0);
 	}
-	else
-	{
-		color = vec4(result, 1.0);
-	}
-}
\ No newline at end of file
+#endif
+#endif
+}
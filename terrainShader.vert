@@ -19,6 +19,8 @@ out vec3 Normal;
 out vec3 FragPos;
 out vec3 eyeVec;
 
+invariant gl_Position;	// Same depth in the prepass and the shaded pass
+
 // Constants
 const float tile = 25.0;
 
@@ -0,0 +1,15 @@
+#version 330 core
+// Stretches the rendered corner of the scene texture over the window, see DynamicResolution.h
+
+in vec2 uv;
+
+uniform sampler2D scene;
+uniform vec2 uv_scale;		// Part of the texture the main pass rendered
+uniform vec2 uv_limit;		// Half a texel in from that part's far edges, so filtering never reads past it
+
+out vec4 color;
+
+void main()
+{
+	color = texture(scene, min(uv * uv_scale, uv_limit));
+}